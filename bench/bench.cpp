@@ -0,0 +1,315 @@
+// Microbenchmarks for the bot's hot paths: MAC parsing (setupWOL), magic
+// packet assembly (sendWOL), update parsing (getTelegramUpdates), reply URL
+// building and encoding (sendTelegram), whitelist matching (processCommand)
+// per-chat rate limiting, progress bar rendering (checkServerMonitoring) and
+// the deferred logger.
+//
+//   pio run -e bench_native -t exec                 Linux
+//   pio run -e bench_esp32 -t upload -t monitor     on-device, report over Serial
+//
+// Every case reports ns/op, heap allocations per op and the peak heap one op
+// holds. Both environments link with -Wl,--wrap for malloc/free/realloc/calloc
+// so allocations made inside ArduinoJson and libc are counted too.
+
+#include <AsyncLog.h>
+#include <BotCore.h>
+#include <WolPacket.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#else
+#include <malloc.h>
+#include <time.h>
+#include <new>
+#endif
+
+// ========== ALLOCATION COUNTING ==========
+extern "C" {
+void* __real_malloc(size_t size);
+void __real_free(void* ptr);
+void* __real_realloc(void* ptr, size_t size);
+void* __real_calloc(size_t count, size_t size);
+}
+
+struct AllocStats {
+  uint32_t count;
+  long live;
+  long peak;
+};
+
+static AllocStats allocStats;
+static bool tracking = false;
+
+#ifdef ARDUINO
+static TaskHandle_t benchTask = NULL;
+
+// Wi-Fi and system tasks allocate in the background, only count our task
+static bool tracked() {
+  return tracking && xTaskGetCurrentTaskHandle() == benchTask;
+}
+
+static size_t blockSize(void* ptr) {
+  return heap_caps_get_allocated_size(ptr);
+}
+#else
+static bool tracked() {
+  return tracking;
+}
+
+static size_t blockSize(void* ptr) {
+  return malloc_usable_size(ptr);
+}
+#endif
+
+static void onAlloc(void* ptr) {
+  allocStats.count++;
+  allocStats.live += blockSize(ptr);
+  if (allocStats.live > allocStats.peak) allocStats.peak = allocStats.live;
+}
+
+extern "C" void* __wrap_malloc(size_t size) {
+  void* ptr = __real_malloc(size);
+  if (ptr && tracked()) onAlloc(ptr);
+  return ptr;
+}
+
+extern "C" void* __wrap_calloc(size_t count, size_t size) {
+  void* ptr = __real_calloc(count, size);
+  if (ptr && tracked()) onAlloc(ptr);
+  return ptr;
+}
+
+extern "C" void __wrap_free(void* ptr) {
+  if (ptr && tracked()) allocStats.live -= blockSize(ptr);
+  __real_free(ptr);
+}
+
+extern "C" void* __wrap_realloc(void* ptr, size_t size) {
+  bool track = tracked();
+  if (ptr && track) allocStats.live -= blockSize(ptr);
+  void* result = __real_realloc(ptr, size);
+  if (result && track) onAlloc(result);
+  return result;
+}
+
+#ifndef ARDUINO
+// libstdc++ is a shared library on Linux, route operator new through the wrap
+void* operator new(size_t size) {
+  void* ptr = __wrap_malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  __wrap_free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  __wrap_free(ptr);
+}
+#endif
+
+// ========== PLATFORM ==========
+static uint64_t nowNanos() {
+#ifdef ARDUINO
+  return (uint64_t)esp_timer_get_time() * 1000;
+#else
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void report(const char* fmt, ...) {
+  char line[160];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+#ifdef ARDUINO
+  Serial.println(line);
+#else
+  puts(line);
+#endif
+}
+
+// ========== FIXTURES ==========
+static const char* const sampleMac = "A1:AA:1A:1A:11:A1";
+
+static const char* const sampleUpdate =
+    "{\"ok\":true,\"result\":[{\"update_id\":815372941,\"message\":{\"message_id\":4711,"
+    "\"from\":{\"id\":1111111111,\"is_bot\":false,\"first_name\":\"Admin\",\"language_code\":\"en\"},"
+    "\"chat\":{\"id\":1111111111,\"first_name\":\"Admin\",\"type\":\"private\"},"
+    "\"date\":1760000000,\"text\":\"/wake\",\"entities\":[{\"offset\":0,\"length\":5,\"type\":\"bot_command\"}]}}]}";
+
+static const char* const sampleReply =
+    "✅ WoL sent!\n\n"
+    "📊 Starting boot monitoring:\n"
+    "• Expected time: 20-50 seconds\n"
+    "• Maximum: 90 seconds\n"
+    "• Check every 3 sec\n"
+    "• Progress every 15 sec\n\n"
+    "I'll notify you when server boots with timing statistics!";
+
+static const char* const sampleToken = "1234567890:ABCdefGHIJKlmnoPQRstuVWXYZ012345678";
+
+static const char* const sampleWhitelist[] = {"1111111111", "2222222222", "3333333333", ""};
+
+// Results land here so the compiler can't drop the work
+static volatile uint32_t sink;
+
+// ========== CASES ==========
+static void benchMacParse() {
+  uint8_t mac[WOL_MAC_SIZE];
+  sink += parseMac(sampleMac, mac) ? mac[5] : 0;
+}
+
+static void benchMagicPacket() {
+  static const uint8_t mac[WOL_MAC_SIZE] = {0xA1, 0xAA, 0x1A, 0x1A, 0x11, 0xA1};
+  uint8_t packet[WOL_PACKET_SIZE];
+  buildMagicPacket(mac, packet);
+  sink += packet[WOL_PACKET_SIZE - 1];
+}
+
+static void benchUpdateParse() {
+  static TelegramUpdate update;
+  sink += parseTelegramUpdate(sampleUpdate, strlen(sampleUpdate), update) ? update.text[1] : 0;
+}
+
+// Same two passes sendTelegram() does: measure, then build into the heap
+static void benchReplyUrl() {
+  size_t len = buildSendMessageUrl(sampleToken, "1111111111", sampleReply, NULL, 0);
+  char* url = (char*)malloc(len + 1);
+  buildSendMessageUrl(sampleToken, "1111111111", sampleReply, url, len + 1);
+  sink += url[len - 1];
+  free(url);
+}
+
+static void benchWhitelistHit() {
+  sink += isAllowedChat("3333333333", sampleWhitelist, 4);
+}
+
+static void benchWhitelistMiss() {
+  sink += isAllowedChat("9999999999", sampleWhitelist, 4);
+}
+
+// A flooding chat: mostly drops from a table that also holds other chats
+static void benchRateLimit() {
+  static ChatRateLimiter limiter(5, 3000, 60000);
+  static uint32_t now = 0;
+  now += 7;
+  sink += limiter.take(sampleWhitelist[now % 3], now);
+}
+
+static void benchProgress() {
+  static int percent = 0;
+  char bar[48];
+  sink += renderProgress(percent, bar, sizeof(bar));
+  percent = (percent + 7) % 101;
+}
+
+// Nothing drains the ring here, so after the first LOG_CAPACITY records this
+// is what a log flood costs the caller: a failed reservation and a counter
+static void benchLogDrop() {
+  static uint32_t n = 0;
+  logRecord(LOG_LEVEL_INFO, "📨 Command: %s after %lu ms", logCopy("/wake"), (unsigned long)++n);
+}
+
+// Record plus the deferred formatting the drain task does
+static void benchLogFormat() {
+  char line[LOG_LINE_MAX];
+  logRecord(LOG_LEVEL_INFO, "🔎 Stage %s after %lu ms", "ARP", (unsigned long)sink);
+  sink += logPop(line, sizeof(line));
+}
+
+struct Bench {
+  const char* name;
+  void (*fn)();
+};
+
+static const Bench benches[] = {
+  {"mac_parse", benchMacParse},
+  {"magic_packet", benchMagicPacket},
+  {"update_parse", benchUpdateParse},
+  {"reply_url", benchReplyUrl},
+  {"whitelist_hit", benchWhitelistHit},
+  {"whitelist_miss", benchWhitelistMiss},
+  {"rate_limit", benchRateLimit},
+  {"progress_bar", benchProgress},
+  {"log_drop", benchLogDrop},
+  {"log_format", benchLogFormat},
+};
+
+// ========== RUNNER ==========
+#ifdef ARDUINO
+static const uint64_t MIN_RUN_NANOS = 200000000ULL;   // 200 ms per case
+#else
+static const uint64_t MIN_RUN_NANOS = 500000000ULL;   // 500 ms per case
+#endif
+static const uint32_t ALLOC_PASS_OPS = 64;
+
+static void runBench(const Bench& bench) {
+  // Warm up static state, then double the batch until it runs long enough
+  bench.fn();
+  uint32_t iterations = 16;
+  uint64_t elapsed = 0;
+  for (;;) {
+    uint64_t start = nowNanos();
+    for (uint32_t i = 0; i < iterations; i++) bench.fn();
+    elapsed = nowNanos() - start;
+    if (elapsed >= MIN_RUN_NANOS || iterations >= (1u << 30)) break;
+    iterations *= 2;
+  }
+
+  // Allocations are counted in a separate pass so timing stays clean
+  uint32_t allocs = 0;
+  long peak = 0;
+  for (uint32_t i = 0; i < ALLOC_PASS_OPS; i++) {
+    allocStats = AllocStats();
+    tracking = true;
+    bench.fn();
+    tracking = false;
+    allocs += allocStats.count;
+    if (allocStats.peak > peak) peak = allocStats.peak;
+  }
+
+  report("%-16s %10lu %12.1f %10.2f %10ld", bench.name, (unsigned long)iterations,
+         (double)elapsed / iterations, (double)allocs / ALLOC_PASS_OPS, peak);
+}
+
+static void runAll() {
+  report("%-16s %10s %12s %10s %10s", "case", "iters", "ns/op", "allocs/op", "peak B/op");
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    runBench(benches[i]);
+  }
+}
+
+#ifdef ARDUINO
+void setup() {
+  Serial.begin(115200);
+  delay(2000);
+  benchTask = xTaskGetCurrentTaskHandle();
+
+  report("=== WoL bot microbenchmarks, %lu MHz, free heap %lu ===",
+         (unsigned long)getCpuFrequencyMhz(), (unsigned long)ESP.getFreeHeap());
+  runAll();
+  report("=== done, min free heap %lu ===", (unsigned long)ESP.getMinFreeHeap());
+}
+
+void loop() {
+  delay(1000);
+}
+#else
+int main() {
+  report("=== WoL bot microbenchmarks, native ===");
+  runAll();
+  return 0;
+}
+#endif
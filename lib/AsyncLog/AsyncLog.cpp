@@ -0,0 +1,166 @@
+#include "AsyncLog.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_timer.h>
+#else
+#include <time.h>
+#endif
+
+static_assert((LOG_CAPACITY & (LOG_CAPACITY - 1)) == 0, "LOG_CAPACITY must be a power of two");
+
+struct LogRecord {
+  const char* format;
+  uint32_t micros;
+  uint8_t level;
+  int8_t copyIndex;
+  uintptr_t args[LOG_MAX_ARGS];
+  char copy[LOG_COPY_SIZE];
+};
+
+// Bounded MPMC queue (Vyukov), used with a single consumer. A slot's
+// sequence is stored minus its index so zero-initialized memory is a valid
+// empty ring without any setup call.
+struct LogSlot {
+  std::atomic<uint32_t> sequence;
+  LogRecord record;
+};
+
+static LogSlot ring[LOG_CAPACITY];
+static std::atomic<uint32_t> enqueuePos(0);
+static uint32_t dequeuePos = 0;
+static std::atomic<uint32_t> dropped(0);
+static std::atomic<uint32_t> written(0);
+static uint32_t droppedReported = 0;
+static bool dropLineLast = false;       // A drop line never follows a drop line, so a flood can't starve the ring
+
+static uint32_t logMicros() {
+#ifdef ARDUINO
+  return (uint32_t)esp_timer_get_time();
+#else
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+#endif
+}
+
+bool logPush(uint8_t level, const char* format, const LogArgs& args) {
+  uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+  LogSlot* slot;
+  for (;;) {
+    uint32_t index = pos % LOG_CAPACITY;
+    slot = &ring[index];
+    uint32_t sequence = slot->sequence.load(std::memory_order_acquire) + index;
+    int32_t diff = (int32_t)(sequence - pos);
+    if (diff == 0) {
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  LogRecord& record = slot->record;
+  record.format = format;
+  record.micros = logMicros();
+  record.level = level;
+  record.copyIndex = args.copyIndex;
+  for (int i = 0; i < LOG_MAX_ARGS; i++) record.args[i] = i < args.count ? args.values[i] : 0;
+  if (args.copyIndex >= 0) {
+    strncpy(record.copy, args.copyText ? args.copyText : "", LOG_COPY_SIZE - 1);
+    record.copy[LOG_COPY_SIZE - 1] = '\0';
+  }
+
+  slot->sequence.store(pos + 1 - pos % LOG_CAPACITY, std::memory_order_release);
+  written.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+size_t logPop(char* out, size_t cap) {
+  if (!cap) return 0;
+
+  int len;
+  uint32_t drops = dropped.load(std::memory_order_relaxed);
+  if (drops != droppedReported && !dropLineLast) {
+    dropLineLast = true;
+    len = snprintf(out, cap, "⚠️ log: %lu records dropped\n", (unsigned long)(drops - droppedReported));
+    droppedReported = drops;
+    return len < (int)cap ? len : cap - 1;
+  }
+
+  uint32_t index = dequeuePos % LOG_CAPACITY;
+  LogSlot& slot = ring[index];
+  uint32_t sequence = slot.sequence.load(std::memory_order_acquire) + index;
+  if ((int32_t)(sequence - (dequeuePos + 1)) < 0) {
+    dropLineLast = false;
+    return 0;
+  }
+  dropLineLast = false;
+
+  LogRecord record = slot.record;
+  slot.sequence.store(dequeuePos + LOG_CAPACITY - index, std::memory_order_release);
+  dequeuePos++;
+
+  if (record.copyIndex >= 0) record.args[record.copyIndex] = (uintptr_t)record.copy;
+
+  static const char levels[] = "-EWID";
+  len = snprintf(out, cap, "[%6lu.%03lu] %c ", (unsigned long)(record.micros / 1000000),
+                 (unsigned long)(record.micros / 1000 % 1000), levels[record.level <= LOG_LEVEL_DEBUG ? record.level : 0]);
+  if (len < 0 || len >= (int)cap) return 0;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+  int body = snprintf(out + len, cap - len, record.format, record.args[0], record.args[1], record.args[2], record.args[3],
+                  record.args[4], record.args[5]);
+#pragma GCC diagnostic pop
+  if (body > 0) len += body;
+  if (len > (int)cap - 2) len = cap - 2;
+  out[len++] = '\n';
+  out[len] = '\0';
+  return len;
+}
+
+uint32_t logDropped() {
+  return dropped.load(std::memory_order_relaxed);
+}
+
+uint32_t logWritten() {
+  return written.load(std::memory_order_relaxed);
+}
+
+#ifdef ARDUINO
+// Dekker-style handshake with logPauseDrain(): both flags are seq_cst, so
+// either the task sees the pause or the pauser sees the task draining
+static std::atomic<bool> drainPaused(false);
+static std::atomic<bool> draining(false);
+
+static void logTask(void* arg) {
+  char line[LOG_LINE_MAX];
+  for (;;) {
+    draining = true;
+    // Only take a record when USB CDC / UART can accept a full line without blocking
+    size_t len;
+    while (!drainPaused && Serial.availableForWrite() >= (int)LOG_LINE_MAX && (len = logPop(line, sizeof(line))) > 0) {
+      Serial.write((const uint8_t*)line, len);
+    }
+    draining = false;
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+}
+
+void logPauseDrain(bool paused) {
+  drainPaused = paused;
+  while (paused && draining) vTaskDelay(1);
+}
+
+void logStartTask() {
+  xTaskCreate(logTask, "log", 3072, NULL, tskIDLE_PRIORITY, NULL);
+}
+#endif
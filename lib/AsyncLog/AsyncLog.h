@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Deferred, leveled logging. A log call stores the format string pointer
+// (it lives in flash and doubles as the format ID), a timestamp and up to
+// six raw arguments into a lock-free ring; formatting happens later, when a
+// low-priority task drains the ring to Serial. Logging never blocks or
+// allocates: when the ring is full the record is dropped and counted.
+//
+// Arguments are stored as integers, so formats may only use %d %u %x %ld %lu
+// %c and %s. A %s argument must be a static string (literal, config entry)
+// unless wrapped in logCopy(), which copies up to LOG_COPY_SIZE - 1 bytes
+// into the record (one copy per record).
+//
+// Levels below LOG_LEVEL compile to nothing, e.g. -DLOG_LEVEL=LOG_LEVEL_WARN.
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_CAPACITY
+#define LOG_CAPACITY 64        // Records, power of two
+#endif
+
+const int LOG_MAX_ARGS = 6;
+const size_t LOG_COPY_SIZE = 24;
+const size_t LOG_LINE_MAX = 192;
+
+struct LogCopy {
+  const char* text;
+};
+
+inline LogCopy logCopy(const char* text) {
+  return LogCopy{text};
+}
+
+struct LogArgs {
+  uintptr_t values[LOG_MAX_ARGS];
+  uint8_t count;
+  int8_t copyIndex;            // Argument replaced by the copied text, -1 = none
+  const char* copyText;
+};
+
+inline void logStore(LogArgs& args, LogCopy copy) {
+  if (args.count >= LOG_MAX_ARGS) return;
+  args.copyIndex = args.count;
+  args.copyText = copy.text;
+  args.values[args.count++] = 0;
+}
+
+template <typename T>
+inline void logStore(LogArgs& args, T value) {
+  if (args.count < LOG_MAX_ARGS) args.values[args.count++] = (uintptr_t)value;
+}
+
+inline void logPack(LogArgs&) {}
+
+template <typename T, typename... Rest>
+inline void logPack(LogArgs& args, T value, Rest... rest) {
+  logStore(args, value);
+  logPack(args, rest...);
+}
+
+// Enqueues one record; false if the ring was full and it was dropped
+bool logPush(uint8_t level, const char* format, const LogArgs& args);
+
+template <typename... Args>
+inline void logRecord(uint8_t level, const char* format, Args... values) {
+  LogArgs args;
+  args.count = 0;
+  args.copyIndex = -1;
+  args.copyText = 0;
+  logPack(args, values...);
+  logPush(level, format, args);
+}
+
+// Consumer side, single reader. Formats the next line (with a trailing
+// newline) into out; a line about dropped records comes first when new
+// drops happened. Returns the line length, 0 when the ring is empty.
+size_t logPop(char* out, size_t cap);
+uint32_t logDropped();
+uint32_t logWritten();
+
+#ifdef ARDUINO
+// Starts the task that drains the ring to Serial at idle priority
+void logStartTask();
+// Holds the task between two lines, so the caller can write to Serial
+// without interleaving; records keep queueing (and dropping) meanwhile.
+// logPauseDrain(true) returns once no line is being written.
+void logPauseDrain(bool paused);
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logRecord(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logRecord(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logRecord(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logRecord(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
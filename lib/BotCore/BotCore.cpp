@@ -0,0 +1,203 @@
+#include "BotCore.h"
+
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <string.h>
+
+// Appends to a bounded buffer while counting the full length
+struct Appender {
+  char* out;
+  size_t cap;
+  size_t len;
+
+  Appender(char* buffer, size_t capacity) : out(buffer), cap(capacity), len(0) {
+    if (cap) out[0] = '\0';
+  }
+
+  void put(char c) {
+    if (len + 1 < cap) {
+      out[len] = c;
+      out[len + 1] = '\0';
+    }
+    len++;
+  }
+
+  void put(const char* s) {
+    while (*s) put(*s++);
+  }
+};
+
+int parseTelegramUpdates(const char* json, size_t len, TelegramUpdate* updates, int max) {
+  int count = 0;
+  {
+    StaticJsonDocument<128> filter;
+    filter["result"][0]["update_id"] = true;
+    DynamicJsonDocument ids(JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(max) + max * JSON_OBJECT_SIZE(1) + 32);
+    if (deserializeJson(ids, json, len, DeserializationOption::Filter(filter))) return 0;
+
+    for (JsonObject result : ids["result"].as<JsonArray>()) {
+      if (count == max) break;
+      TelegramUpdate& update = updates[count++];
+      update.updateId = result["update_id"].as<int32_t>();
+      update.complete = false;
+      update.hasMessage = false;
+      update.chatId[0] = '\0';
+      update.text[0] = '\0';
+    }
+  }
+  if (count == 0) return 0;
+
+  // Only the fields the bot reads, a single update gets the old 2 KB
+  StaticJsonDocument<256> filter;
+  filter["result"][0]["update_id"] = true;
+  filter["result"][0]["message"]["chat"]["id"] = true;
+  filter["result"][0]["message"]["text"] = true;
+  DynamicJsonDocument doc(1536 + count * TELEGRAM_TEXT_MAX);
+  if (deserializeJson(doc, json, len, DeserializationOption::Filter(filter))) return count;
+
+  JsonArray results = doc["result"];
+  for (int i = 0; i < count; i++) {
+    JsonObject result = results[i];
+    TelegramUpdate& update = updates[i];
+    if (result["update_id"].as<int32_t>() != update.updateId) continue;
+
+    update.complete = true;
+    update.hasMessage = result.containsKey("message");
+    if (!update.hasMessage) continue;
+
+    JsonObject message = result["message"];
+    serializeJson(message["chat"]["id"], update.chatId, sizeof(update.chatId));
+    const char* text = message["text"] | "";
+    snprintf(update.text, sizeof(update.text), "%s", text);
+  }
+  return count;
+}
+
+bool parseTelegramUpdate(const char* json, size_t len, TelegramUpdate& update) {
+  return parseTelegramUpdates(json, len, &update, 1) == 1;
+}
+
+static void appendEncoded(Appender& out, const char* text) {
+  static const char hex[] = "0123456789ABCDEF";
+  for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+    unsigned char c = *p;
+    bool plain = c >= 0x80 || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                 (c >= '0' && c <= '9') || strchr("-_.~!*'():/,@", c);
+    if (plain) {
+      out.put((char)c);
+    } else {
+      out.put('%');
+      out.put(hex[c >> 4]);
+      out.put(hex[c & 0xF]);
+    }
+  }
+}
+
+size_t urlEncode(const char* text, char* out, size_t cap) {
+  Appender app(out, cap);
+  appendEncoded(app, text);
+  return app.len;
+}
+
+size_t buildSendMessageUrl(const char* botToken, const char* chatId, const char* text, char* out, size_t cap) {
+  Appender app(out, cap);
+  app.put("https://api.telegram.org/bot");
+  app.put(botToken);
+  app.put("/sendMessage?chat_id=");
+  appendEncoded(app, chatId);
+  app.put("&text=");
+  appendEncoded(app, text);
+  return app.len;
+}
+
+size_t renderProgress(int percent, char* out, size_t cap) {
+  if (percent < 0) percent = 0;
+  if (percent > 100) percent = 100;
+
+  Appender app(out, cap);
+  app.put('[');
+  for (int i = 0; i < 10; i++) {
+    app.put(i < percent / 10 ? "█" : "░");
+  }
+  char tail[8];
+  snprintf(tail, sizeof(tail), "] %d%%", percent);
+  app.put(tail);
+  return app.len;
+}
+
+bool isAllowedChat(const char* chatId, const char* const* allowed, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (allowed[i][0] && strcmp(allowed[i], chatId) == 0) return true;
+  }
+  return false;
+}
+
+// ========== RATE LIMITING ==========
+ChatRateLimiter::ChatRateLimiter(uint8_t burst, uint32_t refillMs, uint32_t noticeWindowMs)
+    : refillMs_(refillMs ? refillMs : 1),
+      capacity_((burst ? burst : 1) * refillMs_),
+      noticeWindowMs_(noticeWindowMs),
+      unauthorizedNoticed_(false),
+      unauthorizedNoticeMs_(0) {
+  memset(slots_, 0, sizeof(slots_));
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+ChatRateLimiter::Slot& ChatRateLimiter::slotFor(const char* chatId, uint32_t nowMs) {
+  // FNV-1a, chat ids are short decimal strings
+  uint32_t hash = 2166136261u;
+  for (const char* p = chatId; *p; p++) hash = (hash ^ (uint8_t)*p) * 16777619u;
+
+  Slot* oldest = &slots_[0];
+  for (int i = 0; i < SLOTS; i++) {
+    Slot& slot = slots_[i];
+    if (slot.used && slot.hash == hash && strcmp(slot.chatId, chatId) == 0) {
+      uint32_t elapsed = nowMs - slot.lastMs;
+      slot.credit = elapsed >= capacity_ - slot.credit ? capacity_ : slot.credit + elapsed;
+      slot.lastMs = nowMs;
+      return slot;
+    }
+    if (!slot.used) {
+      oldest = &slot;
+    } else if (oldest->used && (int32_t)(slot.lastMs - oldest->lastMs) < 0) {
+      oldest = &slot;
+    }
+  }
+
+  if (oldest->used) stats_.evictions++;
+  memset(oldest, 0, sizeof(Slot));
+  oldest->used = true;
+  oldest->hash = hash;
+  snprintf(oldest->chatId, sizeof(oldest->chatId), "%s", chatId);
+  oldest->credit = capacity_;
+  oldest->lastMs = nowMs;
+  return *oldest;
+}
+
+bool ChatRateLimiter::take(const char* chatId, uint32_t nowMs) {
+  Slot& slot = slotFor(chatId, nowMs);
+  if (slot.credit < refillMs_) {
+    stats_.limited++;
+    return false;
+  }
+  slot.credit -= refillMs_;
+  stats_.passed++;
+  return true;
+}
+
+bool ChatRateLimiter::notice(const char* chatId, uint32_t nowMs) {
+  Slot& slot = slotFor(chatId, nowMs);
+  if (slot.noticed && nowMs - slot.noticeMs < noticeWindowMs_) return false;
+  slot.noticed = true;
+  slot.noticeMs = nowMs;
+  stats_.notices++;
+  return true;
+}
+
+bool ChatRateLimiter::noticeUnauthorized(uint32_t nowMs) {
+  if (unauthorizedNoticed_ && nowMs - unauthorizedNoticeMs_ < noticeWindowMs_) return false;
+  unauthorizedNoticed_ = true;
+  unauthorizedNoticeMs_ = nowMs;
+  stats_.notices++;
+  return true;
+}
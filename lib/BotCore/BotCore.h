@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hot helpers of the bot loop, kept free of Arduino types so bench/ can run
+// them on Linux as well as on the device.
+
+const size_t TELEGRAM_CHAT_ID_MAX = 24;
+const size_t TELEGRAM_TEXT_MAX = 512;
+
+struct TelegramUpdate {
+  int32_t updateId;
+  bool complete;                     // False: only updateId could be read
+  bool hasMessage;
+  char chatId[TELEGRAM_CHAT_ID_MAX];
+  char text[TELEGRAM_TEXT_MAX];      // Truncated if longer
+};
+
+// Parses up to `max` updates of a getUpdates response, returns how many.
+// Update ids are read in a pass of their own, so even a response too big to
+// parse whole still yields them (with complete = false) and the caller can
+// move its offset past it instead of fetching it forever.
+int parseTelegramUpdates(const char* json, size_t len, TelegramUpdate* updates, int max);
+
+// The first update only; false if the response has none
+bool parseTelegramUpdate(const char* json, size_t len, TelegramUpdate& update);
+
+// The size_t helpers below work like snprintf: they return the full length
+// needed (without the terminator) and write at most cap - 1 characters.
+// Pass out = NULL, cap = 0 to only measure.
+
+// Percent-encodes a message for a query string. UTF-8 (emoji) passes through.
+size_t urlEncode(const char* text, char* out, size_t cap);
+
+size_t buildSendMessageUrl(const char* botToken, const char* chatId, const char* text, char* out, size_t cap);
+
+// "[████░░░░░░] 40%"
+size_t renderProgress(int percent, char* out, size_t cap);
+
+// Empty whitelist entries never match
+bool isAllowedChat(const char* chatId, const char* const* allowed, size_t count);
+
+// Per-chat token buckets in a small fixed table, so a flood is dropped before
+// the bot spends any network I/O on it. Each chat may send `burst` commands
+// back-to-back and then one per refillMs. The least recently seen chat is
+// evicted when the table is full and simply starts again with a full bucket.
+// Only whitelisted chats get a slot: unknown chats share one notice budget,
+// so any number of them can't push a whitelisted chat out of the table.
+class ChatRateLimiter {
+ public:
+  struct Stats {
+    uint32_t passed;
+    uint32_t limited;      // Commands dropped for an empty bucket
+    uint32_t notices;      // Rejections that may be answered
+    uint32_t evictions;
+  };
+
+  ChatRateLimiter(uint8_t burst, uint32_t refillMs, uint32_t noticeWindowMs);
+
+  // Takes one token; false means drop the command
+  bool take(const char* chatId, uint32_t nowMs);
+  // True at most once per notice window per chat: answer this rejection
+  bool notice(const char* chatId, uint32_t nowMs);
+  // Same for chats outside the whitelist, but once per window for all of them
+  bool noticeUnauthorized(uint32_t nowMs);
+  const Stats& stats() const { return stats_; }
+
+ private:
+  static const int SLOTS = 8;
+  struct Slot {
+    bool used;
+    bool noticed;
+    uint32_t hash;         // Of chatId, checked first
+    char chatId[TELEGRAM_CHAT_ID_MAX];
+    uint32_t credit;       // Milliseconds of refill time banked, refillMs per token
+    uint32_t lastMs;
+    uint32_t noticeMs;
+  };
+
+  Slot& slotFor(const char* chatId, uint32_t nowMs);
+
+  uint32_t refillMs_;
+  uint32_t capacity_;
+  uint32_t noticeWindowMs_;
+  Slot slots_[SLOTS];
+  bool unauthorizedNoticed_;
+  uint32_t unauthorizedNoticeMs_;
+  Stats stats_;
+};
@@ -0,0 +1,126 @@
+#include "CronSchedule.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Parses one field into a bit mask; `text` points into a writable copy
+static bool parseField(char* text, int lo, int hi, uint64_t& mask) {
+  mask = 0;
+  char* save;
+  for (char* item = strtok_r(text, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+    int step = 1;
+    char* slash = strchr(item, '/');
+    if (slash) {
+      *slash = '\0';
+      char* stepEnd;
+      step = (int)strtol(slash + 1, &stepEnd, 10);
+      if (stepEnd == slash + 1 || *stepEnd != '\0' || step <= 0 || step > hi) return false;
+    }
+
+    int from, to;
+    if (strcmp(item, "*") == 0) {
+      from = lo;
+      to = hi;
+    } else {
+      char* end;
+      from = (int)strtol(item, &end, 10);
+      if (end == item) return false;
+      to = from;
+      if (*end == '-') {
+        char* rangeEnd;
+        to = (int)strtol(end + 1, &rangeEnd, 10);
+        if (rangeEnd == end + 1) return false;
+        end = rangeEnd;
+      } else if (slash) {
+        to = hi;  // "5/15" means 5-hi/15
+      }
+      if (*end != '\0') return false;
+    }
+
+    if (from < lo || to > hi || from > to) return false;
+    for (int v = from; v <= to; v += step) mask |= 1ULL << v;
+  }
+  return mask != 0;
+}
+
+bool parseCron(const char* text, CronSpec& spec) {
+  char copy[64];
+  if (strlen(text) >= sizeof(copy)) return false;
+  strcpy(copy, text);
+
+  // Split into five whitespace separated fields
+  char* fields[5];
+  int count = 0;
+  for (char* p = copy; *p && count <= 5;) {
+    while (*p == ' ' || *p == '\t') *p++ = '\0';
+    if (!*p) break;
+    if (count == 5) return false;
+    fields[count++] = p;
+    while (*p && *p != ' ' && *p != '\t') p++;
+  }
+  if (count != 5) return false;
+
+  spec.anyDay = strcmp(fields[2], "*") == 0;
+  spec.anyWeekday = strcmp(fields[4], "*") == 0;
+
+  uint64_t minutes, hours, days, months, weekdays;
+  if (!parseField(fields[0], 0, 59, minutes) || !parseField(fields[1], 0, 23, hours) ||
+      !parseField(fields[2], 1, 31, days) || !parseField(fields[3], 1, 12, months) ||
+      !parseField(fields[4], 0, 7, weekdays)) {
+    return false;
+  }
+
+  spec.minutes = minutes;
+  spec.hours = (uint32_t)hours;
+  spec.days = (uint32_t)days;
+  spec.months = (uint16_t)months;
+  spec.weekdays = (uint8_t)((weekdays | weekdays >> 7) & 0x7F);  // 7 -> Sunday
+  return true;
+}
+
+static bool dayMatches(const CronSpec& spec, const struct tm& tm) {
+  bool dom = spec.days >> tm.tm_mday & 1;
+  bool dow = spec.weekdays >> tm.tm_wday & 1;
+  if (spec.anyDay && spec.anyWeekday) return true;
+  if (spec.anyDay) return dow;
+  if (spec.anyWeekday) return dom;
+  return dom || dow;
+}
+
+time_t cronNextAfter(const CronSpec& spec, time_t after) {
+  time_t start = after - after % 60 + 60;
+  struct tm tm;
+  localtime_r(&start, &tm);
+  int hour = tm.tm_hour;
+  int minute = tm.tm_min;
+
+  // Walk day by day, only the matching day is scanned for hour and minute
+  for (int day = 0; day < 366 * 5; day++) {
+    if ((spec.months >> (tm.tm_mon + 1) & 1) && dayMatches(spec, tm)) {
+      for (int h = hour; h < 24; h++) {
+        if (!(spec.hours >> h & 1)) continue;
+        for (int m = (h == hour ? minute : 0); m < 60; m++) {
+          if (!(spec.minutes >> m & 1)) continue;
+
+          struct tm candidate = tm;
+          candidate.tm_hour = h;
+          candidate.tm_min = m;
+          candidate.tm_sec = 0;
+          candidate.tm_isdst = -1;
+          time_t t = mktime(&candidate);
+          if (t > after) return t;
+        }
+      }
+    }
+
+    tm.tm_mday++;
+    tm.tm_hour = 0;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    mktime(&tm);
+    hour = 0;
+    minute = 0;
+  }
+  return 0;
+}
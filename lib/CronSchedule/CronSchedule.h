@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+// Five-field cron expression: minute hour day-of-month month day-of-week.
+// Fields take *, numbers, lists (1,15), ranges (1-5) and steps (*/10, 0-30/5).
+// Day-of-week is 0-6 with 0 = Sunday (7 is accepted as Sunday too). As in
+// cron, when both day fields are restricted a day matching either one fires.
+struct CronSpec {
+  uint64_t minutes;    // bit 0..59
+  uint32_t hours;      // bit 0..23
+  uint32_t days;       // bit 1..31
+  uint16_t months;     // bit 1..12
+  uint8_t weekdays;    // bit 0..6
+  bool anyDay;         // day-of-month was *
+  bool anyWeekday;     // day-of-week was *
+};
+
+bool parseCron(const char* text, CronSpec& spec);
+
+// First matching minute strictly after `after`, in local time (TZ).
+// Returns 0 if nothing matches within a few years (e.g. "0 0 31 2 *").
+time_t cronNextAfter(const CronSpec& spec, time_t after);
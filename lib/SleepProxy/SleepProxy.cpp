@@ -0,0 +1,191 @@
+#include "SleepProxy.h"
+
+#include <string.h>
+
+static const uint8_t broadcastMac[PROXY_MAC_SIZE] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const uint8_t zeroMac[PROXY_MAC_SIZE] = {0, 0, 0, 0, 0, 0};
+
+static const uint8_t IP_PROTO_TCP = 6;
+static const uint8_t TCP_FLAG_SYN = 0x02;
+static const uint8_t TCP_FLAG_ACK = 0x10;
+
+static uint16_t get16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v & 0xFF;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = (v >> 16) & 0xFF;
+  p[2] = (v >> 8) & 0xFF;
+  p[3] = v & 0xFF;
+}
+
+size_t buildArpFrame(uint8_t* out, const uint8_t ethSrc[PROXY_MAC_SIZE], const uint8_t ethDst[PROXY_MAC_SIZE],
+                     uint16_t op, const uint8_t sha[PROXY_MAC_SIZE], uint32_t spa,
+                     const uint8_t tha[PROXY_MAC_SIZE], uint32_t tpa) {
+  memcpy(out, ethDst, PROXY_MAC_SIZE);
+  memcpy(out + 6, ethSrc, PROXY_MAC_SIZE);
+  put16(out + 12, PROXY_ETHERTYPE_ARP);
+
+  uint8_t* arp = out + PROXY_ETH_HEADER_SIZE;
+  put16(arp, 1);                        // Ethernet
+  put16(arp + 2, PROXY_ETHERTYPE_IPV4);
+  arp[4] = PROXY_MAC_SIZE;
+  arp[5] = 4;
+  put16(arp + 6, op);
+  memcpy(arp + 8, sha, PROXY_MAC_SIZE);
+  put32(arp + 14, spa);
+  memcpy(arp + 18, tha, PROXY_MAC_SIZE);
+  put32(arp + 24, tpa);
+  return PROXY_ARP_FRAME_SIZE;
+}
+
+SleepProxy::SleepProxy(const uint8_t selfMac[PROXY_MAC_SIZE], const Hooks& hooks, uint32_t wakeRetryMs)
+    : hooks_(hooks), wakeRetryMs_(wakeRetryMs), hostCount_(0) {
+  memcpy(self_, selfMac, PROXY_MAC_SIZE);
+  memset(hosts_, 0, sizeof(hosts_));
+}
+
+int SleepProxy::addHost(uint32_t ip, const uint8_t mac[PROXY_MAC_SIZE], const uint16_t* ports, int portCount) {
+  if (hostCount_ >= MAX_HOSTS || portCount > MAX_PORTS) return -1;
+  Host& h = hosts_[hostCount_];
+  h.ip = ip;
+  memcpy(h.mac, mac, PROXY_MAC_SIZE);
+  memcpy(h.ports, ports, portCount * sizeof(uint16_t));
+  h.portCount = portCount;
+  return hostCount_++;
+}
+
+int SleepProxy::hostByIp(uint32_t ip) const {
+  for (int i = 0; i < hostCount_; i++) {
+    if (hosts_[i].ip == ip) return i;
+  }
+  return -1;
+}
+
+// Gratuitous ARP request (RFC 5227 announcement): updates every cache that
+// already holds the address
+void SleepProxy::announce(const uint8_t mac[PROXY_MAC_SIZE], uint32_t ip) {
+  uint8_t frame[PROXY_ARP_FRAME_SIZE];
+  buildArpFrame(frame, self_, broadcastMac, PROXY_ARP_REQUEST, mac, ip, zeroMac, ip);
+  hooks_.transmit(frame, sizeof(frame), hooks_.ctx);
+}
+
+void SleepProxy::start(uint8_t host, uint32_t nowMs) {
+  Host& h = hosts_[host];
+  if (h.state != PROXY_OFF) return;
+  h.state = PROXY_ACTIVE;
+  memset(&h.event, 0, sizeof(Event));
+  h.event.startMs = nowMs;
+  announce(self_, h.ip);
+}
+
+void SleepProxy::release(uint8_t host, uint32_t nowMs) {
+  if (hosts_[host].state != PROXY_OFF) handover(host, nowMs, true);
+}
+
+void SleepProxy::handover(uint8_t host, uint32_t nowMs, bool released) {
+  Host& h = hosts_[host];
+  h.state = PROXY_OFF;
+  h.event.handoverMs = nowMs;
+  h.event.released = released;
+  h.stats.handovers++;
+
+  // Caches that learned our MAC would keep sending to us until they expire
+  announce(h.mac, h.ip);
+  if (hooks_.handover) hooks_.handover(host, h.event, hooks_.ctx);
+}
+
+bool SleepProxy::input(const uint8_t* frame, size_t len, uint32_t nowMs) {
+  if (len < PROXY_ETH_HEADER_SIZE) return false;
+  uint16_t type = get16(frame + 12);
+  if (type == PROXY_ETHERTYPE_ARP) {
+    inputArp(frame, len, nowMs);
+    return false;
+  }
+  if (type == PROXY_ETHERTYPE_IPV4) return inputIpv4(frame, len, nowMs);
+  return false;
+}
+
+void SleepProxy::inputArp(const uint8_t* frame, size_t len, uint32_t nowMs) {
+  if (len < PROXY_ARP_FRAME_SIZE) return;
+  const uint8_t* arp = frame + PROXY_ETH_HEADER_SIZE;
+  if (get16(arp) != 1 || get16(arp + 2) != PROXY_ETHERTYPE_IPV4 || arp[4] != PROXY_MAC_SIZE || arp[5] != 4) return;
+
+  uint16_t op = get16(arp + 6);
+  const uint8_t* sha = arp + 8;
+  uint32_t spa = get32(arp + 14);
+  uint32_t tpa = get32(arp + 24);
+  if (memcmp(sha, self_, PROXY_MAC_SIZE) == 0) return;   // Our own announcement
+
+  // The host speaks for its address again: a reply, a request of its own,
+  // an announcement, or an address probe (sender 0.0.0.0) from its MAC
+  int sender = hostByIp(spa);
+  if (sender >= 0 && hosts_[sender].state != PROXY_OFF) {
+    handover(sender, nowMs, false);
+    return;
+  }
+  if (spa == 0) {
+    int prober = hostByIp(tpa);
+    if (prober >= 0 && hosts_[prober].state != PROXY_OFF && memcmp(sha, hosts_[prober].mac, PROXY_MAC_SIZE) == 0) {
+      handover(prober, nowMs, false);
+    }
+    return;   // Never defend against a probe, the host would see a conflict
+  }
+
+  int target = hostByIp(tpa);
+  if (op != PROXY_ARP_REQUEST || target < 0 || hosts_[target].state == PROXY_OFF) return;
+  uint8_t reply[PROXY_ARP_FRAME_SIZE];
+  buildArpFrame(reply, self_, sha, PROXY_ARP_REPLY, self_, tpa, sha, spa);
+  hooks_.transmit(reply, sizeof(reply), hooks_.ctx);
+  hosts_[target].stats.arpAnswered++;
+}
+
+bool SleepProxy::inputIpv4(const uint8_t* frame, size_t len, uint32_t nowMs) {
+  if (len < PROXY_ETH_HEADER_SIZE + 20 || memcmp(frame, self_, PROXY_MAC_SIZE) != 0) return false;
+  const uint8_t* ip = frame + PROXY_ETH_HEADER_SIZE;
+  int index = hostByIp(get32(ip + 16));
+  if (index < 0 || hosts_[index].state == PROXY_OFF) return false;
+  Host& h = hosts_[index];
+
+  size_t headerLen = (ip[0] & 0x0F) * 4;
+  bool firstFragment = (get16(ip + 6) & 0x1FFF) == 0;
+  if (ip[9] != IP_PROTO_TCP || !firstFragment || headerLen < 20 || len < PROXY_ETH_HEADER_SIZE + headerLen + 14) {
+    h.stats.dropped++;
+    return true;
+  }
+
+  const uint8_t* tcp = ip + headerLen;
+  uint16_t port = get16(tcp + 2);
+  uint8_t flags = tcp[13];
+  bool service = false;
+  for (int p = 0; p < h.portCount; p++) service |= h.ports[p] == port;
+  if (!service || (flags & (TCP_FLAG_SYN | TCP_FLAG_ACK)) != TCP_FLAG_SYN) {
+    h.stats.dropped++;
+    return true;
+  }
+
+  // Retransmitted SYNs of a client waiting for the boot don't wake again
+  h.stats.syns++;
+  if (h.state == PROXY_WAKING && nowMs - h.lastWakeMs < wakeRetryMs_) return true;
+  if (h.event.wakes == 0) {
+    h.event.synMs = nowMs;
+    h.event.client = get32(ip + 12);
+    h.event.port = port;
+  }
+  h.state = PROXY_WAKING;
+  h.lastWakeMs = nowMs;
+  h.event.wakes++;
+  h.stats.wakes++;
+  hooks_.wake(index, get32(ip + 12), port, hooks_.ctx);
+  return true;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sleep proxy for powered-down hosts. While a host is proxied, ARP requests
+// for its IPv4 address are answered with our own MAC, so clients on the
+// segment send their connection attempts to us. A TCP SYN to one of the
+// host's service ports becomes a wake request; the SYN itself is dropped and
+// the client's retransmission reaches the host once it is back. As soon as
+// any ARP frame shows the host using its address again, proxying stops and
+// the host's real MAC is announced to the segment.
+//
+// Works on raw Ethernet II frames: the platform passes every received frame
+// to input() and puts whatever the transmit hook hands out on the wire. Not
+// thread-safe, serialize the calls if frames arrive on another task. Times
+// are caller milliseconds, IPv4 addresses are a.b.c.d -> 0xaabbccdd.
+
+const size_t PROXY_MAC_SIZE = 6;
+const size_t PROXY_ETH_HEADER_SIZE = 14;
+const size_t PROXY_ARP_FRAME_SIZE = 42;
+const uint16_t PROXY_ETHERTYPE_IPV4 = 0x0800;
+const uint16_t PROXY_ETHERTYPE_ARP = 0x0806;
+const uint16_t PROXY_ARP_REQUEST = 1;
+const uint16_t PROXY_ARP_REPLY = 2;
+
+// Ethernet + ARP for IPv4 over Ethernet, returns PROXY_ARP_FRAME_SIZE
+size_t buildArpFrame(uint8_t* out, const uint8_t ethSrc[PROXY_MAC_SIZE], const uint8_t ethDst[PROXY_MAC_SIZE],
+                     uint16_t op, const uint8_t sha[PROXY_MAC_SIZE], uint32_t spa,
+                     const uint8_t tha[PROXY_MAC_SIZE], uint32_t tpa);
+
+enum ProxyState : uint8_t {
+  PROXY_OFF,        // Host owns its address
+  PROXY_ACTIVE,     // Answering ARP, watching for SYNs
+  PROXY_WAKING,     // Wake requested, still answering until the host is back
+};
+
+class SleepProxy {
+ public:
+  static const int MAX_HOSTS = 4;
+  static const int MAX_PORTS = 8;
+
+  // One proxy session, from start() to the handover
+  struct Event {
+    uint32_t startMs;        // Proxying began
+    uint32_t synMs;          // First SYN to a service port (when wakes > 0)
+    uint32_t handoverMs;     // Host seen again or released
+    uint32_t client;         // Sender of that SYN
+    uint16_t port;           // Its destination port
+    uint8_t wakes;           // Wake requests in this session
+    bool released;           // Ended by release(), not by the host's ARP
+  };
+
+  struct Hooks {
+    void (*transmit)(const uint8_t* frame, size_t len, void* ctx);
+    void (*wake)(uint8_t host, uint32_t client, uint16_t port, void* ctx);
+    void (*handover)(uint8_t host, const Event& event, void* ctx);
+    void* ctx;
+  };
+
+  struct Stats {
+    uint32_t arpAnswered;
+    uint32_t syns;           // SYNs to service ports
+    uint32_t dropped;        // Other IPv4 frames for a proxied host
+    uint32_t wakes;
+    uint32_t handovers;
+  };
+
+  // A SYN while waking only requests another wake after wakeRetryMs
+  SleepProxy(const uint8_t selfMac[PROXY_MAC_SIZE], const Hooks& hooks, uint32_t wakeRetryMs);
+
+  int addHost(uint32_t ip, const uint8_t mac[PROXY_MAC_SIZE], const uint16_t* ports, int portCount);  // -1 when full
+
+  // Begin answering for a host confirmed offline; announces our MAC for its IP
+  void start(uint8_t host, uint32_t nowMs);
+  // End proxying without seeing the host's ARP, e.g. a probe found it up
+  void release(uint8_t host, uint32_t nowMs);
+
+  // True if the frame was addressed to a proxied host and must not reach
+  // the local stack. ARP frames always pass through.
+  bool input(const uint8_t* frame, size_t len, uint32_t nowMs);
+
+  int hostCount() const { return hostCount_; }
+  ProxyState state(uint8_t host) const { return hosts_[host].state; }
+  const Event& event(uint8_t host) const { return hosts_[host].event; }
+  const Stats& stats(uint8_t host) const { return hosts_[host].stats; }
+
+ private:
+  struct Host {
+    uint32_t ip;
+    uint8_t mac[PROXY_MAC_SIZE];
+    uint16_t ports[MAX_PORTS];
+    uint8_t portCount;
+    ProxyState state;
+    uint32_t lastWakeMs;
+    Event event;
+    Stats stats;
+  };
+
+  int hostByIp(uint32_t ip) const;
+  void announce(const uint8_t mac[PROXY_MAC_SIZE], uint32_t ip);
+  void handover(uint8_t host, uint32_t nowMs, bool released);
+  void inputArp(const uint8_t* frame, size_t len, uint32_t nowMs);
+  bool inputIpv4(const uint8_t* frame, size_t len, uint32_t nowMs);
+
+  uint8_t self_[PROXY_MAC_SIZE];
+  Hooks hooks_;
+  uint32_t wakeRetryMs_;
+  Host hosts_[MAX_HOSTS];
+  int hostCount_;
+};
@@ -0,0 +1,92 @@
+#include "SpanTrace.h"
+
+#include <stdio.h>
+
+#ifdef ARDUINO
+#include <esp_timer.h>
+#else
+#include <time.h>
+#endif
+
+bool traceOn = false;
+
+static TraceEvent ring[TRACE_CAPACITY];
+static uint32_t written = 0;   // Total records ever written
+
+uint32_t traceMicros() {
+#ifdef ARDUINO
+  return (uint32_t)esp_timer_get_time();
+#else
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+#endif
+}
+
+static void record(const char* name, uint32_t start, uint32_t duration, int32_t arg) {
+  TraceEvent& event = ring[written % TRACE_CAPACITY];
+  event.name = name;
+  event.start = start;
+  event.duration = duration;
+  event.arg = arg;
+  written++;
+}
+
+void traceComplete(const char* name, uint32_t start, int32_t arg) {
+  uint32_t duration = traceMicros() - start;
+  record(name, start, duration == TRACE_INSTANT ? duration - 1 : duration, arg);
+}
+
+void traceInstant(const char* name, int32_t arg) {
+  record(name, traceMicros(), TRACE_INSTANT, arg);
+}
+
+void traceClear() {
+  written = 0;
+}
+
+size_t traceCount() {
+  return written < TRACE_CAPACITY ? written : TRACE_CAPACITY;
+}
+
+uint32_t traceOverwritten() {
+  return written - traceCount();
+}
+
+const TraceEvent& traceEvent(size_t index) {
+  return ring[(written - traceCount() + index) % TRACE_CAPACITY];
+}
+
+size_t traceExport(void (*write)(const char* text, size_t len, void* ctx), void* ctx) {
+  char line[160];
+  size_t total = 0;
+  size_t count = traceCount();
+
+  // Timestamps relative to the earliest start, so micros() wrap-around is harmless
+  uint32_t base = count ? traceEvent(0).start : 0;
+  for (size_t i = 1; i < count; i++) {
+    if ((int32_t)(traceEvent(i).start - base) < 0) base = traceEvent(i).start;
+  }
+
+  int len = snprintf(line, sizeof(line), "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"overwritten\":%lu},\"traceEvents\":[",
+                     (unsigned long)traceOverwritten());
+  write(line, len, ctx);
+  total += len;
+
+  for (size_t i = 0; i < count; i++) {
+    const TraceEvent& event = traceEvent(i);
+    if (event.duration == TRACE_INSTANT) {
+      len = snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lu,\"pid\":1,\"tid\":1,\"args\":{\"v\":%ld}}",
+                     i ? "," : "", event.name, (unsigned long)(event.start - base), (long)event.arg);
+    } else {
+      len = snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":1,\"tid\":1,\"args\":{\"v\":%ld}}",
+                     i ? "," : "", event.name, (unsigned long)(event.start - base), (unsigned long)event.duration, (long)event.arg);
+    }
+    if (len >= (int)sizeof(line)) len = sizeof(line) - 1;
+    write(line, len, ctx);
+    total += len;
+  }
+
+  write("\n]}\n", 4, ctx);
+  return total + 4;
+}
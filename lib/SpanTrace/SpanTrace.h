@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Span recorder for timeline profiling. Each finished span is one 16-byte
+// record (name, start, duration, arg) in a fixed RAM ring; the oldest records
+// are overwritten when it is full. Export is Chrome trace-event JSON, load it
+// in chrome://tracing or ui.perfetto.dev.
+//
+// Compile with -DTRACE_ENABLED=0 to remove every TRACE_* site; otherwise a
+// disabled recorder costs one flag test per span. Names must be string
+// literals. Record from the main loop task only.
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+#ifndef TRACE_CAPACITY
+#define TRACE_CAPACITY 256
+#endif
+
+struct TraceEvent {
+  const char* name;
+  uint32_t start;      // Microseconds
+  uint32_t duration;   // TRACE_INSTANT for a point event
+  int32_t arg;
+};
+
+const uint32_t TRACE_INSTANT = 0xFFFFFFFF;
+
+extern bool traceOn;   // Runtime switch, off until set
+
+uint32_t traceMicros();
+void traceComplete(const char* name, uint32_t start, int32_t arg);
+void traceInstant(const char* name, int32_t arg);
+void traceClear();
+size_t traceCount();
+uint32_t traceOverwritten();   // Records lost to the ring wrapping
+const TraceEvent& traceEvent(size_t index);   // 0 = oldest
+
+// Streams the buffer as JSON in small chunks; returns the bytes written
+size_t traceExport(void (*write)(const char* text, size_t len, void* ctx), void* ctx);
+
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name) : name_(traceOn ? name : 0), start_(name_ ? traceMicros() : 0), arg_(0) {}
+  ~TraceSpan() {
+    if (name_) traceComplete(name_, start_, arg_);
+  }
+  void arg(int32_t value) { arg_ = value; }
+
+ private:
+  const char* name_;
+  uint32_t start_;
+  int32_t arg_;
+};
+
+#if TRACE_ENABLED
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_JOIN(traceSpan, __LINE__)(name)
+#define TRACE_MARK(name, arg) \
+  do {                        \
+    if (traceOn) traceInstant(name, arg); \
+  } while (0)
+#else
+#define TRACE_SPAN(name) do {} while (0)
+#define TRACE_MARK(name, arg) do {} while (0)
+#endif
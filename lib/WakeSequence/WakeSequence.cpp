@@ -0,0 +1,195 @@
+#include "WakeSequence.h"
+
+#include <string.h>
+
+WakeSequencer::WakeSequencer(const Hooks& hooks, const Config& config)
+    : hooks_(hooks), config_(config) {
+  if (config_.maxPowering == 0) config_.maxPowering = 1;
+  reset();
+}
+
+void WakeSequencer::reset() {
+  memset(hosts_, 0, sizeof(hosts_));
+  hostCount_ = 0;
+  running_ = false;
+  poweredAny_ = false;
+  startMs_ = 0;
+  finishMs_ = 0;
+  lastPowerOnMs_ = 0;
+  probeCursor_ = -1;
+}
+
+int WakeSequencer::addHost(uint32_t dependsOn) {
+  if (running_ || hostCount_ >= SEQ_MAX_HOSTS) return -1;
+  hosts_[hostCount_].dependsOn = dependsOn;
+  return hostCount_++;
+}
+
+bool WakeSequencer::start(uint32_t nowMs) {
+  uint32_t all = hostCount_ == SEQ_MAX_HOSTS ? 0xFFFFFFFFu : (1u << hostCount_) - 1;
+
+  // Peel off hosts whose dependencies are all resolved; anything left is a cycle
+  uint32_t resolved = 0;
+  for (bool progress = true; progress;) {
+    progress = false;
+    for (int i = 0; i < hostCount_; i++) {
+      uint32_t bit = 1u << i;
+      if (hosts_[i].dependsOn & ~all) return false;
+      if (!(resolved & bit) && (hosts_[i].dependsOn & ~resolved) == 0) {
+        resolved |= bit;
+        progress = true;
+      }
+    }
+  }
+  if (resolved != all) return false;
+
+  for (int i = 0; i < hostCount_; i++) {
+    uint32_t dependsOn = hosts_[i].dependsOn;
+    memset(&hosts_[i], 0, sizeof(Host));
+    hosts_[i].dependsOn = dependsOn;
+  }
+  running_ = hostCount_ > 0;
+  poweredAny_ = false;
+  probeCursor_ = -1;
+  startMs_ = nowMs;
+  finishMs_ = nowMs;
+  return true;
+}
+
+void WakeSequencer::finish(int i, SeqHostState state, uint32_t nowMs) {
+  hosts_[i].state = state;
+  hosts_[i].doneMs = nowMs;
+}
+
+// Moves waiting hosts on as their dependencies resolve; returns how many
+// hosts are powering
+int WakeSequencer::release(uint32_t nowMs) {
+  uint32_t online = 0;
+  uint32_t failed = 0;
+  int powering = 0;
+  for (int i = 0; i < hostCount_; i++) {
+    if (hosts_[i].state == SEQ_ONLINE) online |= 1u << i;
+    if (hosts_[i].state == SEQ_FAILED || hosts_[i].state == SEQ_SKIPPED) failed |= 1u << i;
+    if (hosts_[i].state == SEQ_POWERING) powering++;
+  }
+
+  // Release waiting hosts in dependency order; a failure skips everything below it
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int i = 0; i < hostCount_; i++) {
+      Host& h = hosts_[i];
+      if (h.state != SEQ_WAITING) continue;
+      if (h.dependsOn & failed) {
+        finish(i, SEQ_SKIPPED, nowMs);
+        failed |= 1u << i;
+        changed = true;
+      } else if ((h.dependsOn & ~online) == 0) {
+        h.state = SEQ_READY;
+        h.readyMs = nowMs;
+      }
+    }
+  }
+  return powering;
+}
+
+bool WakeSequencer::step(uint32_t nowMs) {
+  if (!running_) return false;
+  release(nowMs);
+
+  // A probe can block for its whole timeout, so one step runs at most one:
+  // the pre-wake check of a ready host or a due probe of a booting one.
+  // Hosts take turns, starting after the one probed last.
+  int probed = -1;
+  for (int n = 1; n <= hostCount_ && probed < 0; n++) {
+    int i = (probeCursor_ + n) % hostCount_;
+    const Host& h = hosts_[i];
+    if ((h.state == SEQ_READY && !h.checked) ||
+        (h.state == SEQ_POWERING && (int32_t)(nowMs - h.nextProbeMs) >= 0)) {
+      probed = i;
+    }
+  }
+
+  if (probed >= 0) {
+    probeCursor_ = probed;
+    Host& h = hosts_[probed];
+    SeqProbe answer = hooks_.probe(probed, hooks_.ctx);
+    bool up = answer == SEQ_PROBE_UP;
+    if (h.state == SEQ_READY) {
+      // A host that is already up needs no power slot; one without an
+      // answer yet stays unchecked and is powered on only after it
+      h.checked = answer != SEQ_PROBE_PENDING;
+      if (up) {
+        h.wasOnline = true;
+        h.wokeMs = nowMs;
+        finish(probed, SEQ_ONLINE, nowMs);
+      }
+    } else if (up) {
+      finish(probed, SEQ_ONLINE, nowMs);
+    } else if (nowMs - h.wokeMs >= config_.bootTimeoutMs) {
+      finish(probed, SEQ_FAILED, nowMs);
+    } else if (answer == SEQ_PROBE_DOWN) {
+      h.nextProbeMs = nowMs + config_.probeIntervalMs;
+    }
+  }
+
+  // Again after the probe, so a host it found online or failed releases
+  // its dependents in this same step
+  int powering = release(nowMs);
+
+  // Power on checked ready hosts within the concurrency cap and the stagger
+  for (int i = 0; i < hostCount_; i++) {
+    Host& h = hosts_[i];
+    if (h.state != SEQ_READY || !h.checked) continue;
+    if (powering >= config_.maxPowering) continue;
+    if (poweredAny_ && nowMs - lastPowerOnMs_ < config_.staggerMs) continue;
+
+    h.wokeMs = nowMs;
+    poweredAny_ = true;
+    lastPowerOnMs_ = nowMs;
+    if (hooks_.wake(i, hooks_.ctx)) {
+      h.state = SEQ_POWERING;
+      h.nextProbeMs = nowMs + config_.probeIntervalMs;
+      powering++;
+    } else {
+      finish(i, SEQ_FAILED, nowMs);
+    }
+  }
+
+  running_ = false;
+  for (int i = 0; i < hostCount_; i++) {
+    SeqHostState state = hosts_[i].state;
+    if (state == SEQ_WAITING || state == SEQ_READY || state == SEQ_POWERING) {
+      running_ = true;
+    } else if ((int32_t)(hosts_[i].doneMs - finishMs_) > 0) {
+      finishMs_ = hosts_[i].doneMs;
+    }
+  }
+  return running_;
+}
+
+int WakeSequencer::criticalPath(uint8_t* path, int max) const {
+  // Walk back from the host that finished last
+  int last = -1;
+  for (int i = 0; i < hostCount_; i++) {
+    if (hosts_[i].state == SEQ_SKIPPED) continue;
+    if (last < 0 || (int32_t)(hosts_[i].doneMs - hosts_[last].doneMs) > 0) last = i;
+  }
+
+  int count = 0;
+  for (int i = last; i >= 0 && count < max;) {
+    path[count++] = i;
+    int previous = -1;
+    for (int d = 0; d < hostCount_; d++) {
+      if (!(hosts_[i].dependsOn & (1u << d))) continue;
+      if (previous < 0 || (int32_t)(hosts_[d].doneMs - hosts_[previous].doneMs) > 0) previous = d;
+    }
+    i = previous;
+  }
+
+  for (int a = 0, b = count - 1; a < b; a++, b--) {
+    uint8_t t = path[a];
+    path[a] = path[b];
+    path[b] = t;
+  }
+  return count;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Dependency-ordered wake plan. Hosts form a DAG (dependencies as a bit mask
+// of host indices); a host is powered on only after every dependency probed
+// online, with at most maxPowering hosts booting at once and at least
+// staggerMs between two power-ons so their inrush never overlaps.
+//
+// step() runs at most one probe (hosts take turns) and otherwise never
+// waits, call it from the main loop until it returns false. A probe that
+// runs across several loop passes answers SEQ_PROBE_PENDING until it has a
+// result. Times are caller milliseconds.
+
+const int SEQ_MAX_HOSTS = 32;
+
+enum SeqHostState : uint8_t {
+  SEQ_WAITING,    // Dependencies not online yet
+  SEQ_READY,      // Dependencies online, waiting for a power slot
+  SEQ_POWERING,   // WoL sent, probing until online
+  SEQ_ONLINE,
+  SEQ_FAILED,     // WoL error or boot timeout
+  SEQ_SKIPPED,    // A dependency failed
+};
+
+enum SeqProbe : uint8_t {
+  SEQ_PROBE_DOWN,
+  SEQ_PROBE_UP,
+  SEQ_PROBE_PENDING,  // No result yet, ask again on the host's next turn
+};
+
+class WakeSequencer {
+ public:
+  struct Hooks {
+    bool (*wake)(uint8_t host, void* ctx);
+    SeqProbe (*probe)(uint8_t host, void* ctx);
+    void* ctx;
+  };
+
+  struct Config {
+    uint8_t maxPowering;       // Simultaneous power-ons
+    uint32_t staggerMs;        // Minimum gap between two power-ons
+    uint32_t probeIntervalMs;  // Between probes of a booting host
+    uint32_t bootTimeoutMs;    // WoL → online before the host fails
+  };
+
+  struct Host {
+    uint32_t dependsOn;
+    SeqHostState state;
+    bool wasOnline;            // Already up, no WoL sent
+    bool checked;              // Pre-wake probe done
+    uint32_t readyMs;          // Dependencies online
+    uint32_t wokeMs;           // WoL sent
+    uint32_t doneMs;           // Online, failed or skipped
+    uint32_t nextProbeMs;
+  };
+
+  WakeSequencer(const Hooks& hooks, const Config& config);
+
+  void reset();
+  int addHost(uint32_t dependsOn);  // host index, or -1 when full
+
+  // False if a dependency is unknown or the graph has a cycle
+  bool start(uint32_t nowMs);
+  bool step(uint32_t nowMs);        // True while the plan is still running
+  bool running() const { return running_; }
+
+  int hostCount() const { return hostCount_; }
+  const Host& host(int i) const { return hosts_[i]; }
+  uint32_t startMs() const { return startMs_; }
+  uint32_t finishMs() const { return finishMs_; }
+
+  // Chain of hosts that determined the finish time, first host first.
+  // Each host's predecessor is the dependency that came online last.
+  int criticalPath(uint8_t* path, int max) const;
+
+ private:
+  void finish(int i, SeqHostState state, uint32_t nowMs);
+  int release(uint32_t nowMs);
+
+  Hooks hooks_;
+  Config config_;
+  Host hosts_[SEQ_MAX_HOSTS];
+  int hostCount_;
+  bool running_;
+  bool poweredAny_;
+  uint32_t startMs_;
+  uint32_t finishMs_;
+  uint32_t lastPowerOnMs_;
+  int probeCursor_;            // Host probed last
+};
@@ -0,0 +1,38 @@
+#include "WolPacket.h"
+
+#include <string.h>
+
+// The compile-time half checks itself: a broken parser or packet layout
+// fails every build instead of sending a packet no NIC answers to
+static_assert(isValidMac("AA:BB:CC:DD:EE:FF") && isValidMac("aa-bb-cc-dd-ee-0f"), "valid MACs rejected");
+static_assert(!isValidMac("") && !isValidMac(nullptr) && !isValidMac("AA:BB:CC:DD:EE"), "short MAC accepted");
+static_assert(!isValidMac("AA:BB:CC:DD:EE:FF:00") && !isValidMac("AA:BB:CC:DD:EE:FF:"), "long MAC accepted");
+static_assert(!isValidMac("AA:BB:CC:DD:EE:FG") && !isValidMac("AA:BB:CC:DD:EE:F") && !isValidMac("AABB:CC:DD:EE:FF"),
+              "malformed MAC accepted");
+static_assert(isValidSecureOn("") && isValidSecureOn("01:02:03:04") && isValidSecureOn("01:02:03:04:05:06"),
+              "valid SecureOn rejected");
+static_assert(!isValidSecureOn("01:02:03") && !isValidSecureOn("01:02:03:04:05") && !isValidSecureOn("01:02:03:04:05:06:07"),
+              "SecureOn of the wrong length accepted");
+
+constexpr WolMagicPacket testPacket = makeMagicPacket("01:23:45:67:89:AB", "C0:FF:EE:00");
+static_assert(testPacket.size == WOL_PACKET_SIZE + 4, "SecureOn not appended");
+static_assert(testPacket.bytes[0] == 0xFF && testPacket.bytes[5] == 0xFF, "sync stream");
+static_assert(testPacket.bytes[6] == 0x01 && testPacket.bytes[11] == 0xAB, "first MAC copy");
+static_assert(testPacket.bytes[WOL_PACKET_SIZE - 6] == 0x01 && testPacket.bytes[WOL_PACKET_SIZE - 1] == 0xAB,
+              "last MAC copy");
+static_assert(testPacket.bytes[WOL_PACKET_SIZE] == 0xC0 && testPacket.bytes[WOL_PACKET_SIZE + 3] == 0x00, "SecureOn bytes");
+static_assert(makeMagicPacket("01:23:45:67:89:AB").size == WOL_PACKET_SIZE, "packet without SecureOn");
+
+bool parseMac(const char* text, uint8_t mac[WOL_MAC_SIZE]) {
+  if (!isValidMac(text)) return false;
+
+  for (size_t i = 0; i < WOL_MAC_SIZE; i++) mac[i] = wolHexByte(text, i);
+  return true;
+}
+
+void buildMagicPacket(const uint8_t mac[WOL_MAC_SIZE], uint8_t packet[WOL_PACKET_SIZE]) {
+  memset(packet, 0xFF, 6);
+  for (size_t i = 0; i < 16; i++) {
+    memcpy(packet + 6 + i * WOL_MAC_SIZE, mac, WOL_MAC_SIZE);
+  }
+}
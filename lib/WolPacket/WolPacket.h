@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Wake-on-LAN magic packet: 6 bytes of 0xFF followed by 16 copies of the MAC,
+// optionally followed by a 4 or 6 byte SecureOn password
+const size_t WOL_MAC_SIZE = 6;
+const size_t WOL_PACKET_SIZE = 6 + 16 * WOL_MAC_SIZE;
+const size_t WOL_SECUREON_MAX = 6;
+const size_t WOL_MAX_PACKET_SIZE = WOL_PACKET_SIZE + WOL_SECUREON_MAX;
+
+// ========== COMPILE-TIME ==========
+// Everything below is constexpr so a configured MAC can be checked with
+// static_assert and the packet built by the compiler into flash.
+
+constexpr int wolHexValue(char c) {
+  return c >= '0' && c <= '9' ? c - '0'
+       : c >= 'a' && c <= 'f' ? c - 'a' + 10
+       : c >= 'A' && c <= 'F' ? c - 'A' + 10
+       : -1;
+}
+
+// Number of bytes in "AA:BB:..." (':' or '-' separators, any case), 0 for an
+// empty string, -1 if malformed or longer than 6 bytes
+constexpr int wolHexBytes(const char* text) {
+  if (!text) return -1;
+  int count = 0;
+  for (const char* p = text; *p; p += 3) {
+    if (count == 6 || wolHexValue(p[0]) < 0 || wolHexValue(p[1]) < 0) return -1;
+    count++;
+    if (p[2] == '\0') break;
+    if (p[2] != ':' && p[2] != '-') return -1;
+    if (p[3] == '\0') return -1;
+  }
+  return count;
+}
+
+// Byte number index of a string wolHexBytes() accepted
+constexpr uint8_t wolHexByte(const char* text, int index) {
+  return (uint8_t)(wolHexValue(text[index * 3]) << 4 | wolHexValue(text[index * 3 + 1]));
+}
+
+constexpr bool isValidMac(const char* text) {
+  return wolHexBytes(text) == (int)WOL_MAC_SIZE;
+}
+
+// SecureOn passwords are optional: empty, 4 or 6 bytes
+constexpr bool isValidSecureOn(const char* text) {
+  return wolHexBytes(text) == 0 || wolHexBytes(text) == 4 || wolHexBytes(text) == 6;
+}
+
+struct WolMagicPacket {
+  uint8_t bytes[WOL_MAX_PACKET_SIZE];
+  size_t size;
+};
+
+// Only call with strings that pass isValidMac() / isValidSecureOn()
+constexpr WolMagicPacket makeMagicPacket(const char* mac, const char* secureOn = "") {
+  WolMagicPacket packet{};
+  for (size_t i = 0; i < 6; i++) packet.bytes[i] = 0xFF;
+  for (size_t i = 0; i < 16 * WOL_MAC_SIZE; i++) {
+    packet.bytes[6 + i] = wolHexByte(mac, i % WOL_MAC_SIZE);
+  }
+  packet.size = WOL_PACKET_SIZE;
+
+  int password = wolHexBytes(secureOn);
+  for (int i = 0; i < password; i++) packet.bytes[packet.size++] = wolHexByte(secureOn, i);
+  return packet;
+}
+
+// ========== RUNTIME ==========
+// Parses "AA:BB:CC:DD:EE:FF" (':' or '-' separators, any case).
+// Returns false and leaves mac untouched on any malformed input.
+bool parseMac(const char* text, uint8_t mac[WOL_MAC_SIZE]);
+
+void buildMagicPacket(const uint8_t mac[WOL_MAC_SIZE], uint8_t packet[WOL_PACKET_SIZE]);
@@ -0,0 +1,386 @@
+#include "WolRelay.h"
+
+#include <string.h>
+
+// ========== ENCODING ==========
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void put64(uint8_t* p, uint64_t v) {
+  put32(p, (uint32_t)(v >> 32));
+  put32(p + 4, (uint32_t)v);
+}
+
+static uint16_t get16(const uint8_t* p) {
+  return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint64_t get64(const uint8_t* p) {
+  return (uint64_t)get32(p) << 32 | get32(p + 4);
+}
+
+// ========== SIPHASH-2-4 ==========
+static uint64_t rotl(uint64_t x, int b) {
+  return (x << b) | (x >> (64 - b));
+}
+
+static uint64_t readLE64(const uint8_t* p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) v = v << 8 | p[i];
+  return v;
+}
+
+#define SIPROUND                                                   \
+  do {                                                             \
+    v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);      \
+    v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;                         \
+    v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;                         \
+    v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);      \
+  } while (0)
+
+uint64_t relaySipHash(const uint8_t key[RELAY_KEY_SIZE], const uint8_t* data, size_t len) {
+  uint64_t k0 = readLE64(key);
+  uint64_t k1 = readLE64(key + 8);
+  uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+  uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+  uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+  uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+  size_t blocks = len / 8;
+  for (size_t i = 0; i < blocks; i++) {
+    uint64_t m = readLE64(data + i * 8);
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+  }
+
+  uint64_t last = (uint64_t)len << 56;
+  for (size_t i = 0; i < len % 8; i++) {
+    last |= (uint64_t)data[blocks * 8 + i] << (8 * i);
+  }
+  v3 ^= last;
+  SIPROUND;
+  SIPROUND;
+  v0 ^= last;
+
+  v2 ^= 0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+#undef SIPROUND
+
+// ========== WRITER ==========
+RelayWriter::RelayWriter(uint8_t* buffer, size_t capacity)
+    : buffer_(buffer), capacity_(capacity), length_(0), count_(0), type_(0) {}
+
+void RelayWriter::begin(const RelayHeader& header) {
+  type_ = header.type;
+  count_ = 0;
+  length_ = RELAY_HEADER_SIZE;
+  if (capacity_ < RELAY_HEADER_SIZE + RELAY_TAG_SIZE) return;
+
+  buffer_[0] = 'W';
+  buffer_[1] = 'R';
+  buffer_[2] = RELAY_VERSION;
+  buffer_[3] = header.type;
+  put16(buffer_ + 4, header.node);
+  buffer_[6] = 0;  // count, patched by finish()
+  buffer_[7] = 0;  // flags, reserved
+  put32(buffer_ + 8, header.session);
+  put32(buffer_ + 12, header.seq);
+}
+
+bool RelayWriter::add(const RelayJob& job) {
+  if (type_ != RELAY_MSG_BATCH || count_ >= RELAY_MAX_RECORDS) return false;
+  if (length_ + RELAY_JOB_SIZE + RELAY_TAG_SIZE > capacity_) return false;
+
+  uint8_t* p = buffer_ + length_;
+  p[0] = job.type;
+  p[1] = job.id;
+  put16(p + 2, job.port);
+  put32(p + 4, job.ip);
+  memcpy(p + 8, job.mac, 6);
+  put16(p + 14, job.param);
+  length_ += RELAY_JOB_SIZE;
+  count_++;
+  return true;
+}
+
+bool RelayWriter::add(const RelayResult& result) {
+  if (type_ != RELAY_MSG_RESULT || count_ >= RELAY_MAX_RECORDS) return false;
+  if (length_ + RELAY_RESULT_SIZE + RELAY_TAG_SIZE > capacity_) return false;
+
+  uint8_t* p = buffer_ + length_;
+  p[0] = result.type;
+  p[1] = result.id;
+  p[2] = result.status;
+  p[3] = 0;
+  put32(p + 4, result.micros);
+  length_ += RELAY_RESULT_SIZE;
+  count_++;
+  return true;
+}
+
+size_t RelayWriter::finish(const uint8_t key[RELAY_KEY_SIZE]) {
+  if (count_ == 0 || length_ + RELAY_TAG_SIZE > capacity_) return 0;
+
+  buffer_[6] = count_;
+  put64(buffer_ + length_, relaySipHash(key, buffer_, length_));
+  return length_ + RELAY_TAG_SIZE;
+}
+
+// ========== READER ==========
+bool RelayReader::open(const uint8_t* data, size_t len, const uint8_t key[RELAY_KEY_SIZE]) {
+  data_ = data;
+  if (len < RELAY_HEADER_SIZE + RELAY_TAG_SIZE) return false;
+  if (data[0] != 'W' || data[1] != 'R' || data[2] != RELAY_VERSION) return false;
+
+  header_.type = data[3];
+  header_.node = get16(data + 4);
+  header_.count = data[6];
+  header_.session = get32(data + 8);
+  header_.seq = get32(data + 12);
+
+  size_t recordSize;
+  if (header_.type == RELAY_MSG_BATCH) recordSize = RELAY_JOB_SIZE;
+  else if (header_.type == RELAY_MSG_RESULT) recordSize = RELAY_RESULT_SIZE;
+  else return false;
+
+  size_t body = RELAY_HEADER_SIZE + header_.count * recordSize;
+  if (header_.count == 0 || header_.count > RELAY_MAX_RECORDS) return false;
+  if (len != body + RELAY_TAG_SIZE) return false;
+
+  // Tags are compared without early exit
+  uint64_t diff = get64(data + body) ^ relaySipHash(key, data, body);
+  return diff == 0;
+}
+
+bool RelayReader::job(uint8_t index, RelayJob& job) const {
+  if (header_.type != RELAY_MSG_BATCH || index >= header_.count) return false;
+
+  const uint8_t* p = data_ + RELAY_HEADER_SIZE + index * RELAY_JOB_SIZE;
+  job.type = p[0];
+  job.id = p[1];
+  job.port = get16(p + 2);
+  job.ip = get32(p + 4);
+  memcpy(job.mac, p + 8, 6);
+  job.param = get16(p + 14);
+  return true;
+}
+
+bool RelayReader::result(uint8_t index, RelayResult& result) const {
+  if (header_.type != RELAY_MSG_RESULT || index >= header_.count) return false;
+
+  const uint8_t* p = data_ + RELAY_HEADER_SIZE + index * RELAY_RESULT_SIZE;
+  result.type = p[0];
+  result.id = p[1];
+  result.status = p[2];
+  result.micros = get32(p + 4);
+  return true;
+}
+
+// ========== RELAY NODE ==========
+RelayNode::RelayNode(const uint8_t key[RELAY_KEY_SIZE], uint16_t nodeId, const Hooks& hooks)
+    : nodeId_(nodeId), hooks_(hooks) {
+  memcpy(key_, key, RELAY_KEY_SIZE);
+  memset(&stats_, 0, sizeof(stats_));
+  memset(senders_, 0, sizeof(senders_));
+}
+
+bool RelayNode::acceptSequence(const RelayHeader& header) {
+  Sender* slot = NULL;
+  for (int i = 0; i < MAX_SENDERS; i++) {
+    if (senders_[i].used && senders_[i].node == header.node) {
+      slot = &senders_[i];
+      break;
+    }
+    if (!senders_[i].used && !slot) slot = &senders_[i];
+  }
+  if (!slot) slot = &senders_[header.node % MAX_SENDERS];
+
+  // A newer session (front-end reboot) restarts the sequence; an older one
+  // can only be a captured batch played back
+  if (slot->used && slot->node == header.node) {
+    if (header.session < slot->session) return false;
+    if (header.session == slot->session && header.seq <= slot->seq) return false;
+  }
+
+  slot->used = true;
+  slot->node = header.node;
+  slot->session = header.session;
+  slot->seq = header.seq;
+  return true;
+}
+
+void RelayNode::sendResults(const RelayHeader& batch, const RelayResult* results, uint8_t count) {
+  if (count == 0) return;
+
+  uint8_t buffer[RELAY_MAX_DATAGRAM];
+  RelayWriter writer(buffer, sizeof(buffer));
+  RelayHeader header = {RELAY_MSG_RESULT, nodeId_, 0, batch.session, batch.seq};
+  writer.begin(header);
+  for (uint8_t i = 0; i < count; i++) writer.add(results[i]);
+
+  size_t len = writer.finish(key_);
+  if (len) hooks_.reply(buffer, len, hooks_.ctx);
+}
+
+int RelayNode::handle(const uint8_t* data, size_t len) {
+  RelayReader reader;
+  if (!reader.open(data, len, key_) || reader.header().type != RELAY_MSG_BATCH) {
+    stats_.rejectedAuth++;
+    return -1;
+  }
+
+  const RelayHeader& header = reader.header();
+  if (!acceptSequence(header)) {
+    stats_.rejectedReplay++;
+    return -1;
+  }
+  stats_.batches++;
+
+  // Every magic packet goes out before the first probe starts
+  RelayResult wakes[RELAY_MAX_RECORDS];
+  uint8_t wakeCount = 0;
+  RelayJob job;
+  for (uint8_t i = 0; i < header.count; i++) {
+    if (!reader.job(i, job) || job.type != RELAY_JOB_WAKE) continue;
+
+    uint32_t start = hooks_.micros(hooks_.ctx);
+    bool ok = hooks_.wake(job, hooks_.ctx);
+    RelayResult& r = wakes[wakeCount++];
+    r.type = job.type;
+    r.id = job.id;
+    r.status = ok ? RELAY_OK : RELAY_FAILED;
+    r.micros = hooks_.micros(hooks_.ctx) - start;
+  }
+  sendResults(header, wakes, wakeCount);
+
+  int ran = wakeCount;
+  for (uint8_t i = 0; i < header.count; i++) {
+    if (!reader.job(i, job) || job.type != RELAY_JOB_PROBE) continue;
+
+    uint32_t start = hooks_.micros(hooks_.ctx);
+    bool ok = hooks_.probe(job, hooks_.ctx);
+    RelayResult r = {job.type, job.id, (uint8_t)(ok ? RELAY_OK : RELAY_FAILED),
+                     hooks_.micros(hooks_.ctx) - start};
+    sendResults(header, &r, 1);
+    ran++;
+  }
+
+  stats_.jobs += ran;
+  return ran;
+}
+
+// ========== DISPATCHER ==========
+RelayDispatcher::RelayDispatcher(const uint8_t key[RELAY_KEY_SIZE], uint16_t selfNode, uint32_t session)
+    : selfNode_(selfNode), session_(session), seq_(0) {
+  memcpy(key_, key, RELAY_KEY_SIZE);
+  for (int i = 0; i < MAX_RELAYS; i++) nodes_[i] = -1;
+  reset();
+}
+
+void RelayDispatcher::setRelayNode(uint8_t relay, uint16_t node) {
+  if (relay < MAX_RELAYS) nodes_[relay] = node;
+}
+
+void RelayDispatcher::reset() {
+  jobCount_ = 0;
+  pending_ = 0;
+  firstSeq_ = seq_ + 1;
+}
+
+int RelayDispatcher::add(uint8_t relay, const RelayJob& job) {
+  if (jobCount_ >= MAX_JOBS || relay >= MAX_RELAYS) return -1;
+
+  Slot& slot = jobs_[jobCount_];
+  slot.job = job;
+  slot.job.id = (uint8_t)jobCount_;
+  slot.result.type = job.type;
+  slot.result.id = slot.job.id;
+  slot.result.status = RELAY_PENDING;
+  slot.result.micros = 0;
+  slot.relay = relay;
+  slot.attempts = 0;
+  slot.sentMs = 0;
+  slot.doneMs = 0;
+  slot.retryMs = 0;
+  pending_++;
+  return jobCount_++;
+}
+
+int RelayDispatcher::transmit(SendFn send, void* ctx, uint32_t nowMs) {
+  int datagrams = 0;
+  for (uint8_t relay = 0; relay < MAX_RELAYS; relay++) {
+    uint8_t buffer[RELAY_MAX_DATAGRAM];
+    RelayWriter writer(buffer, sizeof(buffer));
+    RelayHeader header = {RELAY_MSG_BATCH, selfNode_, 0, session_, seq_ + 1};
+    writer.begin(header);
+
+    // Resending a job the relay is still probing would run it twice
+    int added[RELAY_MAX_RECORDS];
+    int count = 0;
+    uint32_t budgetMs = RELAY_RETRY_MARGIN;
+    for (int i = 0; i < jobCount_; i++) {
+      Slot& slot = jobs_[i];
+      if (slot.relay != relay || slot.result.status != RELAY_PENDING) continue;
+      if (slot.attempts && (int32_t)(nowMs - slot.retryMs) < 0) continue;
+      if (!writer.add(slot.job)) break;
+      if (slot.attempts++ == 0) slot.sentMs = nowMs;
+      if (slot.job.type == RELAY_JOB_PROBE) budgetMs += slot.job.param ? slot.job.param : RELAY_DEFAULT_PROBE_TIMEOUT;
+      added[count++] = i;
+    }
+    for (int i = 0; i < count; i++) jobs_[added[i]].retryMs = nowMs + budgetMs;
+
+    size_t len = writer.finish(key_);
+    if (!len) continue;
+    seq_++;
+    send(relay, buffer, len, ctx);
+    datagrams++;
+  }
+  return datagrams;
+}
+
+bool RelayDispatcher::receive(const uint8_t* data, size_t len, uint32_t nowMs) {
+  RelayReader reader;
+  if (!reader.open(data, len, key_)) return false;
+
+  // Only results for batches of the current dispatch count
+  const RelayHeader& header = reader.header();
+  if (header.type != RELAY_MSG_RESULT || header.session != session_ ||
+      header.seq < firstSeq_ || header.seq > seq_) {
+    return false;
+  }
+
+  RelayResult r;
+  for (uint8_t i = 0; i < header.count; i++) {
+    if (!reader.result(i, r) || r.id >= jobCount_ || r.status == RELAY_PENDING) continue;
+
+    // Every node holds the key, but only the job's own relay may answer it
+    Slot& slot = jobs_[r.id];
+    if (nodes_[slot.relay] != header.node) continue;
+    if (slot.result.status != RELAY_PENDING || slot.job.type != r.type) continue;
+    slot.result = r;
+    slot.doneMs = nowMs;
+    pending_--;
+  }
+  return true;
+}
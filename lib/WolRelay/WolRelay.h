@@ -0,0 +1,194 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Relay protocol between the Telegram front-end and WoL relays on other LAN
+// segments. One authenticated UDP datagram carries every job for a segment;
+// the relay sends all magic packets first, answers with their results in one
+// datagram and then streams one datagram per finished probe.
+//
+//   header  16 bytes  'W' 'R' version type | node(2) count flags | session(4) | seq(4)
+//   records count x 16 (jobs) or count x 8 (results)
+//   tag      8 bytes  SipHash-2-4 over everything before it
+//
+// Multi-byte fields are big-endian, IPv4 addresses are a.b.c.d -> 0xaabbccdd.
+// Sessions only grow (the front-end uses a boot counter): a relay refuses
+// batches from an older session than the last one it saw from that sender,
+// and within a session only accepts sequence numbers above the last one.
+// Results echo the batch session and seq.
+
+const uint16_t RELAY_DEFAULT_PORT = 40009;
+const uint8_t RELAY_VERSION = 1;
+const size_t RELAY_KEY_SIZE = 16;
+const size_t RELAY_HEADER_SIZE = 16;
+const size_t RELAY_JOB_SIZE = 16;
+const size_t RELAY_RESULT_SIZE = 8;
+const size_t RELAY_TAG_SIZE = 8;
+const size_t RELAY_MAX_DATAGRAM = 1400;
+const size_t RELAY_MAX_RECORDS = 64;
+const uint16_t RELAY_DEFAULT_PROBE_TIMEOUT = 1000;  // ms, probe jobs with param 0
+const uint32_t RELAY_RETRY_MARGIN = 300;           // ms on top of a batch's probe time
+
+enum RelayMsgType : uint8_t { RELAY_MSG_BATCH = 1, RELAY_MSG_RESULT = 2 };
+enum RelayJobType : uint8_t { RELAY_JOB_WAKE = 1, RELAY_JOB_PROBE = 2 };
+enum RelayStatus : uint8_t { RELAY_OK = 0, RELAY_FAILED = 1, RELAY_PENDING = 0xFF };
+
+struct RelayJob {
+  uint8_t type;
+  uint8_t id;          // Unique within one dispatch
+  uint16_t port;       // WoL UDP port or probed TCP port
+  uint32_t ip;         // WoL broadcast (0 = relay's own) or probed host
+  uint8_t mac[6];
+  uint16_t param;      // WoL repeats or probe timeout in ms
+};
+
+struct RelayResult {
+  uint8_t type;
+  uint8_t id;
+  uint8_t status;
+  uint32_t micros;     // Time the relay spent on the job
+};
+
+struct RelayHeader {
+  uint8_t type;
+  uint16_t node;
+  uint8_t count;
+  uint32_t session;
+  uint32_t seq;
+};
+
+uint64_t relaySipHash(const uint8_t key[RELAY_KEY_SIZE], const uint8_t* data, size_t len);
+
+// Serializes one datagram into a caller-owned buffer
+class RelayWriter {
+ public:
+  RelayWriter(uint8_t* buffer, size_t capacity);
+
+  void begin(const RelayHeader& header);
+  bool add(const RelayJob& job);
+  bool add(const RelayResult& result);
+  size_t finish(const uint8_t key[RELAY_KEY_SIZE]);  // 0 if nothing fits
+  uint8_t count() const { return count_; }
+
+ private:
+  uint8_t* buffer_;
+  size_t capacity_;
+  size_t length_;
+  uint8_t count_;
+  uint8_t type_;
+};
+
+// Verifies and walks one received datagram
+class RelayReader {
+ public:
+  // Checks size, magic, version and tag; header() and the records are only
+  // meaningful when this returns true
+  bool open(const uint8_t* data, size_t len, const uint8_t key[RELAY_KEY_SIZE]);
+
+  const RelayHeader& header() const { return header_; }
+  bool job(uint8_t index, RelayJob& job) const;
+  bool result(uint8_t index, RelayResult& result) const;
+
+ private:
+  const uint8_t* data_;
+  RelayHeader header_;
+};
+
+// Relay side: executes authenticated batches through platform hooks
+class RelayNode {
+ public:
+  struct Hooks {
+    bool (*wake)(const RelayJob& job, void* ctx);
+    bool (*probe)(const RelayJob& job, void* ctx);
+    void (*reply)(const uint8_t* data, size_t len, void* ctx);
+    uint32_t (*micros)(void* ctx);
+    void* ctx;
+  };
+
+  struct Stats {
+    uint32_t batches;
+    uint32_t jobs;
+    uint32_t rejectedAuth;
+    uint32_t rejectedReplay;
+  };
+
+  RelayNode(const uint8_t key[RELAY_KEY_SIZE], uint16_t nodeId, const Hooks& hooks);
+
+  // Returns the number of jobs run, or -1 if the datagram was rejected
+  int handle(const uint8_t* data, size_t len);
+  const Stats& stats() const { return stats_; }
+
+ private:
+  static const int MAX_SENDERS = 8;
+  struct Sender {
+    bool used;
+    uint16_t node;
+    uint32_t session;
+    uint32_t seq;
+  };
+
+  bool acceptSequence(const RelayHeader& header);
+  void sendResults(const RelayHeader& batch, const RelayResult* results, uint8_t count);
+
+  uint8_t key_[RELAY_KEY_SIZE];
+  uint16_t nodeId_;
+  Hooks hooks_;
+  Stats stats_;
+  Sender senders_[MAX_SENDERS];
+};
+
+// Front-end side: fans jobs out to relays in one datagram per relay and
+// collects the streamed results
+class RelayDispatcher {
+ public:
+  static const int MAX_RELAYS = 8;
+  static const int MAX_JOBS = RELAY_MAX_RECORDS;
+
+  typedef void (*SendFn)(uint8_t relay, const uint8_t* data, size_t len, void* ctx);
+
+  RelayDispatcher(const uint8_t key[RELAY_KEY_SIZE], uint16_t selfNode, uint32_t session);
+
+  // Results for a relay's jobs are only taken from the node id set here;
+  // a relay without one never completes a job
+  void setRelayNode(uint8_t relay, uint16_t node);
+
+  void reset();
+  int add(uint8_t relay, const RelayJob& job);  // job index, or -1 when full
+
+  // Sends every relay its pending jobs back-to-back. Call once to start and
+  // again after a timeout: only jobs without a result are resent, and only
+  // once their batch had time to finish. A relay runs its probes one after
+  // another, so a batch is due after the sum of its probe timeouts.
+  int transmit(SendFn send, void* ctx, uint32_t nowMs);
+  bool receive(const uint8_t* data, size_t len, uint32_t nowMs);
+  bool done() const { return pending_ == 0; }
+
+  int jobCount() const { return jobCount_; }
+  const RelayJob& job(int i) const { return jobs_[i].job; }
+  const RelayResult& result(int i) const { return jobs_[i].result; }
+  uint8_t relayOf(int i) const { return jobs_[i].relay; }
+  uint32_t latencyMs(int i) const { return jobs_[i].doneMs - jobs_[i].sentMs; }
+  uint8_t attempts(int i) const { return jobs_[i].attempts; }
+
+ private:
+  struct Slot {
+    RelayJob job;
+    RelayResult result;
+    uint8_t relay;
+    uint8_t attempts;
+    uint32_t sentMs;
+    uint32_t doneMs;
+    uint32_t retryMs;      // Not resent before this, the relay may still run it
+  };
+
+  uint8_t key_[RELAY_KEY_SIZE];
+  uint16_t selfNode_;
+  uint32_t session_;
+  uint32_t seq_;
+  uint32_t firstSeq_;
+  int32_t nodes_[MAX_RELAYS];   // -1 = not set
+  Slot jobs_[MAX_JOBS];
+  int jobCount_;
+  int pending_;
+};
@@ -3,137 +3,1331 @@
 #include <WiFi.h>
 #include <WiFiUdp.h>
 #include <WiFiClient.h>
+#include <WiFiClientSecure.h>
 #include <HTTPClient.h>
+#include <Preferences.h>
+#include <esp_sntp.h>
+#include <time.h>
+#include <lwip/etharp.h>
+#include <lwip/tcpip.h>
+#include <lwip/pbuf.h>
+#include <lwip/sockets.h>
+#include <ping/ping_sock.h>
 #include <ArduinoJson.h>
+#include <BotCore.h>
+#include <CronSchedule.h>
+#include <WolPacket.h>
+#include <WolRelay.h>
+#include <WakeSequence.h>
+#include <SpanTrace.h>
+#include <AsyncLog.h>
+#include <SleepProxy.h>
 
 // ========== CONFIGURATION ==========
 const char* ssid = "SSID";
 const char* password = "Password";
 const String botToken = "Bot token";
-const String allowedUsers[] = {"1111111111", ""}; // User whitelist (Telegram IDs)
+const char* allowedUsers[] = {"1111111111", ""}; // User whitelist (Telegram IDs)
+
+// Flood protection: checked before any reply is sent
+const int CHAT_BURST = 5;               // Commands a chat can send back-to-back
+const int CHAT_REFILL = 3;              // Then one more command every 3 seconds
+const int CHAT_NOTICE_WINDOW = 60;      // At most one rejection reply per chat per 60 seconds
+const int TELEGRAM_BATCH = 8;           // Updates fetched per poll
+const bool ANSWER_UNAUTHORIZED = false; // false = ignore unknown chats silently, true = one reply per window to all of them
+
+// Tracing
+const bool TRACE_AT_BOOT = true;        // Record spans from power-on (/trace on|off)
 
 // WoL Settings
-const String serverMAC = "A1:AA:1A:1A:11:A1"; // Server MAC address
+constexpr char serverMAC[] = "A1:AA:1A:1A:11:A1"; // Server MAC address (checked at compile time)
+constexpr char secureOnPassword[] = "";            // SecureOn password "AA:BB:CC:DD[:EE:FF]", empty = none
 const IPAddress serverIP(192, 168, 1, 228);   // Server local IP
-const IPAddress broadcastIP(192, 168, 1, 255); // Broadcast IP
+
+// WoL burst: every round sends the packet to every address and port
+const IPAddress wolBroadcasts[] = {IPAddress(192, 168, 1, 255)}; // Directed broadcast IPs
+const uint16_t wolPorts[] = {9, 7};
+const int WOL_REPEATS = 3;         // Rounds per wake
+const int WOL_SPACING = 20;        // Pause between rounds (ms)
 
 // Monitoring (configured for your server)
 const int MAX_WAIT_TIME = 90;      // 90 seconds maximum (20-50 sec + margin)
 const int CHECK_INTERVAL = 3;      // Check every 3 seconds
 const int PROGRESS_UPDATE = 15;    // Progress update every 15 seconds
 
+// Boot timeline: ARP → ICMP → SSH → application health check
+const uint16_t BOOT_SSH_PORT = 22;
+const uint16_t HEALTH_PORT = 22;        // The default waits for sshd, e.g. 80 with an HTTP path
+const char* HEALTH_HTTP_PATH = "";      // HTTP health check path, e.g. "/" ("" = TCP banner check instead)
+const int HEALTH_HTTP_STATUS = 0;       // Expected HTTP status (0 = any response)
+const char* HEALTH_BANNER = "SSH-";     // Expected banner prefix for the TCP check ("" = any)
+const int BOOT_HISTORY = 8;             // Boot timelines kept for trends
+
+// Scheduled wakes: the cron time is when the server must be READY, the WoL
+// goes out earlier by the measured boot time plus a margin
+const char* TIMEZONE = "UTC0";          // POSIX TZ, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+const char* NTP_SERVER = "pool.ntp.org";
+const int SCHEDULE_MARGIN = 30;         // Safety margin on top of boot time (sec)
+const int DEFAULT_BOOT_TIME = 50;       // Boot time estimate until one is measured (sec)
+const int MAX_SCHEDULES = 8;
+
+// Relay cluster: one front-end talks to Telegram, relays on other LAN
+// segments send the magic packets there (tools/relay runs a relay on Linux)
+enum RelayRole { RELAY_OFF, RELAY_FRONTEND, RELAY_NODE };
+const RelayRole RELAY_ROLE = RELAY_OFF;
+const uint16_t RELAY_NODE_ID = 1;       // Unique per node in the cluster
+const uint16_t RELAY_PORT = RELAY_DEFAULT_PORT;
+const int RELAY_TIMEOUT = 5000;         // Wait for relay results (ms)
+const int RELAY_RETRY = 400;            // Resend unanswered jobs after (ms)
+const uint8_t RELAY_KEY[RELAY_KEY_SIZE] = { // Shared secret, change it on every node!
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+  0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+
+struct RelaySegment {
+  const char* name;
+  IPAddress relayIP;      // Relay node on that segment
+  uint16_t relayNode;     // Its RELAY_NODE_ID, only it may answer for the segment
+};
+const RelaySegment relaySegments[] = {
+  {"lab", IPAddress(192, 168, 20, 50), 2},
+};
+
+struct RelayTarget {
+  const char* name;
+  const char* mac;
+  uint8_t segment;        // Index in relaySegments
+  IPAddress ip;
+  IPAddress broadcast;    // Directed broadcast of the segment
+  uint16_t probePort;
+};
+const RelayTarget relayTargets[] = {
+  {"lab-nas", "AA:BB:CC:DD:EE:01", 0, IPAddress(192, 168, 20, 10), IPAddress(192, 168, 20, 255), 22},
+};
+
+// Liveness cache (shared by /check, /status, watch and boot monitoring)
+const int LIVENESS_FRESH_TIME = 10;    // Results younger than 10 seconds are reused
+const int LIVENESS_MAX_WAITERS = 4;    // Chats waiting on one in-flight /check
+const int LIVENESS_SLOTS = 4;
+
+// Uptime watch (keeps monitoring hosts after boot)
+const bool WATCH_ENABLED = true;
+const int WATCH_INTERVAL = 30;          // Steady probe every 30 seconds
+const int WATCH_CONFIRM_INTERVAL = 2;   // Confirmation probes every 2 seconds after a failure
+const int WATCH_CONFIRM_PROBES = 3;     // Failed confirmations before reporting DOWN
+const int WATCH_PROBE_TIMEOUT = 400;    // TCP connect timeout per port (ms)
+const int WATCH_BYTES_PER_CONNECT = 420; // ~7 frames of a TCP open/close on the air
+const uint16_t watchPorts[] = {22, 80, 443}; // Probe ports, the last one that answered goes first
+
+struct WatchHost {
+  const char* name;
+  IPAddress ip;
+};
+const WatchHost watchHosts[] = {
+  {"server", serverIP},
+};
+
+// Wake sequences: a host is woken only after every host in "after" answers
+struct SequenceHost {
+  const char* name;
+  const char* mac;
+  IPAddress ip;
+  uint16_t probePort;     // TCP port that means "up"
+  const char* after;      // Dependencies, comma-separated ("" = none)
+};
+const SequenceHost sequenceHosts[] = {
+  {"server", serverMAC, serverIP, 22, ""},
+  {"nas", "AA:BB:CC:DD:EE:02", IPAddress(192, 168, 1, 50), 22, ""},
+  {"app", "AA:BB:CC:DD:EE:03", IPAddress(192, 168, 1, 60), 80, "server,nas"},
+};
+struct SequencePlan {
+  const char* name;
+  const char* hosts;      // Hosts to bring up, their dependencies are added automatically
+};
+const SequencePlan sequencePlans[] = {
+  {"lab", "app"},
+};
+const int SEQUENCE_MAX_POWERING = 1;    // Hosts booting at the same time (PDU inrush)
+const int SEQUENCE_STAGGER = 10;        // Minimum seconds between two power-ons
+const int SEQUENCE_PROBE_INTERVAL = 3;  // Probe booting hosts every 3 seconds
+const int SEQUENCE_BOOT_TIMEOUT = 180;  // WoL → online before the host counts as failed (sec)
+
+// Sleep proxy: while the server is down, answer ARP for it and wake it on a connection
+const bool SLEEP_PROXY_ENABLED = true;
+const uint16_t proxyPorts[] = {22, 80, 443}; // A SYN to one of these wakes the server
+const int PROXY_WAKE_RETRY = 120;       // Another SYN resends WoL after 120 seconds without handover
+const int PROXY_ARP_CONFIRM = 3;        // Unanswered ARP requests (a loop pass apart) before the proxy starts
+
 // ========== VARIABLES ==========
 int lastUpdateId = 0;
-uint8_t macArray[6];
+TelegramUpdate updateBatch[TELEGRAM_BATCH]; // Updates of the last poll
 
 // Monitoring
 bool isMonitoring = false;
 unsigned long wakeCommandTime = 0;     // Time when /wake command was received
 unsigned long wolSentTime = 0;         // Time when WoL packet was sent
+
+// Magic packet built by the compiler, lives in flash
+static_assert(isValidMac(serverMAC), "serverMAC is not a valid MAC address");
+static_assert(isValidSecureOn(secureOnPassword), "secureOnPassword must be empty, 4 or 6 bytes");
+constexpr WolMagicPacket wolPacket = makeMagicPacket(serverMAC, secureOnPassword);
+const int WOL_BROADCAST_COUNT = sizeof(wolBroadcasts) / sizeof(wolBroadcasts[0]);
+const int WOL_PORT_COUNT = sizeof(wolPorts) / sizeof(wolPorts[0]);
+
+// Last WoL burst
+struct WolBurstStats {
+  uint16_t datagrams;
+  uint16_t failed;
+  unsigned long firstMicros;           // sendWOL() call → first datagram handed to lwIP
+  unsigned long maxSendMicros;         // Slowest single send
+  unsigned long totalSendMicros;       // Sum of all sends
+  unsigned long commandToWolMicros;    // Update receipt → first datagram (0 = not a command)
+  unsigned long burstMicros;           // Whole burst including spacing
+};
+WolBurstStats wolBurst;
+unsigned long updateReceivedMicros = 0; // micros() when the current update arrived
+unsigned long commandMicros = 0;        // Receipt of the command behind the next WoL (0 = none)
+WiFiUDP wolUdp;                        // Persistent WoL socket
 String monitoringChatID = "";
 int lastProgressUpdate = 0;            // Last progress update time
 
+// Flood protection
+ChatRateLimiter chatLimiter(CHAT_BURST, CHAT_REFILL * 1000UL, CHAT_NOTICE_WINDOW * 1000UL);
+unsigned long rejectedUnauthorized = 0;
+
+// Boot timeline of the current wake
+enum BootStage { STAGE_ARP, STAGE_ICMP, STAGE_SSH, STAGE_SERVICE, STAGE_COUNT };
+const char* const bootStageNames[STAGE_COUNT] = {"ARP", "ICMP", "SSH", "Service"};
+unsigned long bootStageAt[STAGE_COUNT];  // millis() a stage first appeared, 0 = not yet
+volatile unsigned long icmpReplyAt = 0;  // Set by the ping task
+esp_ping_handle_t bootPing = NULL;
+unsigned long bootProbeAt = 0;           // millis() of the pending liveness request, 0 = none
+
+// Finished timelines (ms after WoL per stage, 0 = never seen), stored in NVS
+struct BootRecord {
+  uint32_t wolAt;                        // Unix time of the WoL
+  uint32_t stageMs[STAGE_COUNT];
+};
+BootRecord bootHistory[BOOT_HISTORY];
+int bootHistoryCount = 0;
+
+// Scheduled wakes (stored in NVS)
+struct WakeSchedule {
+  char cron[32];                       // Ready-by time
+  char chatId[TELEGRAM_CHAT_ID_MAX];   // Who gets the boot report
+};
+WakeSchedule schedules[MAX_SCHEDULES];
+CronSpec scheduleSpecs[MAX_SCHEDULES];
+int scheduleCount = 0;
+Preferences prefs;
+unsigned long bootEstimateMs = DEFAULT_BOOT_TIME * 1000UL; // Measured WoL→Boot
+volatile bool schedulePlanDirty = true; // Recompute on change or clock sync
+time_t nextScheduleFire = 0;           // When the next WoL goes out (0 = none)
+time_t nextScheduleReady = 0;          // Its ready-by target
+int nextScheduleIndex = -1;
+time_t scheduledReadyBy = 0;           // Target of the running wake (0 = manual)
+
+// Liveness cache
+struct LivenessEntry {
+  IPAddress ip;
+  bool known;                 // At least one probe has finished
+  bool online;
+  uint16_t port;              // Port that answered (0 when offline)
+  unsigned long checkedAt;    // millis() of the last probe
+  bool inFlight;              // Probe running, every caller joins it
+  uint16_t firstPort;         // Tried first: the requested port or the last that answered
+  uint8_t portIndex;          // Port the probe is on (0 = firstPort)
+  bool connecting;            // fd holds a pending connect
+  int fd;
+  unsigned long connectAt;    // millis() the pending connect started
+  uint8_t connects;           // TCP connects of the last probe
+  uint32_t probeMicros;       // Loop time of the last probe over all its passes
+  String waiters[LIVENESS_MAX_WAITERS]; // Chats to answer when the probe finishes
+  uint8_t waiterCount;
+};
+LivenessEntry livenessCache[LIVENESS_SLOTS];
+
+// Uptime watch
+enum WatchState { WATCH_UNKNOWN, WATCH_UP, WATCH_SUSPECT, WATCH_DOWN };
+struct WatchStatus {
+  WatchState state;
+  uint16_t port;              // Port that answered last
+  uint8_t failedConfirms;     // Failed confirmation probes in a row
+  unsigned long nextProbe;    // millis() of the next probe
+  bool waiting;               // Liveness probe requested, result not in yet
+  unsigned long requestedAt;  // millis() of that request
+  unsigned long since;        // millis() of the last state change
+  unsigned long lastSeenUp;   // millis() of the last successful probe
+  unsigned long probes;       // Probes done
+  unsigned long connects;     // TCP connect attempts (network cost)
+  uint64_t probeMicros;       // Loop time spent probing (CPU cost)
+  unsigned long alerts;       // Up/down alerts sent
+};
+const int WATCH_HOST_COUNT = sizeof(watchHosts) / sizeof(watchHosts[0]);
+WatchStatus watchStatus[WATCH_HOST_COUNT];
+unsigned long watchStartTime = 0;
+
 // ========== FUNCTION PROTOTYPES ==========
 void sendTelegram(String chatID, String message);
+void bootTimelineStart();
+void sleepProxySet(bool active);
 
 // ========== WoL FUNCTIONS ==========
 void setupWOL() {
-  String macStr = serverMAC;
-  macStr.replace(":", "");
-  
-  for (int i = 0; i < 6; i++) {
-    String byteStr = macStr.substring(i*2, i*2+2);
-    macArray[i] = strtol(byteStr.c_str(), NULL, 16);
-  }
-  
-  Serial.println("MAC: " + serverMAC);
+  Serial.print("MAC: ");
+  Serial.print(serverMAC);
+  Serial.println(wolPacket.size > WOL_PACKET_SIZE ? " + SecureOn" : "");
+  Serial.print("⚡ WoL burst: ");
+  Serial.print(WOL_REPEATS);
+  Serial.print(" x ");
+  Serial.print(WOL_BROADCAST_COUNT * WOL_PORT_COUNT);
+  Serial.println(" datagrams");
 }
 
 bool sendWOL() {
-  Serial.println("⚡ Sending WoL packet...");
+  TRACE_SPAN("wol.send");
+  unsigned long start = micros();
   wolSentTime = millis(); // Record WoL send time
+  wolBurst = WolBurstStats();
   
-  WiFiUDP udp;
-  udp.beginPacket(broadcastIP, 9);
-  
-  // Send 6 bytes of 0xFF (WoL magic packet header)
-  for (int i = 0; i < 6; i++) udp.write(0xFF);
-  
-  // Send 16 repetitions of MAC address
-  for (int i = 0; i < 16; i++) {
-    for (int j = 0; j < 6; j++) {
-      udp.write(macArray[j]);
+  // Every round: each broadcast address on each port, one buffer write per datagram
+  for (int round = 0; round < WOL_REPEATS; round++) {
+    if (round > 0) delay(WOL_SPACING);
+    for (int a = 0; a < WOL_BROADCAST_COUNT; a++) {
+      for (int p = 0; p < WOL_PORT_COUNT; p++) {
+        unsigned long sendStart = micros();
+        wolUdp.beginPacket(wolBroadcasts[a], wolPorts[p]);
+        wolUdp.write(wolPacket.bytes, wolPacket.size);
+        bool sent = (wolUdp.endPacket() == 1);
+        unsigned long sendEnd = micros();
+        
+        if (wolBurst.datagrams == 0) {
+          wolBurst.firstMicros = sendEnd - start;
+          if (commandMicros) wolBurst.commandToWolMicros = sendEnd - commandMicros;
+        }
+        wolBurst.datagrams++;
+        if (!sent) wolBurst.failed++;
+        wolBurst.totalSendMicros += sendEnd - sendStart;
+        if (sendEnd - sendStart > wolBurst.maxSendMicros) wolBurst.maxSendMicros = sendEnd - sendStart;
+      }
     }
   }
+  wolBurst.burstMicros = micros() - start;
+  commandMicros = 0;
   
-  bool success = (udp.endPacket() == 1);
-  udp.stop();
-  
+  bool success = wolBurst.failed < wolBurst.datagrams;
   if (success) {
-    Serial.println("✅ WoL sent successfully");
-    // Calculate delay between command and WoL send
-    unsigned long commandToWolDelay = (wolSentTime - wakeCommandTime);
-    Serial.print("⏱️ Command→WoL delay: ");
-    Serial.print(commandToWolDelay);
-    Serial.println(" ms");
+    LOG_INFO("✅ WoL sent: %u/%u datagrams, first after %lu µs", wolBurst.datagrams - wolBurst.failed, wolBurst.datagrams, wolBurst.firstMicros);
+    if (wolBurst.commandToWolMicros) {
+      LOG_INFO("⏱️ Command→WoL: %lu µs from update receipt", wolBurst.commandToWolMicros);
+    }
   } else {
-    Serial.println("❌ WoL send error");
+    LOG_ERROR("❌ WoL send error");
   }
   
   return success;
 }
 
 // ========== SERVER CHECK ==========
-bool isServerOnline() {
-  HTTPClient http;
+void livenessRecord(IPAddress ip, bool online, uint16_t port);
+
+// Non-blocking TCP connect: started on one loop pass, polled on the next
+// ones, so no probe ever waits in connect()
+int connectStart(IPAddress ip, uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) return -1;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = (uint32_t)ip;
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// 1 connected, 0 refused or failed, -1 still pending
+int connectPoll(int fd) {
+  fd_set writable;
+  FD_ZERO(&writable);
+  FD_SET(fd, &writable);
+  struct timeval noWait = {0, 0};
+  int ready = select(fd + 1, NULL, &writable, NULL, &noWait);
+  if (ready == 0) return -1;
+  if (ready < 0) return 0;
   
-  // Check multiple ports for reliability
-  String urls[] = {
-    "http://" + serverIP.toString(),
-    "http://" + serverIP.toString() + ":80",
-    "http://" + serverIP.toString() + ":443"
-  };
+  int error = 0;
+  socklen_t length = sizeof(error);
+  getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+  return error == 0 ? 1 : 0;
+}
+
+// ========== LIVENESS CACHE ==========
+// Every probe result lands here, whoever ran it. A host has at most one
+// probe running: /check, the watch, boot monitoring and wake sequences all
+// join it and read its result from the entry once it finishes.
+LivenessEntry* livenessEntry(IPAddress ip) {
+  LivenessEntry* oldest = NULL;
+  for (int i = 0; i < LIVENESS_SLOTS; i++) {
+    LivenessEntry& e = livenessCache[i];
+    if (e.ip == ip && (e.known || e.inFlight)) return &e;
+    if (e.inFlight) continue;
+    if (!oldest || !e.known || (oldest->known && e.checkedAt < oldest->checkedAt)) oldest = &e;
+  }
+  
+  // Take a free slot or evict the oldest idle result
+  if (oldest) {
+    *oldest = LivenessEntry();
+    oldest->ip = ip;
+  }
+  return oldest;
+}
+
+void livenessRecord(IPAddress ip, bool online, uint16_t port) {
+  LivenessEntry* e = livenessEntry(ip);
+  if (!e) return;
+  e->known = true;
+  e->online = online;
+  e->port = online ? port : 0;
+  e->checkedAt = millis();
+}
+
+// Returns the entry if its result is younger than maxAgeMs, otherwise NULL
+const LivenessEntry* livenessFresh(IPAddress ip, unsigned long maxAgeMs) {
+  for (int i = 0; i < LIVENESS_SLOTS; i++) {
+    const LivenessEntry& e = livenessCache[i];
+    if (e.known && e.ip == ip && millis() - e.checkedAt < maxAgeMs) return &e;
+  }
+  return NULL;
+}
+
+String livenessText(const LivenessEntry& e) {
+  String text = e.online ? "✅ Server online! " : "❌ Server offline ";
+  text += e.ip.toString();
+  if (e.online) text += " (port " + String(e.port) + ")";
+  return text;
+}
+
+// Result of a probe that finished at or after `since`, NULL while there is none
+const LivenessEntry* livenessSince(IPAddress ip, unsigned long since) {
+  for (int i = 0; i < LIVENESS_SLOTS; i++) {
+    const LivenessEntry& e = livenessCache[i];
+    if (e.known && e.ip == ip && (long)(e.checkedAt - since) >= 0) return &e;
+  }
+  return NULL;
+}
+
+// n-th port of a probe: firstPort, then the watch ports without it (0 = done)
+uint16_t livenessPort(const LivenessEntry& e, int n) {
+  if (n == 0) return e.firstPort;
+  for (int p = 0; p < (int)(sizeof(watchPorts) / sizeof(watchPorts[0])); p++) {
+    if (watchPorts[p] != e.firstPort && --n == 0) return watchPorts[p];
+  }
+  return 0;
+}
+
+// Starts a probe of the host or joins the one already running. `port` goes
+// first (0 = the port that answered last).
+LivenessEntry* livenessRequest(IPAddress ip, uint16_t port) {
+  LivenessEntry* e = livenessEntry(ip);
+  if (!e || e->inFlight) return e;
+  e->inFlight = true;
+  e->firstPort = port ? port : (e->online ? e->port : watchPorts[0]);
+  e->portIndex = 0;
+  e->connects = 0;
+  e->probeMicros = 0;
+  return e;
+}
+
+// Queues chatID on the host's single in-flight probe
+bool livenessWait(IPAddress ip, String chatID) {
+  LivenessEntry* e = livenessRequest(ip, 0);
+  if (!e) return false;
   
-  for (int i = 0; i < 3; i++) {
-    http.begin(urls[i]);
-    http.setTimeout(2000); // 2 seconds timeout per attempt
+  for (int i = 0; i < e->waiterCount; i++) {
+    if (e->waiters[i] == chatID) return true;
+  }
+  if (e->waiterCount >= LIVENESS_MAX_WAITERS) return false;
+  e->waiters[e->waiterCount++] = chatID;
+  return true;
+}
+
+// Moves every running probe one stage per loop pass: starts the connect to
+// its next port or checks the pending one, never waits on it. The first
+// port that accepts ends the probe; after the last one the host is offline.
+void serviceLiveness() {
+  for (int i = 0; i < LIVENESS_SLOTS; i++) {
+    LivenessEntry& e = livenessCache[i];
+    if (!e.inFlight) continue;
     
-    int httpCode = http.GET();
-    http.end();
+    TRACE_SPAN("liveness.step");
+    unsigned long start = micros();
+    uint16_t port = livenessPort(e, e.portIndex);
+    if (!e.connecting) {
+      e.fd = connectStart(e.ip, port);
+      e.connecting = e.fd >= 0;
+      e.connectAt = millis();
+      e.connects++;
+    }
+    int connected = e.connecting ? connectPoll(e.fd) : 0;
+    if (connected < 0 && millis() - e.connectAt < WATCH_PROBE_TIMEOUT) {
+      e.probeMicros += micros() - start;
+      continue;
+    }
+    if (e.connecting) close(e.fd);
+    e.connecting = false;
+    e.probeMicros += micros() - start;
+    if (connected <= 0 && livenessPort(e, ++e.portIndex)) continue;
+    
+    livenessRecord(e.ip, connected > 0, port);
+    e.inFlight = false;
+    LOG_DEBUG("🔍 Liveness %u.%u.%u.%u: %s after %u connects", e.ip[0], e.ip[1], e.ip[2], e.ip[3],
+              e.online ? "online" : "offline", e.connects);
+    
+    String result = livenessText(e);
+    for (int w = 0; w < e.waiterCount; w++) {
+      sendTelegram(e.waiters[w], result);
+      e.waiters[w] = "";
+    }
+    e.waiterCount = 0;
+  }
+}
+
+// ========== UPTIME WATCH ==========
+// The watch has no probe of its own: a due host gets a liveness request and
+// its result is read on a later pass. A steady probe of a host that is up
+// costs one connect to the port that answered last. Only a failure escalates
+// to confirmation probes, so a single lost SYN or a restarting service
+// doesn't flap the host to DOWN.
+void notifyAll(String message) {
+  for (int i = 0; i < sizeof(allowedUsers)/sizeof(allowedUsers[0]); i++) {
+    if (allowedUsers[i][0]) sendTelegram(allowedUsers[i], message);
+  }
+}
+
+// Boot reports go to the chat that asked for the wake; a wake nobody typed
+// (the sleep proxy's) reports to the whole whitelist
+void sendMonitoring(String message) {
+  if (monitoringChatID.length()) sendTelegram(monitoringChatID, message);
+  else notifyAll(message);
+}
+
+void watchSetState(int h, WatchState state, unsigned long now) {
+  watchStatus[h].state = state;
+  watchStatus[h].since = now;
+  watchStatus[h].failedConfirms = 0;
+  watchStatus[h].nextProbe = now + WATCH_INTERVAL * 1000UL;
+  // Confirmed down is when the sleep proxy takes over the server's address
+  if (watchHosts[h].ip == serverIP) sleepProxySet(state == WATCH_DOWN);
+}
+
+// Called by boot monitoring: the host is up, no alert needed
+void watchMarkUp(IPAddress ip) {
+  unsigned long now = millis();
+  for (int h = 0; h < WATCH_HOST_COUNT; h++) {
+    if (watchHosts[h].ip == ip) {
+      watchSetState(h, WATCH_UP, now);
+      watchStatus[h].lastSeenUp = now;
+    }
+  }
+}
+
+void checkWatch() {
+  if (!WATCH_ENABLED) return;
+  
+  unsigned long now = millis();
+  for (int h = 0; h < WATCH_HOST_COUNT; h++) {
+    WatchStatus& st = watchStatus[h];
+    const WatchHost& host = watchHosts[h];
+    if (!st.waiting && (long)(now - st.nextProbe) < 0) continue;
+    
+    // Boot monitoring owns the server while it is waking up
+    if (isMonitoring && host.ip == serverIP) {
+      st.waiting = false;
+      st.nextProbe = now + WATCH_INTERVAL * 1000UL;
+      continue;
+    }
     
-    // If we get any response (even error) - server is alive
-    if (httpCode > 0) {
-      Serial.print("✅ Server responds on port ");
-      Serial.print(i == 0 ? "80/443" : (i == 1 ? "80" : "443"));
-      Serial.print(", code: ");
-      Serial.println(httpCode);
-      return true;
+    const LivenessEntry* result;
+    if (!st.waiting) {
+      // A fresh "online" from /check or boot monitoring replaces a steady probe
+      result = livenessFresh(host.ip, LIVENESS_FRESH_TIME * 1000UL);
+      if (st.state != WATCH_UP || !result || !result->online) {
+        st.waiting = true;
+        st.requestedAt = now;
+        livenessRequest(host.ip, 0);
+        continue;
+      }
+    } else {
+      // Asking again each pass rejoins the probe if its slot was evicted
+      result = livenessSince(host.ip, st.requestedAt);
+      if (!result) {
+        livenessRequest(host.ip, 0);
+        continue;
+      }
+      st.waiting = false;
+      st.probes++;
+      st.connects += result->connects;
+      st.probeMicros += result->probeMicros;
+    }
+    bool alive = result->online;
+    if (alive) {
+      st.lastSeenUp = now;
+      st.port = result->port;
     }
     
-    delay(100); // Small pause between attempts
+    switch (st.state) {
+      case WATCH_UNKNOWN:
+        // First result after boot is only logged
+        watchSetState(h, alive ? WATCH_UP : WATCH_DOWN, now);
+        LOG_INFO("👁️ Watch: %s%s", host.name, alive ? " is up" : " is down");
+        break;
+        
+      case WATCH_UP:
+        if (!alive) {
+          st.state = WATCH_SUSPECT;
+          st.failedConfirms = 0;
+          st.nextProbe = now + WATCH_CONFIRM_INTERVAL * 1000UL;
+          LOG_WARN("⚠️ Watch: %s missed a probe, confirming...", host.name);
+        } else {
+          st.nextProbe = now + WATCH_INTERVAL * 1000UL;
+        }
+        break;
+        
+      case WATCH_SUSPECT:
+        if (alive) {
+          st.state = WATCH_UP;
+          st.nextProbe = now + WATCH_INTERVAL * 1000UL;
+          LOG_INFO("👁️ Watch: %s answered again, not a failure", host.name);
+        } else if (++st.failedConfirms >= WATCH_CONFIRM_PROBES) {
+          unsigned long lastSeen = (now - st.lastSeenUp) / 1000;
+          watchSetState(h, WATCH_DOWN, now);
+          st.alerts++;
+          
+          String msg = "🔴 " + String(host.name) + " is DOWN\n\n";
+          msg += "• IP: " + host.ip.toString() + "\n";
+          msg += "• No answer to " + String(WATCH_CONFIRM_PROBES) + " confirmation probes\n";
+          msg += "• Last seen up: " + String(lastSeen) + " sec ago\n\n";
+          msg += "Use /wake to turn it on";
+          notifyAll(msg);
+          
+          LOG_WARN("🔴 Watch: %s is DOWN", host.name);
+        } else {
+          st.nextProbe = now + WATCH_CONFIRM_INTERVAL * 1000UL;
+        }
+        break;
+        
+      case WATCH_DOWN:
+        if (alive) {
+          unsigned long downtime = (now - st.since) / 1000;
+          watchSetState(h, WATCH_UP, now);
+          st.alerts++;
+          
+          String msg = "🟢 " + String(host.name) + " is UP again\n\n";
+          msg += "• IP: " + host.ip.toString() + "\n";
+          msg += "• Port: " + String(st.port) + "\n";
+          msg += "• Downtime: " + String(downtime) + " sec";
+          notifyAll(msg);
+          
+          LOG_INFO("🟢 Watch: %s is UP", host.name);
+        } else {
+          st.nextProbe = now + WATCH_INTERVAL * 1000UL;
+          // Still down: try the proxy again if ARP kept it from starting
+          if (host.ip == serverIP) sleepProxySet(true);
+        }
+        break;
+    }
+  }
+}
+
+// Measured watch cost scaled to one hour. Until a minute of data is
+// collected the steady-state projection from the settings is shown.
+String watchCostReport() {
+  unsigned long elapsed = millis() - watchStartTime;
+  unsigned long probes = 0, connects = 0;
+  uint64_t busyMicros = 0;
+  for (int h = 0; h < WATCH_HOST_COUNT; h++) {
+    probes += watchStatus[h].probes;
+    connects += watchStatus[h].connects;
+    busyMicros += watchStatus[h].probeMicros;
+  }
+  
+  String report;
+  if (elapsed < 60000 || probes == 0) {
+    float perHour = 3600.0 / WATCH_INTERVAL * WATCH_HOST_COUNT;
+    report += "• Probes: ~" + String(perHour, 0) + "/h (projected)\n";
+    report += "• Traffic: ~" + String(perHour * WATCH_BYTES_PER_CONNECT / 1024, 1) + " KB/h\n";
+    return report;
   }
   
-  // Alternative check via TCP connection
+  float scale = 3600000.0 / elapsed;
+  float busyMsPerHour = busyMicros / 1000.0 * scale;
+  report += "• Probes: " + String(probes * scale, 0) + "/h\n";
+  report += "• Traffic: ~" + String(connects * scale * WATCH_BYTES_PER_CONNECT / 1024, 1) + " KB/h\n";
+  report += "• Loop busy: " + String(busyMsPerHour / 1000, 1) + " sec/h (";
+  report += String(busyMsPerHour / 36000, 2) + "%)\n";
+  return report;
+}
+
+// ========== RELAY CLUSTER ==========
+// Front-end: /wakeall and /checkall send each segment one datagram with all
+// of its jobs and aggregate the results streamed back. Node: executes
+// batches from the front-end and never talks to Telegram.
+WiFiUDP relayUdp;
+
+uint32_t relayIp(IPAddress ip) {
+  return (uint32_t)ip[0] << 24 | (uint32_t)ip[1] << 16 | (uint32_t)ip[2] << 8 | ip[3];
+}
+
+IPAddress relayIp(uint32_t ip) {
+  return IPAddress(ip >> 24, ip >> 16, ip >> 8, ip);
+}
+
+bool relayWake(const RelayJob& job, void* ctx) {
+  uint8_t packet[WOL_PACKET_SIZE];
+  buildMagicPacket(job.mac, packet);
+  
+  IPAddress target = job.ip ? relayIp(job.ip) : WiFi.broadcastIP();
+  bool ok = true;
+  for (int i = 0; i < (job.param ? job.param : 1); i++) {
+    relayUdp.beginPacket(target, job.port);
+    relayUdp.write(packet, sizeof(packet));
+    ok &= (relayUdp.endPacket() == 1);
+  }
+  return ok;
+}
+
+bool relayProbe(const RelayJob& job, void* ctx) {
   WiFiClient client;
-  bool portOpen = client.connect(serverIP, 22, 1000); // Check port 22 (SSH)
+  bool open = client.connect(relayIp(job.ip), job.port, job.param ? job.param : RELAY_DEFAULT_PROBE_TIMEOUT);
   client.stop();
+  return open;
+}
+
+void relayReply(const uint8_t* data, size_t len, void* ctx) {
+  relayUdp.beginPacket(relayUdp.remoteIP(), relayUdp.remotePort());
+  relayUdp.write(data, len);
+  relayUdp.endPacket();
+}
+
+uint32_t relayMicros(void* ctx) {
+  return micros();
+}
+
+const RelayNode::Hooks relayHooks = {relayWake, relayProbe, relayReply, relayMicros, NULL};
+RelayNode relayNode(RELAY_KEY, RELAY_NODE_ID, relayHooks);
+
+void serviceRelayNode() {
+  uint8_t buffer[RELAY_MAX_DATAGRAM];
+  while (relayUdp.parsePacket() > 0) {
+    int len = relayUdp.read(buffer, sizeof(buffer));
+    if (len <= 0) continue;
+    
+    int ran = relayNode.handle(buffer, len);
+    if (ran < 0) {
+      LOG_WARN("⛔ Relay: rejected datagram from %u.%u.%u.%u", relayUdp.remoteIP()[0], relayUdp.remoteIP()[1], relayUdp.remoteIP()[2], relayUdp.remoteIP()[3]);
+    } else {
+      LOG_INFO("📡 Relay: ran jobs for %u.%u.%u.%u", relayUdp.remoteIP()[0], relayUdp.remoteIP()[1], relayUdp.remoteIP()[2], relayUdp.remoteIP()[3]);
+    }
+  }
+}
+
+// One session per boot from a counter in NVS: relays refuse older sessions,
+// so a captured batch can't be played back after a reboot
+uint32_t nextRelaySession() {
+  uint32_t session = prefs.getULong("relaySession", 0) + 1;
+  prefs.putULong("relaySession", session);
+  return session;
+}
+
+RelayDispatcher& relayDispatcher() {
+  static RelayDispatcher dispatcher(RELAY_KEY, RELAY_NODE_ID, nextRelaySession());
+  return dispatcher;
+}
+
+void relaySend(uint8_t relay, const uint8_t* data, size_t len, void* ctx) {
+  relayUdp.beginPacket(relaySegments[relay].relayIP, RELAY_PORT);
+  relayUdp.write(data, len);
+  relayUdp.endPacket();
+}
+
+// Runs one fleet-wide dispatch and returns the report for Telegram
+String runFleet(bool wake) {
+  const int targetCount = sizeof(relayTargets) / sizeof(relayTargets[0]);
+  const int segmentCount = sizeof(relaySegments) / sizeof(relaySegments[0]);
+  RelayDispatcher& dispatcher = relayDispatcher();
+  dispatcher.reset();
+  for (int seg = 0; seg < segmentCount; seg++) dispatcher.setRelayNode(seg, relaySegments[seg].relayNode);
+  int jobTarget[RelayDispatcher::MAX_JOBS];
+  
+  for (int t = 0; t < targetCount; t++) {
+    const RelayTarget& target = relayTargets[t];
+    RelayJob job = {};
+    if (wake) {
+      if (!parseMac(target.mac, job.mac)) {
+        LOG_WARN("❌ Relay: bad MAC for %s", target.name);
+        continue;
+      }
+      job.type = RELAY_JOB_WAKE;
+      job.ip = relayIp(target.broadcast);
+      job.port = 9;
+      job.param = 1;
+    } else {
+      job.type = RELAY_JOB_PROBE;
+      job.ip = relayIp(target.ip);
+      job.port = target.probePort;
+      job.param = WATCH_PROBE_TIMEOUT;
+    }
+    int index = dispatcher.add(target.segment, job);
+    if (index >= 0) jobTarget[index] = t;
+  }
+  
+  // All segments get their datagram back-to-back, then results stream in
+  unsigned long start = millis();
+  unsigned long lastSend = start;
+  int datagrams = dispatcher.transmit(relaySend, NULL, start);
+  uint8_t buffer[RELAY_MAX_DATAGRAM];
+  
+  while (!dispatcher.done() && millis() - start < RELAY_TIMEOUT) {
+    if (relayUdp.parsePacket() > 0) {
+      int len = relayUdp.read(buffer, sizeof(buffer));
+      if (len > 0) dispatcher.receive(buffer, len, millis());
+      continue;
+    }
+    if (millis() - lastSend >= RELAY_RETRY) {
+      lastSend = millis();
+      datagrams += dispatcher.transmit(relaySend, NULL, lastSend);
+    }
+    delay(1);
+  }
+  
+  int ok = 0;
+  String report = wake ? "🌐 Fleet wake:\n" : "🌐 Fleet check:\n";
+  for (int seg = 0; seg < segmentCount; seg++) {
+    report += "\n📍 " + String(relaySegments[seg].name) + " (" + relaySegments[seg].relayIP.toString() + "):\n";
+    for (int i = 0; i < dispatcher.jobCount(); i++) {
+      if (dispatcher.relayOf(i) != seg) continue;
+      
+      const RelayResult& result = dispatcher.result(i);
+      if (result.status == RELAY_OK) ok++;
+      report += "• " + String(relayTargets[jobTarget[i]].name) + " ";
+      
+      if (result.status == RELAY_PENDING) {
+        report += "⏰ relay did not answer\n";
+      } else if (wake) {
+        report += result.status == RELAY_OK ? "✅ sent" : "❌ send error";
+        report += ", " + String(dispatcher.latencyMs(i)) + " ms\n";
+      } else {
+        report += result.status == RELAY_OK ? "✅ online" : "❌ offline";
+        report += ", " + String(dispatcher.latencyMs(i)) + " ms\n";
+      }
+    }
+  }
+  
+  unsigned long elapsed = millis() - start;
+  report += "\n⏱️ " + String(dispatcher.jobCount()) + " jobs, " + String(datagrams);
+  report += " datagrams, " + String(elapsed) + " ms";
+  LOG_INFO("🌐 Fleet %s: %d/%d OK, %d datagrams, %lu ms", wake ? "wake" : "check", ok, dispatcher.jobCount(), datagrams, elapsed);
+  return report;
+}
+
+// ========== WAKE SEQUENCES ==========
+// One plan at a time runs through the WakeSequencer state machine. Every
+// loop pass advances it by one step; progress and the final report with the
+// critical path go to the chat that started it.
+const int SEQUENCE_HOST_COUNT = sizeof(sequenceHosts) / sizeof(sequenceHosts[0]);
+const int SEQUENCE_PLAN_COUNT = sizeof(sequencePlans) / sizeof(sequencePlans[0]);
+int sequenceRunning = -1;                     // Index in sequencePlans, -1 = idle
+uint8_t sequenceHostOf[SEQ_MAX_HOSTS];        // Sequencer host → sequenceHosts index
+SeqHostState sequenceReported[SEQ_MAX_HOSTS]; // Last state sent to the chat
+String sequenceChatID;
+
+bool sequenceWake(uint8_t host, void* ctx) {
+  TRACE_SPAN("sequence.wake");
+  uint8_t mac[WOL_MAC_SIZE];
+  if (!parseMac(sequenceHosts[sequenceHostOf[host]].mac, mac)) return false;
+  uint8_t packet[WOL_PACKET_SIZE];
+  buildMagicPacket(mac, packet);
+  
+  bool sent = false;
+  for (int a = 0; a < WOL_BROADCAST_COUNT; a++) {
+    for (int p = 0; p < WOL_PORT_COUNT; p++) {
+      wolUdp.beginPacket(wolBroadcasts[a], wolPorts[p]);
+      wolUdp.write(packet, sizeof(packet));
+      sent |= (wolUdp.endPacket() == 1);
+    }
+  }
+  return sent;
+}
+
+// Joins the host's liveness probe, which tries probePort first. A result
+// from within the last probe interval is reused.
+SeqProbe sequenceProbe(uint8_t host, void* ctx) {
+  TRACE_SPAN("sequence.probe");
+  const SequenceHost& h = sequenceHosts[sequenceHostOf[host]];
+  const LivenessEntry* result = livenessSince(h.ip, millis() - SEQUENCE_PROBE_INTERVAL * 1000UL);
+  if (!result) {
+    livenessRequest(h.ip, h.probePort);
+    return SEQ_PROBE_PENDING;
+  }
+  return result->online && result->port == h.probePort ? SEQ_PROBE_UP : SEQ_PROBE_DOWN;
+}
+
+WakeSequencer sequencer(
+  WakeSequencer::Hooks{sequenceWake, sequenceProbe, NULL},
+  WakeSequencer::Config{SEQUENCE_MAX_POWERING, SEQUENCE_STAGGER * 1000UL,
+                        SEQUENCE_PROBE_INTERVAL * 1000UL, SEQUENCE_BOOT_TIMEOUT * 1000UL});
+
+// Next name of a comma-separated list as a sequenceHosts index: -1 unknown, -2 at the end
+int nextSequenceHost(const char*& list, String& name) {
+  while (*list == ',' || *list == ' ') list++;
+  if (!*list) return -2;
+  
+  const char* end = list;
+  while (*end && *end != ',' && *end != ' ') end++;
+  name = String(list).substring(0, end - list);
+  list = end;
+  
+  for (int i = 0; i < SEQUENCE_HOST_COUNT; i++) {
+    if (name == sequenceHosts[i].name) return i;
+  }
+  return -1;
+}
+
+String sequenceSeconds(uint32_t ms) {
+  return String((ms + 500) / 1000);
+}
+
+// Builds the plan with every dependency pulled in, returns an error text or ""
+String startSequence(int plan) {
+  bool wanted[SEQUENCE_HOST_COUNT] = {};
+  String name;
+  const char* list = sequencePlans[plan].hosts;
+  for (int h; (h = nextSequenceHost(list, name)) != -2;) {
+    if (h < 0) return "unknown host " + name;
+    wanted[h] = true;
+  }
+  
+  for (bool added = true; added;) {
+    added = false;
+    for (int i = 0; i < SEQUENCE_HOST_COUNT; i++) {
+      if (!wanted[i]) continue;
+      list = sequenceHosts[i].after;
+      for (int h; (h = nextSequenceHost(list, name)) != -2;) {
+        if (h < 0) return "unknown dependency " + name + " of " + sequenceHosts[i].name;
+        if (!wanted[h]) added = true;
+        wanted[h] = true;
+      }
+    }
+  }
+  
+  int indexOf[SEQUENCE_HOST_COUNT];
+  int count = 0;
+  for (int i = 0; i < SEQUENCE_HOST_COUNT; i++) {
+    indexOf[i] = wanted[i] ? count++ : -1;
+  }
+  if (count > SEQ_MAX_HOSTS) return "too many hosts";
   
-  if (portOpen) {
-    Serial.println("✅ Port 22 (SSH) open - server is alive");
-    return true;
+  sequencer.reset();
+  for (int i = 0; i < SEQUENCE_HOST_COUNT; i++) {
+    if (!wanted[i]) continue;
+    uint32_t dependsOn = 0;
+    list = sequenceHosts[i].after;
+    for (int h; (h = nextSequenceHost(list, name)) != -2;) dependsOn |= 1UL << indexOf[h];
+    sequenceHostOf[sequencer.addHost(dependsOn)] = i;
+    sequenceReported[indexOf[i]] = SEQ_WAITING;
   }
   
-  // Check port 80 directly via TCP
-  bool port80Open = client.connect(serverIP, 80, 1000);
+  if (!sequencer.start(millis())) return "dependency cycle";
+  sequenceRunning = plan;
+  return "";
+}
+
+String sequenceReport() {
+  String report = "🧩 Sequence \"" + String(sequencePlans[sequenceRunning].name) + "\" finished in ";
+  report += sequenceSeconds(sequencer.finishMs() - sequencer.startMs()) + " sec:\n\n";
+  
+  for (int i = 0; i < sequencer.hostCount(); i++) {
+    const WakeSequencer::Host& h = sequencer.host(i);
+    report += "• " + String(sequenceHosts[sequenceHostOf[i]].name) + ": ";
+    if (h.state == SEQ_SKIPPED) {
+      report += "⏭️ skipped, a dependency failed\n";
+    } else if (h.wasOnline) {
+      report += "✅ was already online\n";
+    } else {
+      report += h.state == SEQ_ONLINE ? "✅ " : "❌ failed, ";
+      report += "deps " + sequenceSeconds(h.readyMs - sequencer.startMs());
+      report += " + queue " + sequenceSeconds(h.wokeMs - h.readyMs);
+      report += " + boot " + sequenceSeconds(h.doneMs - h.wokeMs) + " sec\n";
+    }
+  }
+  
+  // Each stage of the critical path: its finish minus the previous one
+  uint8_t path[SEQ_MAX_HOSTS];
+  int length = sequencer.criticalPath(path, SEQ_MAX_HOSTS);
+  if (length > 0) {
+    report += "\n🏁 Critical path: ";
+    uint32_t previous = sequencer.startMs();
+    for (int i = 0; i < length; i++) {
+      const WakeSequencer::Host& h = sequencer.host(path[i]);
+      if (i > 0) report += " → ";
+      report += String(sequenceHosts[sequenceHostOf[path[i]]].name) + " " + sequenceSeconds(h.doneMs - previous) + "s";
+      previous = h.doneMs;
+    }
+    report += " = " + sequenceSeconds(previous - sequencer.startMs()) + " sec";
+  }
+  return report;
+}
+
+void serviceSequence() {
+  if (sequenceRunning < 0) return;
+  bool running = sequencer.step(millis());
+  
+  String progress = "";
+  for (int i = 0; i < sequencer.hostCount(); i++) {
+    const WakeSequencer::Host& h = sequencer.host(i);
+    if (h.state == sequenceReported[i] || h.state == SEQ_READY) continue;
+    sequenceReported[i] = h.state;
+    
+    String name = sequenceHosts[sequenceHostOf[i]].name;
+    if (h.state == SEQ_POWERING) {
+      progress += "⚡ " + name + ": WoL sent\n";
+    } else if (h.state == SEQ_ONLINE && !h.wasOnline) {
+      progress += "✅ " + name + ": online after " + sequenceSeconds(h.doneMs - h.wokeMs) + " sec\n";
+    } else if (h.state == SEQ_FAILED) {
+      progress += "❌ " + name + ": did not come up\n";
+    }
+  }
+  
+  if (running) {
+    if (progress != "") sendTelegram(sequenceChatID, progress);
+    return;
+  }
+  
+  String report = sequenceReport();
+  sendTelegram(sequenceChatID, report);
+  int online = 0;
+  for (int i = 0; i < sequencer.hostCount(); i++) online += sequencer.host(i).state == SEQ_ONLINE;
+  LOG_INFO("🧩 Sequence %s: %d/%d online in %lu ms", sequencePlans[sequenceRunning].name, online,
+           sequencer.hostCount(), (unsigned long)(sequencer.finishMs() - sequencer.startMs()));
+  sequenceRunning = -1;
+}
+
+// ========== SCHEDULED WAKES ==========
+// The plan (next fire time over all schedules) is computed only when a
+// schedule changes, one fires or SNTP sets the clock. Between events the
+// loop costs a single time comparison.
+bool clockSynced() {
+  return time(NULL) > 1700000000; // SNTP has set the clock
+}
+
+// "dd.mm HH:MM", for log lines that must not allocate
+void formatTime(time_t t, char* out, size_t cap) {
+  struct tm tm;
+  localtime_r(&t, &tm);
+  strftime(out, cap, "%d.%m %H:%M", &tm);
+}
+
+String formatTime(time_t t) {
+  char text[24];
+  formatTime(t, text, sizeof(text));
+  return String(text);
+}
+
+unsigned long scheduleLeadSeconds() {
+  return bootEstimateMs / 1000 + SCHEDULE_MARGIN;
+}
+
+void onTimeSync(struct timeval* tv) {
+  schedulePlanDirty = true;
+}
+
+void loadSchedules() {
+  scheduleCount = 0;
+  size_t size = prefs.getBytes("schedules", schedules, sizeof(schedules));
+  for (int i = 0; i < (int)(size / sizeof(WakeSchedule)); i++) {
+    schedules[i].cron[sizeof(schedules[i].cron) - 1] = '\0';
+    schedules[i].chatId[sizeof(schedules[i].chatId) - 1] = '\0';
+    if (parseCron(schedules[i].cron, scheduleSpecs[scheduleCount])) {
+      schedules[scheduleCount++] = schedules[i];
+    }
+  }
+  bootEstimateMs = prefs.getULong("bootMs", DEFAULT_BOOT_TIME * 1000UL);
+  schedulePlanDirty = true;
+}
+
+void saveSchedules() {
+  prefs.putBytes("schedules", schedules, scheduleCount * sizeof(WakeSchedule));
+  schedulePlanDirty = true;
+}
+
+void planSchedules() {
+  schedulePlanDirty = false;
+  nextScheduleFire = 0;
+  nextScheduleIndex = -1;
+  if (!clockSynced()) return;
+  
+  // The first ready-by time that can still be reached from now
+  time_t lead = scheduleLeadSeconds();
+  time_t now = time(NULL);
+  for (int i = 0; i < scheduleCount; i++) {
+    time_t readyBy = cronNextAfter(scheduleSpecs[i], now + lead);
+    if (readyBy && (nextScheduleIndex < 0 || readyBy - lead < nextScheduleFire)) {
+      nextScheduleFire = readyBy - lead;
+      nextScheduleReady = readyBy;
+      nextScheduleIndex = i;
+    }
+  }
+  
+  if (nextScheduleIndex >= 0) {
+    char fireAt[24];
+    formatTime(nextScheduleFire, fireAt, sizeof(fireAt));
+    LOG_INFO("📅 Next scheduled WoL: %s, %lu s before ready-by", logCopy(fireAt),
+             (unsigned long)(nextScheduleReady - nextScheduleFire));
+  }
+}
+
+void checkSchedules() {
+  if (schedulePlanDirty) planSchedules();
+  if (nextScheduleIndex < 0 || time(NULL) < nextScheduleFire) return;
+  
+  const WakeSchedule& schedule = schedules[nextScheduleIndex];
+  time_t readyBy = nextScheduleReady;
+  schedulePlanDirty = true;
+  
+  // A manual wake already running takes over the target
+  if (isMonitoring) {
+    scheduledReadyBy = readyBy;
+    return;
+  }
+  
+  wakeCommandTime = millis();
+  lastProgressUpdate = 0;
+  if (sendWOL()) {
+    isMonitoring = true;
+    bootTimelineStart();
+    monitoringChatID = schedule.chatId;
+    scheduledReadyBy = readyBy;
+    
+    String msg = "📅 Scheduled wake (" + String(schedule.cron) + ")\n\n";
+    msg += "• Ready by: " + formatTime(readyBy) + "\n";
+    msg += "• WoL sent " + String(scheduleLeadSeconds()) + " sec early (boot ";
+    msg += String(bootEstimateMs / 1000) + " + margin " + String(SCHEDULE_MARGIN) + ")";
+    sendTelegram(monitoringChatID, msg);
+  } else {
+    sendTelegram(schedule.chatId, "❌ Scheduled wake: WoL send error");
+  }
+}
+
+// Updates the boot estimate: slower boots count in full, faster ones are averaged in
+void recordBootTime(unsigned long wolToBootMs) {
+  if (wolToBootMs > bootEstimateMs) {
+    bootEstimateMs = wolToBootMs;
+  } else {
+    bootEstimateMs = (bootEstimateMs * 3 + wolToBootMs) / 4;
+  }
+  prefs.putULong("bootMs", bootEstimateMs);
+  schedulePlanDirty = true;
+}
+
+// Target line for the boot report of a scheduled wake, empty for manual ones
+String scheduleTargetReport(bool booted) {
+  if (!scheduledReadyBy) return "";
+  
+  long slack = (long)(scheduledReadyBy - time(NULL));
+  String report = "\n\n";
+  if (booted && slack >= 0) {
+    report += "🎯 Target hit: ready " + String(slack) + " sec before " + formatTime(scheduledReadyBy);
+  } else if (booted) {
+    report += "⚠️ Target missed: ready " + String(-slack) + " sec after " + formatTime(scheduledReadyBy);
+  } else {
+    report += "⚠️ Target missed: not ready by " + formatTime(scheduledReadyBy);
+  }
+  scheduledReadyBy = 0;
+  return report;
+}
+
+// ========== BOOT TIMELINE ==========
+// Every loop pass picks up the cheap stages: ARP is read from the lwIP table,
+// ICMP runs as a background esp_ping session that timestamps the first reply.
+// SSH and the service are probed each monitoring tick, once ARP is seen.
+struct ArpLookup {
+  struct tcpip_api_call_data call;
+  ip4_addr_t ip;
+  bool flush;
+  bool found;
+};
+
+// Runs in the lwIP thread: look the host up and ask again if it is missing
+err_t arpLookupTcpip(struct tcpip_api_call_data* call) {
+  ArpLookup* lookup = (ArpLookup*)call;
+  if (!netif_default) return ERR_OK;
+  if (lookup->flush) etharp_cleanup_netif(netif_default);
+  
+  struct eth_addr* mac;
+  const ip4_addr_t* ip;
+  lookup->found = etharp_find_addr(netif_default, &lookup->ip, &mac, &ip) >= 0;
+  if (!lookup->found) etharp_request(netif_default, &lookup->ip);
+  return ERR_OK;
+}
+
+bool arpLookup(IPAddress ip, bool flush) {
+  ArpLookup lookup = {};
+  IP4_ADDR(&lookup.ip, ip[0], ip[1], ip[2], ip[3]);
+  lookup.flush = flush;
+  tcpip_api_call(arpLookupTcpip, &lookup.call);
+  return lookup.found;
+}
+
+void onBootPingReply(esp_ping_handle_t session, void* args) {
+  if (!icmpReplyAt) icmpReplyAt = millis();
+}
+
+void bootPingStop() {
+  if (!bootPing) return;
+  esp_ping_stop(bootPing);
+  esp_ping_delete_session(bootPing);
+  bootPing = NULL;
+}
+
+void bootTimelineStart() {
+  for (int i = 0; i < STAGE_COUNT; i++) bootStageAt[i] = 0;
+  icmpReplyAt = 0;
+  bootProbeAt = 0;
+  
+  // A stale ARP entry from before the shutdown would fake the first stage
+  arpLookup(serverIP, true);
+  
+  bootPingStop();
+  esp_ping_config_t config = ESP_PING_DEFAULT_CONFIG();
+  IP_ADDR4(&config.target_addr, serverIP[0], serverIP[1], serverIP[2], serverIP[3]);
+  config.count = ESP_PING_COUNT_INFINITE;
+  config.interval_ms = 1000;
+  config.timeout_ms = 1000;
+  esp_ping_callbacks_t callbacks = {};
+  callbacks.on_ping_success = onBootPingReply;
+  if (esp_ping_new_session(&config, &callbacks, &bootPing) == ESP_OK) {
+    esp_ping_start(bootPing);
+  } else {
+    bootPing = NULL;
+  }
+}
+
+bool healthCheck() {
+  if (HEALTH_HTTP_PATH[0]) {
+    HTTPClient http;
+    http.begin("http://" + serverIP.toString() + ":" + String(HEALTH_PORT) + HEALTH_HTTP_PATH);
+    http.setTimeout(2000);
+    int httpCode = http.GET();
+    http.end();
+    return HEALTH_HTTP_STATUS ? httpCode == HEALTH_HTTP_STATUS : httpCode > 0;
+  }
+  
+  WiFiClient client;
+  if (!client.connect(serverIP, HEALTH_PORT, WATCH_PROBE_TIMEOUT)) return false;
+  client.setTimeout(1000);
+  String banner = client.readStringUntil('\n');
   client.stop();
+  return banner.startsWith(HEALTH_BANNER);
+}
+
+void markStage(int stage, unsigned long at) {
+  if (bootStageAt[stage]) return;
+  bootStageAt[stage] = at;
+  LOG_INFO("🔎 Stage %s after %lu ms", bootStageNames[stage], at - wolSentTime);
+}
+
+void checkEarlyStages() {
+  if (!bootStageAt[STAGE_ARP] && arpLookup(serverIP, false)) markStage(STAGE_ARP, millis());
+  if (icmpReplyAt) {
+    markStage(STAGE_ICMP, icmpReplyAt);
+    bootPingStop();
+  }
+}
+
+// Returns true once the service stage is reached
+bool checkBootStages() {
+  TRACE_SPAN("boot.stages");
+  if (!bootStageAt[STAGE_ARP]) return false;
+  
+  // SSH comes from the shared liveness probe, which tries BOOT_SSH_PORT
+  // first. Its result arrives on a later pass, checkServerMonitoring()
+  // keeps calling until then.
+  if (!bootProbeAt) bootProbeAt = millis();
+  const LivenessEntry* result = livenessSince(serverIP, bootProbeAt);
+  if (!result) {
+    livenessRequest(serverIP, BOOT_SSH_PORT);
+    return false;
+  }
+  bootProbeAt = 0;
+  if (!result->online) return false;
+  if (result->port == BOOT_SSH_PORT) markStage(STAGE_SSH, result->checkedAt);
   
-  if (port80Open) {
-    Serial.println("✅ Port 80 (HTTP) open - server is alive");
-    return true;
+  // The service stage needs the application itself, not just an open port
+  if (healthCheck()) {
+    markStage(STAGE_SERVICE, millis());
+    livenessRecord(serverIP, true, HEALTH_PORT);
+  }
+  return bootStageAt[STAGE_SERVICE] != 0;
+}
+
+void loadBootHistory() {
+  bootHistoryCount = prefs.getBytes("boots", bootHistory, sizeof(bootHistory)) / sizeof(BootRecord);
+}
+
+// Saves the finished timeline, newest first
+void recordBootTimeline() {
+  bootPingStop();
+  for (int i = BOOT_HISTORY - 1; i > 0; i--) bootHistory[i] = bootHistory[i - 1];
+  bootHistory[0].wolAt = clockSynced() ? time(NULL) - (millis() - wolSentTime) / 1000 : 0;
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    bootHistory[0].stageMs[i] = bootStageAt[i] ? bootStageAt[i] - wolSentTime : 0;
+  }
+  if (bootHistoryCount < BOOT_HISTORY) bootHistoryCount++;
+  prefs.putBytes("boots", bootHistory, bootHistoryCount * sizeof(BootRecord));
+}
+
+String bootSeconds(uint32_t ms) {
+  return String(ms / 1000.0, 1);
+}
+
+// Phase of a stage: from the previous stage that appeared (or the WoL) to this one
+uint32_t bootPhaseMs(const BootRecord& record, int stage) {
+  uint32_t previous = 0;
+  for (int i = 0; i < stage; i++) {
+    if (record.stageMs[i]) previous = record.stageMs[i];
   }
+  return record.stageMs[stage] ? record.stageMs[stage] - previous : 0;
+}
+
+// Phase breakdown of the newest timeline against the average of the older ones
+String bootTimelineReport() {
+  const BootRecord& latest = bootHistory[0];
+  String report = "🧭 Boot phases:\n";
+  const char* const phaseNames[STAGE_COUNT] = {"WoL→ARP (POST, NIC)", "ARP→ICMP (kernel)", "ICMP→SSH (services)", "SSH→Service (app)"};
   
-  Serial.println("❌ Server not responding on any port");
-  return false;
+  for (int stage = 0; stage < STAGE_COUNT; stage++) {
+    report += "• " + String(phaseNames[stage]) + ": ";
+    if (!latest.stageMs[stage]) {
+      report += "not seen\n";
+      continue;
+    }
+    report += bootSeconds(bootPhaseMs(latest, stage)) + " s";
+    
+    uint32_t sum = 0;
+    int count = 0;
+    for (int i = 1; i < bootHistoryCount; i++) {
+      if (!bootHistory[i].stageMs[stage]) continue;
+      sum += bootPhaseMs(bootHistory[i], stage);
+      count++;
+    }
+    if (count > 0) report += " (avg " + bootSeconds(sum / count) + ")";
+    report += "\n";
+  }
+  return report;
 }
 
 // ========== BOOT MONITORING ==========
@@ -154,27 +1348,22 @@ void checkServerMonitoring() {
     
     // Progress bar
     int progressPercent = std::min(100, static_cast<int>((elapsedSeconds * 100) / MAX_WAIT_TIME));
-    progressMsg += "[";
-    for (int i = 0; i < 10; i++) {
-      progressMsg += (i < progressPercent / 10) ? "█" : "░";
-    }
-    progressMsg += "] " + String(progressPercent) + "%";
+    char bar[48];
+    renderProgress(progressPercent, bar, sizeof(bar));
+    progressMsg += bar;
     
-    sendTelegram(monitoringChatID, progressMsg);
-    Serial.print("📊 Progress: ");
-    Serial.print(elapsedSeconds);
-    Serial.print(" sec (");
-    Serial.print(progressPercent);
-    Serial.println("%)");
+    sendMonitoring(progressMsg);
+    LOG_INFO("📊 Progress: %lu sec (%d%%)", elapsedSeconds, progressPercent);
   }
   
-  // Check server every CHECK_INTERVAL seconds
-  if (elapsedSeconds % CHECK_INTERVAL == 0) {
-    Serial.print("🔍 Checking server... ");
-    Serial.print(elapsedSeconds);
-    Serial.println(" sec");
+  // ARP and ICMP cost nothing, a tick that skips them would blur the timeline
+  checkEarlyStages();
+  
+  // Check server every CHECK_INTERVAL seconds, and on every pass until its probe is done
+  if (elapsedSeconds % CHECK_INTERVAL == 0 || bootProbeAt) {
+    if (!bootProbeAt) LOG_DEBUG("🔍 Checking server... %lu sec", elapsedSeconds);
     
-    if (isServerOnline()) {
+    if (checkBootStages()) {
       // Server has booted!
       unsigned long totalBootTime = (currentTime - wakeCommandTime) / 1000;
       unsigned long wolToBootTime = (currentTime - wolSentTime) / 1000;
@@ -184,7 +1373,7 @@ void checkServerMonitoring() {
       successMsg += "• Total time: " + String(totalBootTime) + " sec\n";
       successMsg += "• WoL→Boot: " + String(wolToBootTime) + " sec\n";
       successMsg += "• IP: " + serverIP.toString() + "\n";
-      successMsg += "• MAC: " + serverMAC + "\n\n";
+      successMsg += "• MAC: " + String(serverMAC) + "\n\n";
       
       if (wolToBootTime < 30) {
         successMsg += "⚡ Fast boot!";
@@ -194,12 +1383,15 @@ void checkServerMonitoring() {
         successMsg += "⚠️ Slow boot, check the server";
       }
       
-      sendTelegram(monitoringChatID, successMsg);
+      recordBootTimeline();
+      successMsg += "\n\n" + bootTimelineReport();
+      successMsg += scheduleTargetReport(true);
+      sendMonitoring(successMsg);
       isMonitoring = false;
+      watchMarkUp(serverIP);
+      recordBootTime(currentTime - wolSentTime);
       
-      Serial.print("✅ Server booted in ");
-      Serial.print(totalBootTime);
-      Serial.println(" seconds");
+      LOG_INFO("✅ Server booted in %lu seconds", totalBootTime);
     }
     else if (elapsedSeconds >= MAX_WAIT_TIME) {
       // Timeout
@@ -213,96 +1405,416 @@ void checkServerMonitoring() {
       timeoutMsg += "4. Long POST check\n\n";
       timeoutMsg += "Try /wake command again";
       
-      sendTelegram(monitoringChatID, timeoutMsg);
+      recordBootTimeline();
+      timeoutMsg += "\n\n" + bootTimelineReport();
+      timeoutMsg += scheduleTargetReport(false);
+      sendMonitoring(timeoutMsg);
       isMonitoring = false;
       
-      Serial.println("❌ Monitoring: timeout");
+      LOG_WARN("❌ Monitoring: timeout");
+    }
+  }
+}
+
+// ========== SLEEP PROXY ==========
+// Every frame from the Wi-Fi driver passes sleepProxyInput() before lwIP.
+// That runs in the driver's task, so it never waits: the proxy sits behind a
+// mutex taken without blocking, ARP replies are queued for the lwIP thread to
+// send, and wakes and handovers are only flagged for the loop.
+const int PROXY_PORT_COUNT = sizeof(proxyPorts) / sizeof(proxyPorts[0]);
+struct netif* proxyNetif = NULL;           // Set once the proxy is installed
+netif_input_fn proxyStackInput = NULL;     // lwIP's own input for frames the proxy leaves alone
+SemaphoreHandle_t proxyLock = NULL;
+const size_t PROXY_INSPECT_SIZE = 128;     // Frame bytes the proxy reads: Ethernet, IPv4 with options, TCP ports and flags
+QueueHandle_t proxyTxQueue = NULL;         // ARP frames from the proxy, sent by proxyFlush()
+TaskHandle_t loopTask = NULL;
+volatile bool proxyWakePending = false;
+volatile bool proxyHandoverPending = false;
+unsigned long proxyWakeMicros = 0;         // micros() of the SYN that asked for the wake
+uint32_t proxyWakeClient = 0;
+uint16_t proxyWakePort = 0;
+SleepProxy::Event proxyEvent;              // Last finished proxy session
+unsigned long proxySynToWol = 0;           // µs, last proxy wake
+int proxyConfirmLeft = 0;                  // ARP requests still to go before start(), 0 = not confirming
+unsigned long proxyConfirmAt = 0;          // millis() of the last one
+
+struct ProxyFrame {
+  uint8_t data[PROXY_ARP_FRAME_SIZE];
+};
+
+// Runs in the lwIP thread
+void proxyFlush(void* ctx) {
+  ProxyFrame frame;
+  while (xQueueReceive(proxyTxQueue, &frame, 0) == pdTRUE) {
+    struct pbuf* p = pbuf_alloc(PBUF_RAW, sizeof(frame.data), PBUF_RAM);
+    if (!p) continue;
+    pbuf_take(p, frame.data, sizeof(frame.data));
+    proxyNetif->linkoutput(proxyNetif, p);
+    pbuf_free(p);
+  }
+}
+
+// The proxy only ever sends ARP frames. A full queue drops the frame, the
+// client asks again.
+void proxyTransmit(const uint8_t* frame, size_t len, void* ctx) {
+  ProxyFrame queued;
+  if (len != sizeof(queued.data)) return;
+  memcpy(queued.data, frame, len);
+  if (xQueueSend(proxyTxQueue, &queued, 0) == pdTRUE) tcpip_try_callback(proxyFlush, NULL);
+}
+
+void proxyWake(uint8_t host, uint32_t client, uint16_t port, void* ctx) {
+  proxyWakeMicros = micros();
+  proxyWakeClient = client;
+  proxyWakePort = port;
+  proxyWakePending = true;
+  xTaskNotifyGive(loopTask);
+}
+
+void proxyHandover(uint8_t host, const SleepProxy::Event& event, void* ctx) {
+  proxyEvent = event;
+  proxyHandoverPending = true;
+}
+
+const SleepProxy::Hooks proxyHooks = {proxyTransmit, proxyWake, proxyHandover, NULL};
+
+// Created on the first use, after the Wi-Fi interface exists
+SleepProxy& sleepProxy() {
+  static SleepProxy proxy(proxyNetif->hwaddr, proxyHooks, PROXY_WAKE_RETRY * 1000UL);
+  return proxy;
+}
+
+// A frame that arrives while the loop holds the proxy goes to lwIP unseen:
+// ARP requests are repeated and SYNs retransmitted, the next one is caught
+err_t sleepProxyInput(struct pbuf* p, struct netif* inp) {
+  if (xSemaphoreTake(proxyLock, 0) != pdTRUE) return proxyStackInput(p, inp);
+  uint8_t frame[PROXY_INSPECT_SIZE];
+  size_t len = pbuf_copy_partial(p, frame, sizeof(frame), 0);
+  bool taken = sleepProxy().input(frame, len, millis());
+  xSemaphoreGive(proxyLock);
+  if (!taken) return proxyStackInput(p, inp);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+// Runs in the lwIP thread: put the proxy in front of the interface input
+err_t sleepProxyInstall(struct tcpip_api_call_data* call) {
+  if (!netif_default) return ERR_IF;
+  proxyNetif = netif_default;
+  uint8_t mac[WOL_MAC_SIZE];
+  parseMac(serverMAC, mac);
+  sleepProxy().addHost(relayIp(serverIP), mac, proxyPorts, PROXY_PORT_COUNT);
+  proxyStackInput = proxyNetif->input;
+  proxyNetif->input = sleepProxyInput;
+  return ERR_OK;
+}
+
+void setupSleepProxy() {
+  static struct tcpip_api_call_data call;
+  proxyLock = xSemaphoreCreateMutex();
+  proxyTxQueue = xQueueCreate(4, sizeof(ProxyFrame));
+  loopTask = xTaskGetCurrentTaskHandle();
+  if (tcpip_api_call(sleepProxyInstall, &call) != ERR_OK) {
+    Serial.println("❌ Sleep proxy: no network interface");
+    return;
+  }
+  Serial.print("💤 Sleep proxy: ");
+  Serial.print(PROXY_PORT_COUNT);
+  Serial.println(" port(s), starts when the server is confirmed down");
+}
+
+// A dead TCP port doesn't mean the server gave up its address, and answering
+// ARP for a host that is still there would steal its traffic. Going active
+// only flushes the ARP entry and asks again; serviceSleepProxy() starts the
+// proxy once PROXY_ARP_CONFIRM requests went unanswered.
+void sleepProxySet(bool active) {
+  if (!proxyNetif) return;
+  xSemaphoreTake(proxyLock, portMAX_DELAY);
+  ProxyState state = sleepProxy().state(0);
+  if (!active) sleepProxy().release(0, millis());
+  xSemaphoreGive(proxyLock);
+  
+  if (!active) {
+    proxyConfirmLeft = 0;
+  } else if (state == PROXY_OFF && proxyConfirmLeft == 0) {
+    arpLookup(serverIP, true);
+    proxyConfirmLeft = PROXY_ARP_CONFIRM;
+    proxyConfirmAt = millis();
+  }
+}
+
+// One ARP check per call, at least a second after the previous request
+void sleepProxyConfirm() {
+  if (proxyConfirmLeft == 0 || millis() - proxyConfirmAt < 1000) return;
+  proxyConfirmAt = millis();
+  
+  if (arpLookup(serverIP, false)) {
+    proxyConfirmLeft = 0;
+    LOG_WARN("💤 Sleep proxy: %u.%u.%u.%u still answers ARP, not starting", serverIP[0], serverIP[1], serverIP[2], serverIP[3]);
+    return;
+  }
+  if (--proxyConfirmLeft > 0) return;
+  
+  xSemaphoreTake(proxyLock, portMAX_DELAY);
+  sleepProxy().start(0, millis());
+  xSemaphoreGive(proxyLock);
+  LOG_INFO("💤 Sleep proxy: answering for %u.%u.%u.%u", serverIP[0], serverIP[1], serverIP[2], serverIP[3]);
+}
+
+// Wakes the server for a SYN the proxy caught and reports every handover
+void serviceSleepProxy() {
+  if (!proxyNetif) return;
+  sleepProxyConfirm();
+  
+  if (proxyWakePending) {
+    xSemaphoreTake(proxyLock, portMAX_DELAY);
+    proxyWakePending = false;
+    unsigned long synMicros = proxyWakeMicros;
+    IPAddress client = relayIp(proxyWakeClient);
+    uint16_t port = proxyWakePort;
+    xSemaphoreGive(proxyLock);
+    
+    // A wake already in progress has sent its WoL
+    if (!isMonitoring) {
+      wakeCommandTime = millis();
+      lastProgressUpdate = 0;
+      commandMicros = synMicros;
+      if (sendWOL()) {
+        proxySynToWol = wolBurst.commandToWolMicros;
+        isMonitoring = true;
+        monitoringChatID = "";
+        bootTimelineStart();
+        
+        String msg = "💤 Sleep proxy: connection from " + client.toString() + " to port " + String(port) + "\n";
+        msg += "⚡ WoL sent " + String(proxySynToWol / 1000.0, 2) + " ms after the SYN, monitoring the boot";
+        notifyAll(msg);
+      }
+    }
+  }
+  
+  if (proxyHandoverPending) {
+    xSemaphoreTake(proxyLock, portMAX_DELAY);
+    proxyHandoverPending = false;
+    SleepProxy::Event event = proxyEvent;
+    xSemaphoreGive(proxyLock);
+    
+    LOG_INFO("🔁 Sleep proxy: handover after %lu ms (%u wakes)", (unsigned long)(event.handoverMs - event.startMs), event.wakes);
+    if (event.wakes) {
+      String msg = "🔁 Sleep proxy handed the server its address back\n\n";
+      msg += "• SYN→WoL: " + String(proxySynToWol / 1000.0, 2) + " ms\n";
+      msg += "• SYN→handover: " + String((event.handoverMs - event.synMs) / 1000.0, 1) + " sec";
+      msg += event.released ? " (by probe)\n" : " (server ARP)\n";
+      msg += "• Proxied for: " + String((event.handoverMs - event.startMs) / 60000) + " min";
+      notifyAll(msg);
     }
   }
 }
 
 // ========== TELEGRAM FUNCTIONS ==========
-String getTelegramUpdate() {
+// Polls up to `limit` updates into updateBatch and confirms them all with the
+// next offset; returns how many arrived
+int getTelegramUpdates(int limit = TELEGRAM_BATCH) {
+  TRACE_SPAN("telegram.poll");
   HTTPClient http;
   
-  String url = "https://api.telegram.org/bot" + botToken + "/getUpdates?timeout=1&limit=1";
+  // The offset confirms everything up to the last update, no separate acknowledgement request
+  String url = "https://api.telegram.org/bot" + botToken + "/getUpdates?timeout=1&limit=" + String(limit) + "&offset=" + String(lastUpdateId + 1);
   
   http.begin(url);
   http.setTimeout(3000);
   
+  if (http.GET() != 200) {
+    http.end();
+    return 0;
+  }
+  
+  String response = http.getString();
+  updateReceivedMicros = micros();
+  http.end();
+  
+  int count;
+  {
+    TRACE_SPAN("telegram.parse");
+    count = parseTelegramUpdates(response.c_str(), response.length(), updateBatch, limit);
+  }
+  if (count == 0) return 0;
+  
+  // A batch too big to parse whole is fetched again one update at a time;
+  // a single update that still doesn't fit is skipped, never retried forever
+  if (!updateBatch[0].complete && count > 1) return getTelegramUpdates(1);
+  lastUpdateId = updateBatch[count - 1].updateId;
+  if (!updateBatch[0].complete) LOG_WARN("📨 Update %d too large, skipped", updateBatch[0].updateId);
+  
+  for (int i = 0; i < count; i++) {
+    if (updateBatch[i].hasMessage) LOG_INFO("📨 Command: %s", logCopy(updateBatch[i].text));
+  }
+  return count;
+}
+
+// Skips everything already waiting; the next poll confirms the last update too
+void clearUpdateHistory() {
+  HTTPClient http;
+  http.begin("https://api.telegram.org/bot" + botToken + "/getUpdates?offset=-1");
   if (http.GET() == 200) {
     String response = http.getString();
-    
-    DynamicJsonDocument doc(2048);
-    DeserializationError error = deserializeJson(doc, response);
-    
-    if (!error) {
-      if (doc.containsKey("result") && doc["result"].size() > 0) {
-        JsonObject result = doc["result"][0];
-        int update_id = result["update_id"].as<int>();
-        
-        lastUpdateId = update_id;
-        
-        if (result.containsKey("message")) {
-          String chatID = result["message"]["chat"]["id"].as<String>();
-          String text = result["message"]["text"].as<String>();
-          
-          Serial.print("📨 Command: ");
-          Serial.println(text);
-          
-          // Delete message from history
-          String deleteUrl = "https://api.telegram.org/bot" + botToken + 
-                           "/getUpdates?offset=" + String(update_id + 1);
-          HTTPClient http2;
-          http2.begin(deleteUrl);
-          http2.GET();
-          http2.end();
-          
-          http.end();
-          return chatID + "|" + text;
-        }
-      }
+    TelegramUpdate update;
+    if (parseTelegramUpdate(response.c_str(), response.length(), update)) {
+      lastUpdateId = update.updateId;
     }
   }
-  
   http.end();
-  return "";
 }
 
 void sendTelegram(String chatID, String message) {
   if (WiFi.status() != WL_CONNECTED) return;
+  TRACE_SPAN("telegram.send");
   
-  message.replace(" ", "%20");
-  message.replace("\n", "%0A");
+  size_t len = buildSendMessageUrl(botToken.c_str(), chatID.c_str(), message.c_str(), NULL, 0);
+  char* url = (char*)malloc(len + 1);
+  if (!url) return;
+  buildSendMessageUrl(botToken.c_str(), chatID.c_str(), message.c_str(), url, len + 1);
   
   HTTPClient http;
-  String url = "https://api.telegram.org/bot" + botToken + 
-               "/sendMessage?chat_id=" + chatID + "&text=" + message;
-  
   http.begin(url);
+  free(url);
   http.setTimeout(5000);
   http.GET();
   http.end();
 }
 
+struct DocumentStream {
+  WiFiClientSecure* client;   // NULL = only count
+  size_t length;
+  size_t buffered;
+  char buffer[512];           // Small writes go out as one TLS record
+};
+
+void documentFlush(DocumentStream& stream) {
+  if (stream.client && stream.buffered) stream.client->write((const uint8_t*)stream.buffer, stream.buffered);
+  stream.buffered = 0;
+}
+
+void documentWrite(const char* text, size_t len, void* ctx) {
+  DocumentStream& stream = *(DocumentStream*)ctx;
+  stream.length += len;
+  if (!stream.client) return;
+  while (len > 0) {
+    size_t chunk = std::min(len, sizeof(stream.buffer) - stream.buffered);
+    memcpy(stream.buffer + stream.buffered, text, chunk);
+    stream.buffered += chunk;
+    text += chunk;
+    len -= chunk;
+    if (stream.buffered == sizeof(stream.buffer)) documentFlush(stream);
+  }
+}
+
+// Uploads a text file (multipart/form-data sendDocument) that `content`
+// writes out. It runs twice, once to measure the Content-Length and once
+// straight into the socket, so the file is never held in RAM and must come
+// out the same both times.
+bool sendTelegramDocument(String chatID, const char* filename,
+                          size_t (*content)(void (*write)(const char* text, size_t len, void* ctx), void* ctx)) {
+  if (WiFi.status() != WL_CONNECTED) return false;
+  TRACE_SPAN("telegram.document");
+  
+  String boundary = "wolbot" + String(micros());
+  String head = "--" + boundary + "\r\nContent-Disposition: form-data; name=\"chat_id\"\r\n\r\n" + chatID + "\r\n";
+  head += "--" + boundary + "\r\nContent-Disposition: form-data; name=\"document\"; filename=\"" + filename + "\"\r\n";
+  head += "Content-Type: application/json\r\n\r\n";
+  String tail = "\r\n--" + boundary + "--\r\n";
+  
+  DocumentStream stream = {};
+  content(documentWrite, &stream);
+  size_t length = head.length() + stream.length + tail.length();
+  
+  WiFiClientSecure client;
+  client.setInsecure();
+  if (!client.connect("api.telegram.org", 443)) return false;
+  client.print("POST /bot" + botToken + "/sendDocument HTTP/1.1\r\nHost: api.telegram.org\r\n");
+  client.print("Content-Type: multipart/form-data; boundary=" + boundary + "\r\n");
+  client.print("Content-Length: " + String(length) + "\r\nConnection: close\r\n\r\n");
+  client.print(head);
+  
+  stream = DocumentStream();
+  stream.client = &client;
+  content(documentWrite, &stream);
+  documentFlush(stream);
+  client.print(tail);
+  
+  // Status line, e.g. "HTTP/1.1 200 OK"
+  unsigned long start = millis();
+  while (client.connected() && !client.available() && millis() - start < 10000) delay(10);
+  String status = client.readStringUntil('\n');
+  client.stop();
+  return status.startsWith("HTTP/1.1 200");
+}
+
+// ========== TRACE ==========
+void traceToSerial(const char* text, size_t len, void* ctx) {
+  Serial.write((const uint8_t*)text, len);
+}
+
+// Per span name: count, total and longest time
+String traceSummary() {
+  const int MAX_NAMES = 16;
+  const char* names[MAX_NAMES];
+  uint32_t counts[MAX_NAMES] = {};
+  uint64_t totals[MAX_NAMES] = {};
+  uint32_t longest[MAX_NAMES] = {};
+  int nameCount = 0;
+  
+  for (size_t i = 0; i < traceCount(); i++) {
+    const TraceEvent& event = traceEvent(i);
+    if (event.duration == TRACE_INSTANT) continue;
+    int n = 0;
+    while (n < nameCount && names[n] != event.name) n++;
+    if (n == nameCount) {
+      if (nameCount == MAX_NAMES) continue;
+      names[nameCount++] = event.name;
+    }
+    counts[n]++;
+    totals[n] += event.duration;
+    if (event.duration > longest[n]) longest[n] = event.duration;
+  }
+  
+  String summary = "🧵 Trace: " + String(traceCount()) + " records";
+  if (traceOverwritten()) summary += " (" + String(traceOverwritten()) + " overwritten" + ")";
+  summary += traceOn ? ", recording\n\n" : ", paused\n\n";
+  for (int n = 0; n < nameCount; n++) {
+    summary += "• " + String(names[n]) + ": " + String(counts[n]) + "x, total " + String((uint32_t)(totals[n] / 1000));
+    summary += " ms, max " + String(longest[n] / 1000) + " ms\n";
+  }
+  return summary;
+}
+
 // ========== COMMAND PROCESSING ==========
+// WoL commands of a batch run first: every other command blocks on its HTTPS reply
+bool isWolCommand(const char* text) {
+  return !strcmp(text, "/wake") || !strcmp(text, "/wakeonly");
+}
+
 void processCommand(String chatID, String text) {
+  TRACE_SPAN("command");
   // Check whitelist
-  bool allowed = false;
-  for (int i = 0; i < sizeof(allowedUsers)/sizeof(allowedUsers[0]); i++) {
-    if (allowedUsers[i] == chatID) {
-      allowed = true;
-      break;
+  bool allowed = isAllowedChat(chatID.c_str(), allowedUsers, sizeof(allowedUsers)/sizeof(allowedUsers[0]));
+  
+  // Rejections cost no network I/O, apart from one optional notice per window
+  if (!allowed) {
+    rejectedUnauthorized++;
+    if (ANSWER_UNAUTHORIZED && chatLimiter.noticeUnauthorized(millis())) {
+      sendTelegram(chatID, "⛔ Access denied");
     }
+    return;
   }
   
-  if (!allowed) {
-    sendTelegram(chatID, "⛔ Access denied");
+  if (!chatLimiter.take(chatID.c_str(), millis())) {
+    if (chatLimiter.notice(chatID.c_str(), millis())) {
+      sendTelegram(chatID, "🐌 Too many commands, the rest are dropped for a while");
+    }
     return;
   }
   
-  Serial.print("Processing: ");
-  Serial.println(text);
+  LOG_DEBUG("Processing: %s", logCopy(text.c_str()));
   
   if (text == "/start" || text == "/help") {
     String msg = "🤖 WoL Bot with detailed monitoring\n\n";
@@ -311,7 +1823,15 @@ void processCommand(String chatID, String text) {
     msg += "/wakeonly - WoL only (no monitoring)\n";
     msg += "/status - system status\n";
     msg += "/check - check server now\n";
+    msg += "/check force - check ignoring cached result\n";
+    msg += "/watch - uptime watch state and cost\n";
+    msg += "/schedule - scheduled wakes (ready-by times)\n";
+    msg += "/sequence - dependency-ordered wake plans\n";
+    msg += "/wakeall - wake every relay target\n";
+    msg += "/checkall - check every relay target\n";
     msg += "/timing - timing statistics\n";
+    msg += "/boots - boot phase history\n";
+    msg += "/trace - span trace (Chrome JSON), on/off/clear/dump\n";
     msg += "/ping - connection test\n";
     msg += "/clear - clear history\n\n";
     msg += "⚙️ Monitoring settings:\n";
@@ -321,17 +1841,18 @@ void processCommand(String chatID, String text) {
     sendTelegram(chatID, msg);
   }
   else if (text == "/wake") {
+    // WoL goes out before any Telegram I/O, the acknowledgement follows
     wakeCommandTime = millis(); // Record command time
     lastProgressUpdate = 0;
-    
-    sendTelegram(chatID, "🔌 Command received, sending WoL...");
+    commandMicros = updateReceivedMicros;
     
     if (sendWOL()) {
       // Start monitoring
       isMonitoring = true;
+      bootTimelineStart();
       monitoringChatID = chatID;
       
-      String msg = "✅ WoL sent!\n\n";
+      String msg = "✅ WoL sent " + String(wolBurst.commandToWolMicros / 1000.0, 2) + " ms after the command arrived!\n\n";
       msg += "📊 Starting boot monitoring:\n";
       msg += "• Expected time: 20-50 seconds\n";
       msg += "• Maximum: " + String(MAX_WAIT_TIME) + " seconds\n";
@@ -340,16 +1861,16 @@ void processCommand(String chatID, String text) {
       msg += "I'll notify you when server boots with timing statistics!";
       sendTelegram(chatID, msg);
       
-      Serial.println("🔍 Monitoring started");
+      LOG_INFO("🔍 Monitoring started");
     } else {
       sendTelegram(chatID, "❌ WoL send error");
     }
   }
   else if (text == "/wakeonly") {
-    sendTelegram(chatID, "🔌 Sending WoL without monitoring...");
+    commandMicros = updateReceivedMicros;
     
     if (sendWOL()) {
-      sendTelegram(chatID, "✅ WoL sent to " + serverIP.toString());
+      sendTelegram(chatID, "✅ WoL sent to " + serverIP.toString() + " (no monitoring), " + String(wolBurst.commandToWolMicros / 1000.0, 2) + " ms after the command");
     } else {
       sendTelegram(chatID, "❌ WoL error");
     }
@@ -360,6 +1881,14 @@ void processCommand(String chatID, String text) {
     status += "ESP IP: " + WiFi.localIP().toString() + "\n";
     status += "Server: " + serverIP.toString() + "\n";
     
+    const LivenessEntry* last = livenessFresh(serverIP, (unsigned long)-1);
+    if (last) {
+      status += last->online ? "Server state: online (port " + String(last->port) + ", " : "Server state: offline (";
+      status += String((millis() - last->checkedAt) / 1000) + " sec ago)\n";
+    } else {
+      status += "Server state: unknown\n";
+    }
+    
     if (isMonitoring) {
       unsigned long elapsed = (millis() - wakeCommandTime) / 1000;
       status += "Monitoring: ACTIVE " + String(elapsed) + " sec\n";
@@ -367,17 +1896,188 @@ void processCommand(String chatID, String text) {
       status += "Monitoring: disabled\n";
     }
     
+    if (WATCH_ENABLED) {
+      status += "Watch: " + String(WATCH_HOST_COUNT) + " host(s) every " + String(WATCH_INTERVAL) + " sec\n";
+    }
+    
+    if (sequenceRunning >= 0) {
+      status += "🧩 Sequence running: " + String(sequencePlans[sequenceRunning].name) + "\n";
+    }
+    
+    if (nextScheduleIndex >= 0) {
+      status += "Next scheduled WoL: " + formatTime(nextScheduleFire) + "\n";
+    } else if (scheduleCount > 0 && !clockSynced()) {
+      status += "Schedules: waiting for SNTP time\n";
+    }
+    
+    if (RELAY_ROLE == RELAY_FRONTEND) {
+      status += "Relays: " + String(sizeof(relaySegments) / sizeof(relaySegments[0])) + " segment(s)\n";
+    }
+    
+    const ChatRateLimiter::Stats& limits = chatLimiter.stats();
+    status += "Rejected: " + String(rejectedUnauthorized) + " unauthorized, ";
+    status += String(limits.limited) + " rate-limited (" + String(limits.notices) + " answered)\n";
+    if (proxyNetif) {
+      const char* const proxyStates[] = {"off", "active", "waking"};
+      xSemaphoreTake(proxyLock, portMAX_DELAY);
+      ProxyState state = sleepProxy().state(0);
+      SleepProxy::Stats stats = sleepProxy().stats(0);
+      xSemaphoreGive(proxyLock);
+      status += "Sleep proxy: " + String(proxyConfirmLeft ? "confirming" : proxyStates[state]) + ", " + String(stats.arpAnswered) + " ARP, ";
+      status += String(stats.wakes) + " wakes, " + String(stats.handovers) + " handovers\n";
+    }
+    status += "Log: " + String(logWritten()) + " records, " + String(logDropped()) + " dropped\n";
     status += "lastUpdateId: " + String(lastUpdateId);
     sendTelegram(chatID, status);
   }
-  else if (text == "/check") {
-    sendTelegram(chatID, "🔍 Checking server...");
+  else if (text == "/check" || text == "/check force") {
+    // Fresh data answers instantly, otherwise wait on the shared probe
+    const LivenessEntry* cached = livenessFresh(serverIP, LIVENESS_FRESH_TIME * 1000UL);
+    if (cached && text == "/check") {
+      String msg = livenessText(*cached) + "\n";
+      msg += "ℹ️ Data age: " + String((millis() - cached->checkedAt) / 1000) + " sec";
+      sendTelegram(chatID, msg);
+    } else if (livenessWait(serverIP, chatID)) {
+      sendTelegram(chatID, "🔍 Checking server...");
+    } else {
+      sendTelegram(chatID, "⏳ Check already in progress, try again in a few seconds");
+    }
+  }
+  else if (text.startsWith("/sequence")) {
+    String name = text.substring(9);
+    name.trim();
     
-    if (isServerOnline()) {
-      sendTelegram(chatID, "✅ Server online! " + serverIP.toString());
+    int plan = -1;
+    for (int i = 0; i < SEQUENCE_PLAN_COUNT; i++) {
+      if (name == sequencePlans[i].name) plan = i;
+    }
+    
+    if (name == "") {
+      String msg = "🧩 Wake sequences:\n\n";
+      for (int i = 0; i < SEQUENCE_PLAN_COUNT; i++) {
+        msg += "• " + String(sequencePlans[i].name) + ": " + sequencePlans[i].hosts;
+        if (i == sequenceRunning) msg += " ▶️ running";
+        msg += "\n";
+      }
+      msg += "\nPower-ons: at most " + String(SEQUENCE_MAX_POWERING) + " at once, ";
+      msg += "at least " + String(SEQUENCE_STAGGER) + " sec apart\n";
+      msg += "Start: /sequence <name>";
+      sendTelegram(chatID, msg);
+    } else if (sequenceRunning >= 0) {
+      sendTelegram(chatID, "⏳ Sequence " + String(sequencePlans[sequenceRunning].name) + " is already running");
+    } else if (plan < 0) {
+      sendTelegram(chatID, "❌ No sequence named " + name);
     } else {
-      sendTelegram(chatID, "❌ Server offline " + serverIP.toString());
+      String error = startSequence(plan);
+      if (error != "") {
+        sendTelegram(chatID, "❌ Sequence " + name + ": " + error);
+      } else {
+        sequenceChatID = chatID;
+        String msg = "🧩 Starting sequence " + name + ": ";
+        for (int i = 0; i < sequencer.hostCount(); i++) {
+          msg += String(i ? ", " : "") + sequenceHosts[sequenceHostOf[i]].name;
+        }
+        sendTelegram(chatID, msg);
+        serviceSequence();
+      }
+    }
+  }
+  else if (text.startsWith("/schedule")) {
+    String args = text.substring(9);
+    args.trim();
+    
+    if (args.startsWith("add ")) {
+      String cron = args.substring(4);
+      cron.trim();
+      CronSpec spec;
+      if (scheduleCount >= MAX_SCHEDULES) {
+        sendTelegram(chatID, "❌ Schedule list is full (" + String(MAX_SCHEDULES) + ")");
+      } else if (cron.length() >= sizeof(schedules[0].cron) || !parseCron(cron.c_str(), spec)) {
+        sendTelegram(chatID, "❌ Invalid cron expression: " + cron);
+      } else {
+        WakeSchedule& schedule = schedules[scheduleCount];
+        snprintf(schedule.cron, sizeof(schedule.cron), "%s", cron.c_str());
+        snprintf(schedule.chatId, sizeof(schedule.chatId), "%s", chatID.c_str());
+        scheduleSpecs[scheduleCount++] = spec;
+        saveSchedules();
+        planSchedules();
+        
+        String msg = "✅ Schedule #" + String(scheduleCount) + " added: ready by " + cron;
+        if (clockSynced()) {
+          time_t readyBy = cronNextAfter(spec, time(NULL) + scheduleLeadSeconds());
+          msg += "\n• Next ready-by: " + (readyBy ? formatTime(readyBy) : String("never"));
+        }
+        sendTelegram(chatID, msg);
+      }
+    }
+    else if (args.startsWith("del ")) {
+      int n = args.substring(4).toInt();
+      if (n < 1 || n > scheduleCount) {
+        sendTelegram(chatID, "❌ No schedule #" + args.substring(4));
+      } else {
+        for (int i = n - 1; i < scheduleCount - 1; i++) {
+          schedules[i] = schedules[i + 1];
+          scheduleSpecs[i] = scheduleSpecs[i + 1];
+        }
+        scheduleCount--;
+        saveSchedules();
+        sendTelegram(chatID, "🗑️ Schedule #" + String(n) + " deleted");
+      }
+    }
+    else {
+      String msg = "📅 Scheduled wakes (ready-by times):\n\n";
+      if (schedulePlanDirty) planSchedules();
+      for (int i = 0; i < scheduleCount; i++) {
+        msg += String(i + 1) + ". " + schedules[i].cron;
+        if (i == nextScheduleIndex) msg += " ⏭️ next";
+        msg += "\n";
+      }
+      if (scheduleCount == 0) msg += "No schedules\n";
+      
+      msg += "\n";
+      if (nextScheduleIndex >= 0) {
+        msg += "• Next WoL: " + formatTime(nextScheduleFire) + ", ready by " + formatTime(nextScheduleReady) + "\n";
+      } else if (!clockSynced()) {
+        msg += "• Clock not synced yet (SNTP)\n";
+      }
+      msg += "• Boot estimate: " + String(bootEstimateMs / 1000) + " sec + margin " + String(SCHEDULE_MARGIN) + " sec\n\n";
+      msg += "Add: /schedule add 30 8 * * 1-5\n(minute hour day month weekday)\nDelete: /schedule del 1";
+      sendTelegram(chatID, msg);
+    }
+  }
+  else if (text == "/wakeall" || text == "/checkall") {
+    if (RELAY_ROLE != RELAY_FRONTEND) {
+      sendTelegram(chatID, "ℹ️ Relay cluster is disabled");
+      return;
+    }
+    
+    String report = runFleet(text == "/wakeall");
+    sendTelegram(chatID, report);
+  }
+  else if (text == "/watch") {
+    if (!WATCH_ENABLED) {
+      sendTelegram(chatID, "ℹ️ Uptime watch is disabled");
+      return;
+    }
+    
+    const char* stateNames[] = {"❔ unknown", "🟢 UP", "🟡 confirming", "🔴 DOWN"};
+    unsigned long now = millis();
+    
+    String msg = "👁️ Uptime watch:\n\n";
+    for (int h = 0; h < WATCH_HOST_COUNT; h++) {
+      const WatchStatus& st = watchStatus[h];
+      msg += String(watchHosts[h].name) + " (" + watchHosts[h].ip.toString() + "): ";
+      msg += String(stateNames[st.state]);
+      if (st.state != WATCH_UNKNOWN) {
+        msg += " for " + String((now - st.since) / 1000) + " sec";
+      }
+      msg += "\n";
     }
+    
+    msg += "\n📊 Cost:\n" + watchCostReport();
+    msg += "• Probe every " + String(WATCH_INTERVAL) + " sec, confirm ";
+    msg += String(WATCH_CONFIRM_PROBES) + "x every " + String(WATCH_CONFIRM_INTERVAL) + " sec";
+    sendTelegram(chatID, msg);
   }
   else if (text == "/timing") {
     if (wolSentTime > 0) {
@@ -386,10 +2086,24 @@ void processCommand(String chatID, String text) {
       unsigned long wolToNow = (now - wolSentTime);
       
       String timing = "⏱️ Timing statistics:\n\n";
-      timing += "• Command→WoL: " + String(commandToWol) + " ms\n";
+      if (wolBurst.commandToWolMicros) {
+        timing += "• Command→WoL: " + String(wolBurst.commandToWolMicros) + " µs (update receipt → first datagram)\n";
+      } else {
+        timing += "• Command→WoL: " + String(commandToWol) + " ms\n";
+      }
       timing += "• WoL→Now: " + String(wolToNow / 1000) + " sec\n";
       timing += "• Total: " + String((now - wakeCommandTime) / 1000) + " sec\n\n";
       
+      timing += "⚡ Last WoL burst:\n";
+      timing += "• Datagrams: " + String(wolBurst.datagrams - wolBurst.failed) + "/" + String(wolBurst.datagrams);
+      timing += " (" + String(WOL_REPEATS) + "x" + String(WOL_BROADCAST_COUNT) + "x" + String(WOL_PORT_COUNT) + ")\n";
+      timing += "• First datagram: " + String(wolBurst.firstMicros) + " µs\n";
+      if (wolBurst.datagrams > 0) {
+        timing += "• Per send: avg " + String(wolBurst.totalSendMicros / wolBurst.datagrams);
+        timing += " µs, max " + String(wolBurst.maxSendMicros) + " µs\n";
+      }
+      timing += "• Burst: " + String(wolBurst.burstMicros / 1000) + " ms\n\n";
+      
       if (isMonitoring) {
         timing += "📡 Monitoring active";
       } else if (wolSentTime > 0) {
@@ -401,17 +2115,57 @@ void processCommand(String chatID, String text) {
       sendTelegram(chatID, "ℹ️ WoL hasn't been sent yet");
     }
   }
+  else if (text == "/trace on" || text == "/trace off") {
+    traceOn = (text == "/trace on");
+    sendTelegram(chatID, traceOn ? "🧵 Trace recording on" : "🧵 Trace recording paused");
+  }
+  else if (text == "/trace clear") {
+    traceClear();
+    sendTelegram(chatID, "🗑️ Trace cleared");
+  }
+  else if (text == "/trace dump") {
+    // Log lines would land in the middle of the JSON
+    logPauseDrain(true);
+    traceExport(traceToSerial, NULL);
+    logPauseDrain(false);
+    sendTelegram(chatID, "🧵 Trace JSON written to Serial");
+  }
+  else if (text == "/trace") {
+    // Pause so the upload does not land in the buffer being exported: both
+    // export passes of sendTelegramDocument() must see the same records
+    bool wasOn = traceOn;
+    traceOn = false;
+    
+    String summary = traceSummary();
+    if (!sendTelegramDocument(chatID, "wolbot-trace.json", traceExport)) {
+      summary += "\n⚠️ Upload failed, use /trace dump";
+    }
+    sendTelegram(chatID, summary + "\nOpen the file in ui.perfetto.dev or chrome://tracing");
+    traceOn = wasOn;
+  }
+  else if (text == "/boots") {
+    if (bootHistoryCount == 0) {
+      sendTelegram(chatID, "ℹ️ No boots recorded yet");
+    } else {
+      String msg = "🧭 Boot history (phases in sec: ARP / ICMP / SSH / Service):\n\n";
+      for (int i = 0; i < bootHistoryCount; i++) {
+        msg += bootHistory[i].wolAt ? formatTime(bootHistory[i].wolAt) : String("?");
+        msg += ": ";
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+          if (stage > 0) msg += " / ";
+          msg += bootHistory[i].stageMs[stage] ? bootSeconds(bootPhaseMs(bootHistory[i], stage)) : String("—");
+        }
+        msg += "\n";
+      }
+      msg += "\n" + bootTimelineReport();
+      sendTelegram(chatID, msg);
+    }
+  }
   else if (text == "/ping") {
     sendTelegram(chatID, "🏓 Pong! " + String(millis()) + " ms");
   }
   else if (text == "/clear") {
-    HTTPClient http;
-    String url = "https://api.telegram.org/bot" + botToken + "/getUpdates?offset=-1";
-    http.begin(url);
-    http.GET();
-    http.end();
-    
-    lastUpdateId = 0;
+    clearUpdateHistory();
     sendTelegram(chatID, "🗑️ History cleared");
   }
   else {
@@ -422,6 +2176,8 @@ void processCommand(String chatID, String text) {
 // ========== SETUP ==========
 void setup() {
   Serial.begin(115200);
+  traceOn = TRACE_AT_BOOT;
+  logStartTask();
   delay(1000);
   
   Serial.println("\n=== WoL Bot with boot timing ===");
@@ -451,14 +2207,45 @@ void setup() {
   
   setupWOL();
   
+  if (RELAY_ROLE != RELAY_OFF) {
+    relayUdp.begin(RELAY_PORT);
+    Serial.print("📡 Relay ");
+    Serial.print(RELAY_ROLE == RELAY_NODE ? "node" : "front-end");
+    Serial.print(" #");
+    Serial.print(RELAY_NODE_ID);
+    Serial.print(", port ");
+    Serial.println(RELAY_PORT);
+  }
+  if (RELAY_ROLE == RELAY_NODE) return;
+  
+  // Time for scheduled wakes
+  prefs.begin("wolbot", false);
+  loadSchedules();
+  loadBootHistory();
+  sntp_set_time_sync_notification_cb(onTimeSync);
+  configTzTime(TIMEZONE, NTP_SERVER);
+  Serial.print("📅 Schedules: ");
+  Serial.println(scheduleCount);
+  
+  if (SLEEP_PROXY_ENABLED) setupSleepProxy();
+  
   // Clear Telegram history
   Serial.println("🧹 Clearing history...");
-  HTTPClient http;
-  String url = "https://api.telegram.org/bot" + botToken + "/getUpdates?offset=-1";
-  http.begin(url);
-  http.GET();
-  http.end();
-  delay(1000);
+  clearUpdateHistory();
+  
+  // First watch probes right away, staggered over the steady interval
+  watchStartTime = millis();
+  for (int h = 0; h < WATCH_HOST_COUNT; h++) {
+    watchStatus[h] = WatchStatus();
+    watchStatus[h].nextProbe = watchStartTime + (WATCH_INTERVAL * 1000UL * h) / WATCH_HOST_COUNT;
+  }
+  if (WATCH_ENABLED) {
+    Serial.print("👁️ Uptime watch: ");
+    Serial.print(WATCH_HOST_COUNT);
+    Serial.print(" host(s), ~");
+    Serial.print(3600 / WATCH_INTERVAL * WATCH_HOST_COUNT);
+    Serial.println(" probes/h");
+  }
   
   Serial.println("✅ Bot started");
   Serial.println("Expected server boot time: 20-50 seconds");
@@ -466,21 +2253,38 @@ void setup() {
 
 // ========== LOOP ==========
 void loop() {
-  // Check Telegram
-  String update = getTelegramUpdate();
-  
-  if (update != "") {
-    int separator = update.indexOf("|");
-    if (separator > 0) {
-      String chatID = update.substring(0, separator);
-      String text = update.substring(separator + 1);
-      
-      processCommand(chatID, text);
+  // Relay nodes only serve the front-end
+  if (RELAY_ROLE == RELAY_NODE) {
+    serviceRelayNode();
+    delay(1);
+    return;
+  }
+  
+  // A wake for the sleep proxy goes out before anything else
+  serviceSleepProxy();
+  
+  // Check Telegram: a flood drains TELEGRAM_BATCH commands per poll
+  int updates = getTelegramUpdates();
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < updates; i++) {
+      const TelegramUpdate& update = updateBatch[i];
+      if (!update.complete || !update.hasMessage || isWolCommand(update.text) != (pass == 0)) continue;
+      processCommand(update.chatId, update.text);
     }
   }
   
   // Check monitoring
   checkServerMonitoring();
+  serviceLiveness();
+  checkWatch();
+  checkSchedules();
+  serviceSequence();
   
-  delay(2000);
+  // More updates may be queued behind a poll that brought some
+  if (updates == 0) {
+    TRACE_SPAN("idle");
+    // A SYN caught by the sleep proxy ends the pause early; a running
+    // sequence probes one host per pass, so it keeps the pause short
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sequenceRunning >= 0 ? 100 : 2000));
+  }
 }
\ No newline at end of file
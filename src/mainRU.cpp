@@ -2,134 +2,1331 @@
 #include <WiFi.h>
 #include <WiFiUdp.h>
 #include <WiFiClient.h>
+#include <WiFiClientSecure.h>
 #include <HTTPClient.h>
+#include <Preferences.h>
+#include <esp_sntp.h>
+#include <time.h>
+#include <lwip/etharp.h>
+#include <lwip/tcpip.h>
+#include <lwip/pbuf.h>
+#include <lwip/sockets.h>
+#include <ping/ping_sock.h>
 #include <ArduinoJson.h>
+#include <BotCore.h>
+#include <CronSchedule.h>
+#include <WolPacket.h>
+#include <WolRelay.h>
+#include <WakeSequence.h>
+#include <SpanTrace.h>
+#include <AsyncLog.h>
+#include <SleepProxy.h>
 
 // ========== КОНФИГУРАЦИЯ ==========
 const char* ssid = "Вайфай";
 const char* password = "Пароль вайфая";
 const String botToken = "Апи бота";
-const String allowedUsers[] = {"111111111", "111111111", ""}; //Вайтлист пользователей (в форме айди)
+const char* allowedUsers[] = {"111111111", "111111111", ""}; //Вайтлист пользователей (в форме айди)
+
+// Защита от флуда: проверяется до отправки любого ответа
+const int CHAT_BURST = 5;               // Сколько команд чат может отправить подряд
+const int CHAT_REFILL = 3;              // Дальше одна команда каждые 3 секунды
+const int CHAT_NOTICE_WINDOW = 60;      // Не больше одного ответа об отказе на чат за 60 секунд
+const int TELEGRAM_BATCH = 8;           // Апдейтов за один опрос
+const bool ANSWER_UNAUTHORIZED = false; // false = молча игнорировать чужие чаты, true = один ответ за окно на всех
+
+// Трассировка
+const bool TRACE_AT_BOOT = true;        // Записывать спаны с включения (/trace on|off)
 
 // WoL
-const String serverMAC = "AA:AA:1A:1A:11:AA"; //Мак адрес сервера 
+constexpr char serverMAC[] = "AA:AA:1A:1A:11:AA"; //Мак адрес сервера (проверяется при компиляции)
+constexpr char secureOnPassword[] = "";            //Пароль SecureOn "AA:BB:CC:DD[:EE:FF]", пусто = нет
 const IPAddress serverIP(192, 168, 1, 228); //Локальный айпи сервера
-const IPAddress broadcastIP(192, 168, 1, 255); //Бродкаст айпи (Берешь айпи роутера и после последней точки меняешь на 3 цыфры из маски подсети)
+
+// Серия WoL: каждый раунд шлет пакет на все адреса и порты
+const IPAddress wolBroadcasts[] = {IPAddress(192, 168, 1, 255)}; //Бродкаст айпи (Берешь айпи роутера и после последней точки меняешь на 3 цыфры из маски подсети)
+const uint16_t wolPorts[] = {9, 7};
+const int WOL_REPEATS = 3;         // Раундов на одно пробуждение
+const int WOL_SPACING = 20;        // Пауза между раундами (мс)
 
 // Мониторинг (настроено под ваш сервер)
 const int MAX_WAIT_TIME = 90;      // 90 секунд максимум (20-50 сек + запас)
 const int CHECK_INTERVAL = 3;      // Проверка каждые 3 секунды
 const int PROGRESS_UPDATE = 15;    // Прогресс каждые 15 секунд
 
+// Хронология загрузки: ARP → ICMP → SSH → проверка приложения
+const uint16_t BOOT_SSH_PORT = 22;
+const uint16_t HEALTH_PORT = 22;        // По умолчанию ждем sshd, например 80 с путем HTTP
+const char* HEALTH_HTTP_PATH = "";      // Путь HTTP проверки, например "/" ("" = вместо нее проверка TCP баннера)
+const int HEALTH_HTTP_STATUS = 0;       // Ожидаемый HTTP статус (0 = любой ответ)
+const char* HEALTH_BANNER = "SSH-";     // Ожидаемое начало баннера для TCP проверки ("" = любой)
+const int BOOT_HISTORY = 8;             // Сколько хронологий загрузки хранить для трендов
+
+// Пробуждение по расписанию: время в cron - когда сервер должен быть ГОТОВ,
+// WoL уходит раньше на измеренное время загрузки плюс запас
+const char* TIMEZONE = "MSK-3";         // POSIX TZ, например "MSK-3" или "UTC0"
+const char* NTP_SERVER = "pool.ntp.org";
+const int SCHEDULE_MARGIN = 30;         // Запас сверх времени загрузки (сек)
+const int DEFAULT_BOOT_TIME = 50;       // Оценка загрузки, пока нет замеров (сек)
+const int MAX_SCHEDULES = 8;
+
+// Кластер ретрансляторов: один фронтенд общается с Telegram, ретрансляторы
+// в других сегментах сети отправляют там magic-пакеты (tools/relay - ретранслятор для Linux)
+enum RelayRole { RELAY_OFF, RELAY_FRONTEND, RELAY_NODE };
+const RelayRole RELAY_ROLE = RELAY_OFF;
+const uint16_t RELAY_NODE_ID = 1;       // Уникальный для каждого узла кластера
+const uint16_t RELAY_PORT = RELAY_DEFAULT_PORT;
+const int RELAY_TIMEOUT = 5000;         // Ожидание результатов от ретрансляторов (мс)
+const int RELAY_RETRY = 400;            // Повтор неотвеченных заданий через (мс)
+const uint8_t RELAY_KEY[RELAY_KEY_SIZE] = { // Общий секрет, смените на всех узлах!
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+  0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+
+struct RelaySegment {
+  const char* name;
+  IPAddress relayIP;      // Ретранслятор в этом сегменте
+  uint16_t relayNode;     // Его RELAY_NODE_ID, только он отвечает за сегмент
+};
+const RelaySegment relaySegments[] = {
+  {"lab", IPAddress(192, 168, 20, 50), 2},
+};
+
+struct RelayTarget {
+  const char* name;
+  const char* mac;
+  uint8_t segment;        // Индекс в relaySegments
+  IPAddress ip;
+  IPAddress broadcast;    // Бродкаст сегмента
+  uint16_t probePort;
+};
+const RelayTarget relayTargets[] = {
+  {"lab-nas", "AA:BB:CC:DD:EE:01", 0, IPAddress(192, 168, 20, 10), IPAddress(192, 168, 20, 255), 22},
+};
+
+// Кэш доступности (общий для /check, /status, наблюдения и мониторинга загрузки)
+const int LIVENESS_FRESH_TIME = 10;    // Результаты моложе 10 секунд используются повторно
+const int LIVENESS_MAX_WAITERS = 4;    // Чаты, ждущие одну выполняющуюся /check
+const int LIVENESS_SLOTS = 4;
+
+// Наблюдение за аптаймом (мониторинг хостов после загрузки)
+const bool WATCH_ENABLED = true;
+const int WATCH_INTERVAL = 30;          // Обычная проверка каждые 30 секунд
+const int WATCH_CONFIRM_INTERVAL = 2;   // Подтверждающие проверки каждые 2 секунды после сбоя
+const int WATCH_CONFIRM_PROBES = 3;     // Сколько неудачных подтверждений до "НЕДОСТУПЕН"
+const int WATCH_PROBE_TIMEOUT = 400;    // Таймаут TCP подключения на порт (мс)
+const int WATCH_BYTES_PER_CONNECT = 420; // ~7 кадров на открытие/закрытие TCP в эфире
+const uint16_t watchPorts[] = {22, 80, 443}; // Порты проверки, последний ответивший идет первым
+
+struct WatchHost {
+  const char* name;
+  IPAddress ip;
+};
+const WatchHost watchHosts[] = {
+  {"server", serverIP},
+};
+
+// Последовательности пробуждения: хост будится только после ответа всех хостов из "after"
+struct SequenceHost {
+  const char* name;
+  const char* mac;
+  IPAddress ip;
+  uint16_t probePort;     // TCP порт, ответ на котором значит "включен"
+  const char* after;      // Зависимости через запятую ("" = нет)
+};
+const SequenceHost sequenceHosts[] = {
+  {"server", serverMAC, serverIP, 22, ""},
+  {"nas", "AA:BB:CC:DD:EE:02", IPAddress(192, 168, 1, 50), 22, ""},
+  {"app", "AA:BB:CC:DD:EE:03", IPAddress(192, 168, 1, 60), 80, "server,nas"},
+};
+struct SequencePlan {
+  const char* name;
+  const char* hosts;      // Какие хосты поднять, их зависимости добавляются сами
+};
+const SequencePlan sequencePlans[] = {
+  {"lab", "app"},
+};
+const int SEQUENCE_MAX_POWERING = 1;    // Сколько хостов грузится одновременно (пусковой ток PDU)
+const int SEQUENCE_STAGGER = 10;        // Минимум секунд между двумя включениями
+const int SEQUENCE_PROBE_INTERVAL = 3;  // Проверка загружающихся хостов каждые 3 секунды
+const int SEQUENCE_BOOT_TIMEOUT = 180;  // WoL → ответ, после которого хост считается сбойным (сек)
+
+// Sleep proxy: пока сервер выключен, отвечаем на ARP за него и будим его при подключении
+const bool SLEEP_PROXY_ENABLED = true;
+const uint16_t proxyPorts[] = {22, 80, 443}; // SYN на один из этих портов будит сервер
+const int PROXY_WAKE_RETRY = 120;       // Повторный SYN шлет WoL снова через 120 секунд без передачи адреса
+const int PROXY_ARP_CONFIRM = 3;        // ARP запросов без ответа (через проход цикла) перед запуском прокси
+
 // ========== ПЕРЕМЕННЫЕ ==========
 int lastUpdateId = 0;
-uint8_t macArray[6];
+TelegramUpdate updateBatch[TELEGRAM_BATCH]; // Апдейты последнего опроса
 
 // Мониторинг
 bool isMonitoring = false;
 unsigned long wakeCommandTime = 0;     // Время отправки команды /wake
 unsigned long wolSentTime = 0;         // Время отправки WoL пакета
+
+// Magic пакет собирается компилятором и лежит во flash
+static_assert(isValidMac(serverMAC), "serverMAC - неверный MAC адрес");
+static_assert(isValidSecureOn(secureOnPassword), "secureOnPassword - пусто, 4 или 6 байт");
+constexpr WolMagicPacket wolPacket = makeMagicPacket(serverMAC, secureOnPassword);
+const int WOL_BROADCAST_COUNT = sizeof(wolBroadcasts) / sizeof(wolBroadcasts[0]);
+const int WOL_PORT_COUNT = sizeof(wolPorts) / sizeof(wolPorts[0]);
+
+// Последняя серия WoL
+struct WolBurstStats {
+  uint16_t datagrams;
+  uint16_t failed;
+  unsigned long firstMicros;           // Вызов sendWOL() → первый пакет передан в lwIP
+  unsigned long maxSendMicros;         // Самая медленная отправка
+  unsigned long totalSendMicros;       // Сумма всех отправок
+  unsigned long commandToWolMicros;    // Получение апдейта → первый пакет (0 = не команда)
+  unsigned long burstMicros;           // Вся серия с паузами
+};
+WolBurstStats wolBurst;
+unsigned long updateReceivedMicros = 0; // micros() получения текущего апдейта
+unsigned long commandMicros = 0;        // Получение команды для следующего WoL (0 = нет)
+WiFiUDP wolUdp;                        // Постоянный WoL сокет
 String monitoringChatID = "";
 int lastProgressUpdate = 0;            // Последнее обновление прогресса
 
+// Защита от флуда
+ChatRateLimiter chatLimiter(CHAT_BURST, CHAT_REFILL * 1000UL, CHAT_NOTICE_WINDOW * 1000UL);
+unsigned long rejectedUnauthorized = 0;
+
+// Хронология загрузки текущего пробуждения
+enum BootStage { STAGE_ARP, STAGE_ICMP, STAGE_SSH, STAGE_SERVICE, STAGE_COUNT };
+const char* const bootStageNames[STAGE_COUNT] = {"ARP", "ICMP", "SSH", "Сервис"};
+unsigned long bootStageAt[STAGE_COUNT];  // millis() первого появления этапа, 0 = еще нет
+volatile unsigned long icmpReplyAt = 0;  // Выставляется задачей ping
+esp_ping_handle_t bootPing = NULL;
+unsigned long bootProbeAt = 0;           // millis() ожидающего запроса доступности, 0 = нет
+
+// Завершенные хронологии (мс после WoL по этапам, 0 = не было), хранятся в NVS
+struct BootRecord {
+  uint32_t wolAt;                        // Unix время WoL
+  uint32_t stageMs[STAGE_COUNT];
+};
+BootRecord bootHistory[BOOT_HISTORY];
+int bootHistoryCount = 0;
+
+// Пробуждение по расписанию (хранится в NVS)
+struct WakeSchedule {
+  char cron[32];                       // Время готовности
+  char chatId[TELEGRAM_CHAT_ID_MAX];   // Кому отправить отчет о загрузке
+};
+WakeSchedule schedules[MAX_SCHEDULES];
+CronSpec scheduleSpecs[MAX_SCHEDULES];
+int scheduleCount = 0;
+Preferences prefs;
+unsigned long bootEstimateMs = DEFAULT_BOOT_TIME * 1000UL; // Измеренное WoL→Загрузка
+volatile bool schedulePlanDirty = true; // Пересчитать после изменений или синхронизации часов
+time_t nextScheduleFire = 0;           // Когда уйдет следующий WoL (0 = нет)
+time_t nextScheduleReady = 0;          // Его целевое время готовности
+int nextScheduleIndex = -1;
+time_t scheduledReadyBy = 0;           // Цель текущего пробуждения (0 = ручное)
+
+// Кэш доступности
+struct LivenessEntry {
+  IPAddress ip;
+  bool known;                 // Хотя бы одна проверка завершилась
+  bool online;
+  uint16_t port;              // Ответивший порт (0 если недоступен)
+  unsigned long checkedAt;    // millis() последней проверки
+  bool inFlight;              // Проверка идет, все вызывающие присоединяются к ней
+  uint16_t firstPort;         // Проверяется первым: запрошенный или последний ответивший порт
+  uint8_t portIndex;          // Порт, на котором сейчас проверка (0 = firstPort)
+  bool connecting;            // В fd ожидающее подключение
+  int fd;
+  unsigned long connectAt;    // millis() начала ожидающего подключения
+  uint8_t connects;           // TCP подключений последней проверки
+  uint32_t probeMicros;       // Время цикла последней проверки за все ее проходы
+  String waiters[LIVENESS_MAX_WAITERS]; // Чаты, которым ответить после проверки
+  uint8_t waiterCount;
+};
+LivenessEntry livenessCache[LIVENESS_SLOTS];
+
+// Наблюдение за аптаймом
+enum WatchState { WATCH_UNKNOWN, WATCH_UP, WATCH_SUSPECT, WATCH_DOWN };
+struct WatchStatus {
+  WatchState state;
+  uint16_t port;              // Последний ответивший порт
+  uint8_t failedConfirms;     // Неудачные подтверждения подряд
+  unsigned long nextProbe;    // millis() следующей проверки
+  bool waiting;               // Проверка доступности запрошена, результата еще нет
+  unsigned long requestedAt;  // millis() этого запроса
+  unsigned long since;        // millis() последней смены состояния
+  unsigned long lastSeenUp;   // millis() последней удачной проверки
+  unsigned long probes;       // Выполнено проверок
+  unsigned long connects;     // Попыток TCP подключения (сетевая стоимость)
+  uint64_t probeMicros;       // Время цикла на проверки (стоимость CPU)
+  unsigned long alerts;       // Отправлено уведомлений
+};
+const int WATCH_HOST_COUNT = sizeof(watchHosts) / sizeof(watchHosts[0]);
+WatchStatus watchStatus[WATCH_HOST_COUNT];
+unsigned long watchStartTime = 0;
+
 // ========== ПРОТОТИПЫ ФУНКЦИЙ ==========
 void sendTelegram(String chatID, String message);
+void bootTimelineStart();
+void sleepProxySet(bool active);
 
 // ========== WoL ФУНКЦИИ ==========
 void setupWOL() {
-  String macStr = serverMAC;
-  macStr.replace(":", "");
-  
-  for (int i = 0; i < 6; i++) {
-    String byteStr = macStr.substring(i*2, i*2+2);
-    macArray[i] = strtol(byteStr.c_str(), NULL, 16);
-  }
-  
-  Serial.println("MAC: " + serverMAC);
+  Serial.print("MAC: ");
+  Serial.print(serverMAC);
+  Serial.println(wolPacket.size > WOL_PACKET_SIZE ? " + SecureOn" : "");
+  Serial.print("⚡ Серия WoL: ");
+  Serial.print(WOL_REPEATS);
+  Serial.print(" x ");
+  Serial.print(WOL_BROADCAST_COUNT * WOL_PORT_COUNT);
+  Serial.println(" пакетов");
 }
 
 bool sendWOL() {
-  Serial.println("⚡ Отправляю WoL пакет...");
+  TRACE_SPAN("wol.send");
+  unsigned long start = micros();
   wolSentTime = millis(); // Засекаем время отправки WoL
+  wolBurst = WolBurstStats();
   
-  WiFiUDP udp;
-  udp.beginPacket(broadcastIP, 9);
-  
-  for (int i = 0; i < 6; i++) udp.write(0xFF);
-  for (int i = 0; i < 16; i++) {
-    for (int j = 0; j < 6; j++) {
-      udp.write(macArray[j]);
+  // Каждый раунд: каждый адрес на каждый порт, одна запись буфера на пакет
+  for (int round = 0; round < WOL_REPEATS; round++) {
+    if (round > 0) delay(WOL_SPACING);
+    for (int a = 0; a < WOL_BROADCAST_COUNT; a++) {
+      for (int p = 0; p < WOL_PORT_COUNT; p++) {
+        unsigned long sendStart = micros();
+        wolUdp.beginPacket(wolBroadcasts[a], wolPorts[p]);
+        wolUdp.write(wolPacket.bytes, wolPacket.size);
+        bool sent = (wolUdp.endPacket() == 1);
+        unsigned long sendEnd = micros();
+        
+        if (wolBurst.datagrams == 0) {
+          wolBurst.firstMicros = sendEnd - start;
+          if (commandMicros) wolBurst.commandToWolMicros = sendEnd - commandMicros;
+        }
+        wolBurst.datagrams++;
+        if (!sent) wolBurst.failed++;
+        wolBurst.totalSendMicros += sendEnd - sendStart;
+        if (sendEnd - sendStart > wolBurst.maxSendMicros) wolBurst.maxSendMicros = sendEnd - sendStart;
+      }
     }
   }
+  wolBurst.burstMicros = micros() - start;
+  commandMicros = 0;
   
-  bool success = (udp.endPacket() == 1);
-  udp.stop();
-  
+  bool success = wolBurst.failed < wolBurst.datagrams;
   if (success) {
-    Serial.println("✅ WoL отправлен успешно");
-    // Рассчитываем задержку между командой и отправкой WoL
-    unsigned long commandToWolDelay = (wolSentTime - wakeCommandTime);
-    Serial.print("⏱️ Задержка команда→WoL: ");
-    Serial.print(commandToWolDelay);
-    Serial.println(" мс");
+    LOG_INFO("✅ WoL отправлен: %u/%u пакетов, первый через %lu мкс", wolBurst.datagrams - wolBurst.failed, wolBurst.datagrams, wolBurst.firstMicros);
+    if (wolBurst.commandToWolMicros) {
+      LOG_INFO("⏱️ Команда→WoL: %lu мкс от получения апдейта", wolBurst.commandToWolMicros);
+    }
   } else {
-    Serial.println("❌ Ошибка отправки WoL");
+    LOG_ERROR("❌ Ошибка отправки WoL");
   }
   
   return success;
 }
 
 // ========== ПРОВЕРКА СЕРВЕРА ==========
-bool isServerOnline() {
-  HTTPClient http;
+void livenessRecord(IPAddress ip, bool online, uint16_t port);
+
+// Неблокирующее TCP подключение: начинается в одном проходе цикла и
+// опрашивается в следующих, так что проверка никогда не ждет в connect()
+int connectStart(IPAddress ip, uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) return -1;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = (uint32_t)ip;
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// 1 подключено, 0 отказ или ошибка, -1 еще ждем
+int connectPoll(int fd) {
+  fd_set writable;
+  FD_ZERO(&writable);
+  FD_SET(fd, &writable);
+  struct timeval noWait = {0, 0};
+  int ready = select(fd + 1, NULL, &writable, NULL, &noWait);
+  if (ready == 0) return -1;
+  if (ready < 0) return 0;
+  
+  int error = 0;
+  socklen_t length = sizeof(error);
+  getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+  return error == 0 ? 1 : 0;
+}
+
+// ========== КЭШ ДОСТУПНОСТИ ==========
+// Сюда попадает результат каждой проверки, кто бы ее ни запустил. У хоста
+// идет не больше одной проверки: /check, наблюдение, мониторинг загрузки и
+// последовательности присоединяются к ней и читают результат из записи.
+LivenessEntry* livenessEntry(IPAddress ip) {
+  LivenessEntry* oldest = NULL;
+  for (int i = 0; i < LIVENESS_SLOTS; i++) {
+    LivenessEntry& e = livenessCache[i];
+    if (e.ip == ip && (e.known || e.inFlight)) return &e;
+    if (e.inFlight) continue;
+    if (!oldest || !e.known || (oldest->known && e.checkedAt < oldest->checkedAt)) oldest = &e;
+  }
+  
+  // Берем свободный слот или вытесняем самый старый результат
+  if (oldest) {
+    *oldest = LivenessEntry();
+    oldest->ip = ip;
+  }
+  return oldest;
+}
+
+void livenessRecord(IPAddress ip, bool online, uint16_t port) {
+  LivenessEntry* e = livenessEntry(ip);
+  if (!e) return;
+  e->known = true;
+  e->online = online;
+  e->port = online ? port : 0;
+  e->checkedAt = millis();
+}
+
+// Возвращает запись, если результат моложе maxAgeMs, иначе NULL
+const LivenessEntry* livenessFresh(IPAddress ip, unsigned long maxAgeMs) {
+  for (int i = 0; i < LIVENESS_SLOTS; i++) {
+    const LivenessEntry& e = livenessCache[i];
+    if (e.known && e.ip == ip && millis() - e.checkedAt < maxAgeMs) return &e;
+  }
+  return NULL;
+}
+
+String livenessText(const LivenessEntry& e) {
+  String text = e.online ? "✅ Сервер онлайн! " : "❌ Сервер оффлайн ";
+  text += e.ip.toString();
+  if (e.online) text += " (порт " + String(e.port) + ")";
+  return text;
+}
+
+// Результат проверки, завершившейся не раньше `since`, NULL пока его нет
+const LivenessEntry* livenessSince(IPAddress ip, unsigned long since) {
+  for (int i = 0; i < LIVENESS_SLOTS; i++) {
+    const LivenessEntry& e = livenessCache[i];
+    if (e.known && e.ip == ip && (long)(e.checkedAt - since) >= 0) return &e;
+  }
+  return NULL;
+}
+
+// n-й порт проверки: firstPort, затем порты наблюдения без него (0 = конец)
+uint16_t livenessPort(const LivenessEntry& e, int n) {
+  if (n == 0) return e.firstPort;
+  for (int p = 0; p < (int)(sizeof(watchPorts) / sizeof(watchPorts[0])); p++) {
+    if (watchPorts[p] != e.firstPort && --n == 0) return watchPorts[p];
+  }
+  return 0;
+}
+
+// Запускает проверку хоста или присоединяется к уже идущей. `port`
+// проверяется первым (0 = последний ответивший порт).
+LivenessEntry* livenessRequest(IPAddress ip, uint16_t port) {
+  LivenessEntry* e = livenessEntry(ip);
+  if (!e || e->inFlight) return e;
+  e->inFlight = true;
+  e->firstPort = port ? port : (e->online ? e->port : watchPorts[0]);
+  e->portIndex = 0;
+  e->connects = 0;
+  e->probeMicros = 0;
+  return e;
+}
+
+// Ставит chatID в очередь к единственной выполняющейся проверке хоста
+bool livenessWait(IPAddress ip, String chatID) {
+  LivenessEntry* e = livenessRequest(ip, 0);
+  if (!e) return false;
   
-  // Проверяем несколько портов для надежности
-  String urls[] = {
-    "http://" + serverIP.toString(),
-    "http://" + serverIP.toString() + ":80",
-    "http://" + serverIP.toString() + ":443"
-  };
+  for (int i = 0; i < e->waiterCount; i++) {
+    if (e->waiters[i] == chatID) return true;
+  }
+  if (e->waiterCount >= LIVENESS_MAX_WAITERS) return false;
+  e->waiters[e->waiterCount++] = chatID;
+  return true;
+}
+
+// Продвигает каждую идущую проверку на один шаг за проход цикла: начинает
+// подключение к следующему порту или опрашивает ожидающее, никогда не ждет.
+// Первый принявший порт завершает проверку; после последнего хост недоступен.
+void serviceLiveness() {
+  for (int i = 0; i < LIVENESS_SLOTS; i++) {
+    LivenessEntry& e = livenessCache[i];
+    if (!e.inFlight) continue;
+    
+    TRACE_SPAN("liveness.step");
+    unsigned long start = micros();
+    uint16_t port = livenessPort(e, e.portIndex);
+    if (!e.connecting) {
+      e.fd = connectStart(e.ip, port);
+      e.connecting = e.fd >= 0;
+      e.connectAt = millis();
+      e.connects++;
+    }
+    int connected = e.connecting ? connectPoll(e.fd) : 0;
+    if (connected < 0 && millis() - e.connectAt < WATCH_PROBE_TIMEOUT) {
+      e.probeMicros += micros() - start;
+      continue;
+    }
+    if (e.connecting) close(e.fd);
+    e.connecting = false;
+    e.probeMicros += micros() - start;
+    if (connected <= 0 && livenessPort(e, ++e.portIndex)) continue;
+    
+    livenessRecord(e.ip, connected > 0, port);
+    e.inFlight = false;
+    LOG_DEBUG("🔍 Доступность %u.%u.%u.%u: %s после %u подключений", e.ip[0], e.ip[1], e.ip[2], e.ip[3],
+              e.online ? "онлайн" : "оффлайн", e.connects);
+    
+    String result = livenessText(e);
+    for (int w = 0; w < e.waiterCount; w++) {
+      sendTelegram(e.waiters[w], result);
+      e.waiters[w] = "";
+    }
+    e.waiterCount = 0;
+  }
+}
+
+// ========== НАБЛЮДЕНИЕ ЗА АПТАЙМОМ ==========
+// У наблюдения нет своей проверки: хост, которому пора, получает запрос
+// доступности, а результат читается в одном из следующих проходов. Обычная
+// проверка доступного хоста стоит одно подключение к последнему ответившему
+// порту. Только неудача переводит в подтверждающие проверки, чтобы
+// потерянный SYN или перезапуск сервиса не давали ложное "НЕДОСТУПЕН".
+void notifyAll(String message) {
+  for (int i = 0; i < sizeof(allowedUsers)/sizeof(allowedUsers[0]); i++) {
+    if (allowedUsers[i][0]) sendTelegram(allowedUsers[i], message);
+  }
+}
+
+// Отчеты о загрузке идут в чат, запросивший пробуждение; пробуждение без
+// команды (от sleep proxy) сообщается всему белому списку
+void sendMonitoring(String message) {
+  if (monitoringChatID.length()) sendTelegram(monitoringChatID, message);
+  else notifyAll(message);
+}
+
+void watchSetState(int h, WatchState state, unsigned long now) {
+  watchStatus[h].state = state;
+  watchStatus[h].since = now;
+  watchStatus[h].failedConfirms = 0;
+  watchStatus[h].nextProbe = now + WATCH_INTERVAL * 1000UL;
+  // Подтвержденное падение — момент, когда sleep proxy берет адрес сервера
+  if (watchHosts[h].ip == serverIP) sleepProxySet(state == WATCH_DOWN);
+}
+
+// Вызывается мониторингом загрузки: хост поднялся, уведомление не нужно
+void watchMarkUp(IPAddress ip) {
+  unsigned long now = millis();
+  for (int h = 0; h < WATCH_HOST_COUNT; h++) {
+    if (watchHosts[h].ip == ip) {
+      watchSetState(h, WATCH_UP, now);
+      watchStatus[h].lastSeenUp = now;
+    }
+  }
+}
+
+void checkWatch() {
+  if (!WATCH_ENABLED) return;
   
-  for (int i = 0; i < 3; i++) {
-    http.begin(urls[i]);
-    http.setTimeout(2000); // 2 секунды на попытку
+  unsigned long now = millis();
+  for (int h = 0; h < WATCH_HOST_COUNT; h++) {
+    WatchStatus& st = watchStatus[h];
+    const WatchHost& host = watchHosts[h];
+    if (!st.waiting && (long)(now - st.nextProbe) < 0) continue;
     
-    int httpCode = http.GET();
-    http.end();
+    // Пока сервер загружается, им занимается мониторинг загрузки
+    if (isMonitoring && host.ip == serverIP) {
+      st.waiting = false;
+      st.nextProbe = now + WATCH_INTERVAL * 1000UL;
+      continue;
+    }
     
-    // Если получили любой ответ (даже ошибку) - сервер жив
-    if (httpCode > 0) {
-      Serial.print("✅ Сервер отвечает на порт ");
-      Serial.print(i == 0 ? "80/443" : (i == 1 ? "80" : "443"));
-      Serial.print(", код: ");
-      Serial.println(httpCode);
-      return true;
+    const LivenessEntry* result;
+    if (!st.waiting) {
+      // Свежее "онлайн" от /check или мониторинга загрузки заменяет обычную проверку
+      result = livenessFresh(host.ip, LIVENESS_FRESH_TIME * 1000UL);
+      if (st.state != WATCH_UP || !result || !result->online) {
+        st.waiting = true;
+        st.requestedAt = now;
+        livenessRequest(host.ip, 0);
+        continue;
+      }
+    } else {
+      // Повторный запрос в каждом проходе заново присоединяет к проверке, если ее слот вытеснен
+      result = livenessSince(host.ip, st.requestedAt);
+      if (!result) {
+        livenessRequest(host.ip, 0);
+        continue;
+      }
+      st.waiting = false;
+      st.probes++;
+      st.connects += result->connects;
+      st.probeMicros += result->probeMicros;
+    }
+    bool alive = result->online;
+    if (alive) {
+      st.lastSeenUp = now;
+      st.port = result->port;
     }
     
-    delay(100); // Маленькая пауза между попытками
+    switch (st.state) {
+      case WATCH_UNKNOWN:
+        // Первый результат после старта только пишется в лог
+        watchSetState(h, alive ? WATCH_UP : WATCH_DOWN, now);
+        LOG_INFO("👁️ Наблюдение: %s%s", host.name, alive ? " доступен" : " недоступен");
+        break;
+        
+      case WATCH_UP:
+        if (!alive) {
+          st.state = WATCH_SUSPECT;
+          st.failedConfirms = 0;
+          st.nextProbe = now + WATCH_CONFIRM_INTERVAL * 1000UL;
+          LOG_WARN("⚠️ Наблюдение: %s не ответил, подтверждаю...", host.name);
+        } else {
+          st.nextProbe = now + WATCH_INTERVAL * 1000UL;
+        }
+        break;
+        
+      case WATCH_SUSPECT:
+        if (alive) {
+          st.state = WATCH_UP;
+          st.nextProbe = now + WATCH_INTERVAL * 1000UL;
+          LOG_INFO("👁️ Наблюдение: %s снова ответил, это не сбой", host.name);
+        } else if (++st.failedConfirms >= WATCH_CONFIRM_PROBES) {
+          unsigned long lastSeen = (now - st.lastSeenUp) / 1000;
+          watchSetState(h, WATCH_DOWN, now);
+          st.alerts++;
+          
+          String msg = "🔴 " + String(host.name) + " НЕДОСТУПЕН\n\n";
+          msg += "• IP: " + host.ip.toString() + "\n";
+          msg += "• Нет ответа на " + String(WATCH_CONFIRM_PROBES) + " подтверждающие проверки\n";
+          msg += "• Последний раз был доступен: " + String(lastSeen) + " сек назад\n\n";
+          msg += "Используйте /wake чтобы включить";
+          notifyAll(msg);
+          
+          LOG_WARN("🔴 Наблюдение: %s НЕДОСТУПЕН", host.name);
+        } else {
+          st.nextProbe = now + WATCH_CONFIRM_INTERVAL * 1000UL;
+        }
+        break;
+        
+      case WATCH_DOWN:
+        if (alive) {
+          unsigned long downtime = (now - st.since) / 1000;
+          watchSetState(h, WATCH_UP, now);
+          st.alerts++;
+          
+          String msg = "🟢 " + String(host.name) + " снова ДОСТУПЕН\n\n";
+          msg += "• IP: " + host.ip.toString() + "\n";
+          msg += "• Порт: " + String(st.port) + "\n";
+          msg += "• Простой: " + String(downtime) + " сек";
+          notifyAll(msg);
+          
+          LOG_INFO("🟢 Наблюдение: %s ДОСТУПЕН", host.name);
+        } else {
+          st.nextProbe = now + WATCH_INTERVAL * 1000UL;
+          // Все еще лежит: снова пробуем прокси, если ARP помешал его запуску
+          if (host.ip == serverIP) sleepProxySet(true);
+        }
+        break;
+    }
+  }
+}
+
+// Измеренная стоимость наблюдения в пересчете на час. Пока не набралась
+// минута данных, показывается расчет по настройкам.
+String watchCostReport() {
+  unsigned long elapsed = millis() - watchStartTime;
+  unsigned long probes = 0, connects = 0;
+  uint64_t busyMicros = 0;
+  for (int h = 0; h < WATCH_HOST_COUNT; h++) {
+    probes += watchStatus[h].probes;
+    connects += watchStatus[h].connects;
+    busyMicros += watchStatus[h].probeMicros;
+  }
+  
+  String report;
+  if (elapsed < 60000 || probes == 0) {
+    float perHour = 3600.0 / WATCH_INTERVAL * WATCH_HOST_COUNT;
+    report += "• Проверки: ~" + String(perHour, 0) + "/ч (расчет)\n";
+    report += "• Трафик: ~" + String(perHour * WATCH_BYTES_PER_CONNECT / 1024, 1) + " КБ/ч\n";
+    return report;
   }
   
-  // Альтернативная проверка через подключение к порту (замена WiFi.ping)
+  float scale = 3600000.0 / elapsed;
+  float busyMsPerHour = busyMicros / 1000.0 * scale;
+  report += "• Проверки: " + String(probes * scale, 0) + "/ч\n";
+  report += "• Трафик: ~" + String(connects * scale * WATCH_BYTES_PER_CONNECT / 1024, 1) + " КБ/ч\n";
+  report += "• Занятость цикла: " + String(busyMsPerHour / 1000, 1) + " сек/ч (";
+  report += String(busyMsPerHour / 36000, 2) + "%)\n";
+  return report;
+}
+
+// ========== КЛАСТЕР РЕТРАНСЛЯТОРОВ ==========
+// Фронтенд: /wakeall и /checkall отправляют каждому сегменту одну датаграмму
+// со всеми его заданиями и собирают присланные результаты. Узел: выполняет
+// пакеты заданий от фронтенда и не общается с Telegram.
+WiFiUDP relayUdp;
+
+uint32_t relayIp(IPAddress ip) {
+  return (uint32_t)ip[0] << 24 | (uint32_t)ip[1] << 16 | (uint32_t)ip[2] << 8 | ip[3];
+}
+
+IPAddress relayIp(uint32_t ip) {
+  return IPAddress(ip >> 24, ip >> 16, ip >> 8, ip);
+}
+
+bool relayWake(const RelayJob& job, void* ctx) {
+  uint8_t packet[WOL_PACKET_SIZE];
+  buildMagicPacket(job.mac, packet);
+  
+  IPAddress target = job.ip ? relayIp(job.ip) : WiFi.broadcastIP();
+  bool ok = true;
+  for (int i = 0; i < (job.param ? job.param : 1); i++) {
+    relayUdp.beginPacket(target, job.port);
+    relayUdp.write(packet, sizeof(packet));
+    ok &= (relayUdp.endPacket() == 1);
+  }
+  return ok;
+}
+
+bool relayProbe(const RelayJob& job, void* ctx) {
   WiFiClient client;
-  bool portOpen = client.connect(serverIP, 22, 1000); // Проверяем порт 22 (SSH)
+  bool open = client.connect(relayIp(job.ip), job.port, job.param ? job.param : RELAY_DEFAULT_PROBE_TIMEOUT);
   client.stop();
+  return open;
+}
+
+void relayReply(const uint8_t* data, size_t len, void* ctx) {
+  relayUdp.beginPacket(relayUdp.remoteIP(), relayUdp.remotePort());
+  relayUdp.write(data, len);
+  relayUdp.endPacket();
+}
+
+uint32_t relayMicros(void* ctx) {
+  return micros();
+}
+
+const RelayNode::Hooks relayHooks = {relayWake, relayProbe, relayReply, relayMicros, NULL};
+RelayNode relayNode(RELAY_KEY, RELAY_NODE_ID, relayHooks);
+
+void serviceRelayNode() {
+  uint8_t buffer[RELAY_MAX_DATAGRAM];
+  while (relayUdp.parsePacket() > 0) {
+    int len = relayUdp.read(buffer, sizeof(buffer));
+    if (len <= 0) continue;
+    
+    int ran = relayNode.handle(buffer, len);
+    if (ran < 0) {
+      LOG_WARN("⛔ Ретранслятор: отклонена датаграмма от %u.%u.%u.%u", relayUdp.remoteIP()[0], relayUdp.remoteIP()[1], relayUdp.remoteIP()[2], relayUdp.remoteIP()[3]);
+    } else {
+      LOG_INFO("📡 Ретранслятор: выполнены задания от %u.%u.%u.%u", relayUdp.remoteIP()[0], relayUdp.remoteIP()[1], relayUdp.remoteIP()[2], relayUdp.remoteIP()[3]);
+    }
+  }
+}
+
+// Одна сессия на загрузку из счетчика в NVS: ретрансляторы отвергают старые
+// сессии, поэтому перехваченный пакет нельзя проиграть после перезагрузки
+uint32_t nextRelaySession() {
+  uint32_t session = prefs.getULong("relaySession", 0) + 1;
+  prefs.putULong("relaySession", session);
+  return session;
+}
+
+RelayDispatcher& relayDispatcher() {
+  static RelayDispatcher dispatcher(RELAY_KEY, RELAY_NODE_ID, nextRelaySession());
+  return dispatcher;
+}
+
+void relaySend(uint8_t relay, const uint8_t* data, size_t len, void* ctx) {
+  relayUdp.beginPacket(relaySegments[relay].relayIP, RELAY_PORT);
+  relayUdp.write(data, len);
+  relayUdp.endPacket();
+}
+
+// Runs one fleet-wide dispatch and returns the report for Telegram
+String runFleet(bool wake) {
+  const int targetCount = sizeof(relayTargets) / sizeof(relayTargets[0]);
+  const int segmentCount = sizeof(relaySegments) / sizeof(relaySegments[0]);
+  RelayDispatcher& dispatcher = relayDispatcher();
+  dispatcher.reset();
+  for (int seg = 0; seg < segmentCount; seg++) dispatcher.setRelayNode(seg, relaySegments[seg].relayNode);
+  int jobTarget[RelayDispatcher::MAX_JOBS];
+  
+  for (int t = 0; t < targetCount; t++) {
+    const RelayTarget& target = relayTargets[t];
+    RelayJob job = {};
+    if (wake) {
+      if (!parseMac(target.mac, job.mac)) {
+        LOG_WARN("❌ Ретранслятор: неверный MAC для %s", target.name);
+        continue;
+      }
+      job.type = RELAY_JOB_WAKE;
+      job.ip = relayIp(target.broadcast);
+      job.port = 9;
+      job.param = 1;
+    } else {
+      job.type = RELAY_JOB_PROBE;
+      job.ip = relayIp(target.ip);
+      job.port = target.probePort;
+      job.param = WATCH_PROBE_TIMEOUT;
+    }
+    int index = dispatcher.add(target.segment, job);
+    if (index >= 0) jobTarget[index] = t;
+  }
+  
+  // All segments get their datagram back-to-back, then results stream in
+  unsigned long start = millis();
+  unsigned long lastSend = start;
+  int datagrams = dispatcher.transmit(relaySend, NULL, start);
+  uint8_t buffer[RELAY_MAX_DATAGRAM];
+  
+  while (!dispatcher.done() && millis() - start < RELAY_TIMEOUT) {
+    if (relayUdp.parsePacket() > 0) {
+      int len = relayUdp.read(buffer, sizeof(buffer));
+      if (len > 0) dispatcher.receive(buffer, len, millis());
+      continue;
+    }
+    if (millis() - lastSend >= RELAY_RETRY) {
+      lastSend = millis();
+      datagrams += dispatcher.transmit(relaySend, NULL, lastSend);
+    }
+    delay(1);
+  }
+  
+  int ok = 0;
+  String report = wake ? "🌐 Пробуждение флота:\n" : "🌐 Проверка флота:\n";
+  for (int seg = 0; seg < segmentCount; seg++) {
+    report += "\n📍 " + String(relaySegments[seg].name) + " (" + relaySegments[seg].relayIP.toString() + "):\n";
+    for (int i = 0; i < dispatcher.jobCount(); i++) {
+      if (dispatcher.relayOf(i) != seg) continue;
+      
+      const RelayResult& result = dispatcher.result(i);
+      if (result.status == RELAY_OK) ok++;
+      report += "• " + String(relayTargets[jobTarget[i]].name) + " ";
+      
+      if (result.status == RELAY_PENDING) {
+        report += "⏰ ретранслятор не ответил\n";
+      } else if (wake) {
+        report += result.status == RELAY_OK ? "✅ отправлен" : "❌ ошибка отправки";
+        report += ", " + String(dispatcher.latencyMs(i)) + " ms\n";
+      } else {
+        report += result.status == RELAY_OK ? "✅ онлайн" : "❌ оффлайн";
+        report += ", " + String(dispatcher.latencyMs(i)) + " ms\n";
+      }
+    }
+  }
+  
+  unsigned long elapsed = millis() - start;
+  report += "\n⏱️ " + String(dispatcher.jobCount()) + " заданий, " + String(datagrams);
+  report += " датаграмм, " + String(elapsed) + " ms";
+  LOG_INFO("🌐 Флот, %s: %d/%d OK, %d датаграмм, %lu мс", wake ? "пробуждение" : "проверка", ok, dispatcher.jobCount(), datagrams, elapsed);
+  return report;
+}
+
+// ========== ПОСЛЕДОВАТЕЛЬНОСТИ ПРОБУЖДЕНИЯ ==========
+// Одновременно выполняется один план через машину состояний WakeSequencer.
+// Каждый проход цикла продвигает ее на один шаг; прогресс и итоговый отчет с
+// критическим путем уходят в чат, который запустил план.
+const int SEQUENCE_HOST_COUNT = sizeof(sequenceHosts) / sizeof(sequenceHosts[0]);
+const int SEQUENCE_PLAN_COUNT = sizeof(sequencePlans) / sizeof(sequencePlans[0]);
+int sequenceRunning = -1;                     // Индекс в sequencePlans, -1 = нет
+uint8_t sequenceHostOf[SEQ_MAX_HOSTS];        // Хост секвенсора → индекс в sequenceHosts
+SeqHostState sequenceReported[SEQ_MAX_HOSTS]; // Последнее состояние, отправленное в чат
+String sequenceChatID;
+
+bool sequenceWake(uint8_t host, void* ctx) {
+  TRACE_SPAN("sequence.wake");
+  uint8_t mac[WOL_MAC_SIZE];
+  if (!parseMac(sequenceHosts[sequenceHostOf[host]].mac, mac)) return false;
+  uint8_t packet[WOL_PACKET_SIZE];
+  buildMagicPacket(mac, packet);
+  
+  bool sent = false;
+  for (int a = 0; a < WOL_BROADCAST_COUNT; a++) {
+    for (int p = 0; p < WOL_PORT_COUNT; p++) {
+      wolUdp.beginPacket(wolBroadcasts[a], wolPorts[p]);
+      wolUdp.write(packet, sizeof(packet));
+      sent |= (wolUdp.endPacket() == 1);
+    }
+  }
+  return sent;
+}
+
+// Присоединяется к проверке доступности хоста, которая начинает с probePort.
+// Результат за последний интервал проверки используется повторно.
+SeqProbe sequenceProbe(uint8_t host, void* ctx) {
+  TRACE_SPAN("sequence.probe");
+  const SequenceHost& h = sequenceHosts[sequenceHostOf[host]];
+  const LivenessEntry* result = livenessSince(h.ip, millis() - SEQUENCE_PROBE_INTERVAL * 1000UL);
+  if (!result) {
+    livenessRequest(h.ip, h.probePort);
+    return SEQ_PROBE_PENDING;
+  }
+  return result->online && result->port == h.probePort ? SEQ_PROBE_UP : SEQ_PROBE_DOWN;
+}
+
+WakeSequencer sequencer(
+  WakeSequencer::Hooks{sequenceWake, sequenceProbe, NULL},
+  WakeSequencer::Config{SEQUENCE_MAX_POWERING, SEQUENCE_STAGGER * 1000UL,
+                        SEQUENCE_PROBE_INTERVAL * 1000UL, SEQUENCE_BOOT_TIMEOUT * 1000UL});
+
+// Следующее имя из списка через запятую как индекс в sequenceHosts: -1 неизвестно, -2 конец
+int nextSequenceHost(const char*& list, String& name) {
+  while (*list == ',' || *list == ' ') list++;
+  if (!*list) return -2;
+  
+  const char* end = list;
+  while (*end && *end != ',' && *end != ' ') end++;
+  name = String(list).substring(0, end - list);
+  list = end;
+  
+  for (int i = 0; i < SEQUENCE_HOST_COUNT; i++) {
+    if (name == sequenceHosts[i].name) return i;
+  }
+  return -1;
+}
+
+String sequenceSeconds(uint32_t ms) {
+  return String((ms + 500) / 1000);
+}
+
+// Собирает план со всеми зависимостями, возвращает текст ошибки или ""
+String startSequence(int plan) {
+  bool wanted[SEQUENCE_HOST_COUNT] = {};
+  String name;
+  const char* list = sequencePlans[plan].hosts;
+  for (int h; (h = nextSequenceHost(list, name)) != -2;) {
+    if (h < 0) return "неизвестный хост " + name;
+    wanted[h] = true;
+  }
+  
+  for (bool added = true; added;) {
+    added = false;
+    for (int i = 0; i < SEQUENCE_HOST_COUNT; i++) {
+      if (!wanted[i]) continue;
+      list = sequenceHosts[i].after;
+      for (int h; (h = nextSequenceHost(list, name)) != -2;) {
+        if (h < 0) return "неизвестная зависимость " + name + " у " + sequenceHosts[i].name;
+        if (!wanted[h]) added = true;
+        wanted[h] = true;
+      }
+    }
+  }
+  
+  int indexOf[SEQUENCE_HOST_COUNT];
+  int count = 0;
+  for (int i = 0; i < SEQUENCE_HOST_COUNT; i++) {
+    indexOf[i] = wanted[i] ? count++ : -1;
+  }
+  if (count > SEQ_MAX_HOSTS) return "слишком много хостов";
+  
+  sequencer.reset();
+  for (int i = 0; i < SEQUENCE_HOST_COUNT; i++) {
+    if (!wanted[i]) continue;
+    uint32_t dependsOn = 0;
+    list = sequenceHosts[i].after;
+    for (int h; (h = nextSequenceHost(list, name)) != -2;) dependsOn |= 1UL << indexOf[h];
+    sequenceHostOf[sequencer.addHost(dependsOn)] = i;
+    sequenceReported[indexOf[i]] = SEQ_WAITING;
+  }
+  
+  if (!sequencer.start(millis())) return "циклическая зависимость";
+  sequenceRunning = plan;
+  return "";
+}
+
+String sequenceReport() {
+  String report = "🧩 Последовательность \"" + String(sequencePlans[sequenceRunning].name) + "\" завершена за ";
+  report += sequenceSeconds(sequencer.finishMs() - sequencer.startMs()) + " сек:\n\n";
+  
+  for (int i = 0; i < sequencer.hostCount(); i++) {
+    const WakeSequencer::Host& h = sequencer.host(i);
+    report += "• " + String(sequenceHosts[sequenceHostOf[i]].name) + ": ";
+    if (h.state == SEQ_SKIPPED) {
+      report += "⏭️ пропущен, сбой зависимости\n";
+    } else if (h.wasOnline) {
+      report += "✅ уже был включен\n";
+    } else {
+      report += h.state == SEQ_ONLINE ? "✅ " : "❌ сбой, ";
+      report += "зависимости " + sequenceSeconds(h.readyMs - sequencer.startMs());
+      report += " + очередь " + sequenceSeconds(h.wokeMs - h.readyMs);
+      report += " + загрузка " + sequenceSeconds(h.doneMs - h.wokeMs) + " сек\n";
+    }
+  }
+  
+  // Каждый этап критического пути: его завершение минус предыдущее
+  uint8_t path[SEQ_MAX_HOSTS];
+  int length = sequencer.criticalPath(path, SEQ_MAX_HOSTS);
+  if (length > 0) {
+    report += "\n🏁 Критический путь: ";
+    uint32_t previous = sequencer.startMs();
+    for (int i = 0; i < length; i++) {
+      const WakeSequencer::Host& h = sequencer.host(path[i]);
+      if (i > 0) report += " → ";
+      report += String(sequenceHosts[sequenceHostOf[path[i]]].name) + " " + sequenceSeconds(h.doneMs - previous) + "с";
+      previous = h.doneMs;
+    }
+    report += " = " + sequenceSeconds(previous - sequencer.startMs()) + " сек";
+  }
+  return report;
+}
+
+void serviceSequence() {
+  if (sequenceRunning < 0) return;
+  bool running = sequencer.step(millis());
+  
+  String progress = "";
+  for (int i = 0; i < sequencer.hostCount(); i++) {
+    const WakeSequencer::Host& h = sequencer.host(i);
+    if (h.state == sequenceReported[i] || h.state == SEQ_READY) continue;
+    sequenceReported[i] = h.state;
+    
+    String name = sequenceHosts[sequenceHostOf[i]].name;
+    if (h.state == SEQ_POWERING) {
+      progress += "⚡ " + name + ": WoL отправлен\n";
+    } else if (h.state == SEQ_ONLINE && !h.wasOnline) {
+      progress += "✅ " + name + ": включен через " + sequenceSeconds(h.doneMs - h.wokeMs) + " сек\n";
+    } else if (h.state == SEQ_FAILED) {
+      progress += "❌ " + name + ": не включился\n";
+    }
+  }
+  
+  if (running) {
+    if (progress != "") sendTelegram(sequenceChatID, progress);
+    return;
+  }
+  
+  String report = sequenceReport();
+  sendTelegram(sequenceChatID, report);
+  int online = 0;
+  for (int i = 0; i < sequencer.hostCount(); i++) online += sequencer.host(i).state == SEQ_ONLINE;
+  LOG_INFO("🧩 Последовательность %s: %d/%d в сети за %lu мс", sequencePlans[sequenceRunning].name, online,
+           sequencer.hostCount(), (unsigned long)(sequencer.finishMs() - sequencer.startMs()));
+  sequenceRunning = -1;
+}
+
+// ========== ПРОБУЖДЕНИЕ ПО РАСПИСАНИЮ ==========
+// План (ближайшее срабатывание среди всех расписаний) считается только при
+// изменении расписания, срабатывании или синхронизации часов по SNTP. Между
+// событиями цикл тратит одно сравнение времени.
+bool clockSynced() {
+  return time(NULL) > 1700000000; // SNTP has set the clock
+}
+
+// "dd.mm HH:MM", for log lines that must not allocate
+void formatTime(time_t t, char* out, size_t cap) {
+  struct tm tm;
+  localtime_r(&t, &tm);
+  strftime(out, cap, "%d.%m %H:%M", &tm);
+}
+
+String formatTime(time_t t) {
+  char text[24];
+  formatTime(t, text, sizeof(text));
+  return String(text);
+}
+
+unsigned long scheduleLeadSeconds() {
+  return bootEstimateMs / 1000 + SCHEDULE_MARGIN;
+}
+
+void onTimeSync(struct timeval* tv) {
+  schedulePlanDirty = true;
+}
+
+void loadSchedules() {
+  scheduleCount = 0;
+  size_t size = prefs.getBytes("schedules", schedules, sizeof(schedules));
+  for (int i = 0; i < (int)(size / sizeof(WakeSchedule)); i++) {
+    schedules[i].cron[sizeof(schedules[i].cron) - 1] = '\0';
+    schedules[i].chatId[sizeof(schedules[i].chatId) - 1] = '\0';
+    if (parseCron(schedules[i].cron, scheduleSpecs[scheduleCount])) {
+      schedules[scheduleCount++] = schedules[i];
+    }
+  }
+  bootEstimateMs = prefs.getULong("bootMs", DEFAULT_BOOT_TIME * 1000UL);
+  schedulePlanDirty = true;
+}
+
+void saveSchedules() {
+  prefs.putBytes("schedules", schedules, scheduleCount * sizeof(WakeSchedule));
+  schedulePlanDirty = true;
+}
+
+void planSchedules() {
+  schedulePlanDirty = false;
+  nextScheduleFire = 0;
+  nextScheduleIndex = -1;
+  if (!clockSynced()) return;
+  
+  // The first ready-by time that can still be reached from now
+  time_t lead = scheduleLeadSeconds();
+  time_t now = time(NULL);
+  for (int i = 0; i < scheduleCount; i++) {
+    time_t readyBy = cronNextAfter(scheduleSpecs[i], now + lead);
+    if (readyBy && (nextScheduleIndex < 0 || readyBy - lead < nextScheduleFire)) {
+      nextScheduleFire = readyBy - lead;
+      nextScheduleReady = readyBy;
+      nextScheduleIndex = i;
+    }
+  }
+  
+  if (nextScheduleIndex >= 0) {
+    char fireAt[24];
+    formatTime(nextScheduleFire, fireAt, sizeof(fireAt));
+    LOG_INFO("📅 Следующий WoL по расписанию: %s, за %lu с до готовности", logCopy(fireAt),
+             (unsigned long)(nextScheduleReady - nextScheduleFire));
+  }
+}
+
+void checkSchedules() {
+  if (schedulePlanDirty) planSchedules();
+  if (nextScheduleIndex < 0 || time(NULL) < nextScheduleFire) return;
+  
+  const WakeSchedule& schedule = schedules[nextScheduleIndex];
+  time_t readyBy = nextScheduleReady;
+  schedulePlanDirty = true;
+  
+  // A manual wake already running takes over the target
+  if (isMonitoring) {
+    scheduledReadyBy = readyBy;
+    return;
+  }
+  
+  wakeCommandTime = millis();
+  lastProgressUpdate = 0;
+  if (sendWOL()) {
+    isMonitoring = true;
+    bootTimelineStart();
+    monitoringChatID = schedule.chatId;
+    scheduledReadyBy = readyBy;
+    
+    String msg = "📅 Пробуждение по расписанию (" + String(schedule.cron) + ")\n\n";
+    msg += "• Готовность к: " + formatTime(readyBy) + "\n";
+    msg += "• WoL отправлен за " + String(scheduleLeadSeconds()) + " сек (загрузка ";
+    msg += String(bootEstimateMs / 1000) + " + запас " + String(SCHEDULE_MARGIN) + ")";
+    sendTelegram(monitoringChatID, msg);
+  } else {
+    sendTelegram(schedule.chatId, "❌ Пробуждение по расписанию: ошибка отправки WoL");
+  }
+}
+
+// Updates the boot estimate: slower boots count in full, faster ones are averaged in
+void recordBootTime(unsigned long wolToBootMs) {
+  if (wolToBootMs > bootEstimateMs) {
+    bootEstimateMs = wolToBootMs;
+  } else {
+    bootEstimateMs = (bootEstimateMs * 3 + wolToBootMs) / 4;
+  }
+  prefs.putULong("bootMs", bootEstimateMs);
+  schedulePlanDirty = true;
+}
+
+// Target line for the boot report of a scheduled wake, empty for manual ones
+String scheduleTargetReport(bool booted) {
+  if (!scheduledReadyBy) return "";
+  
+  long slack = (long)(scheduledReadyBy - time(NULL));
+  String report = "\n\n";
+  if (booted && slack >= 0) {
+    report += "🎯 Цель достигнута: готов за " + String(slack) + " сек до " + formatTime(scheduledReadyBy);
+  } else if (booted) {
+    report += "⚠️ Цель пропущена: готов на " + String(-slack) + " сек позже " + formatTime(scheduledReadyBy);
+  } else {
+    report += "⚠️ Цель пропущена: не готов к " + formatTime(scheduledReadyBy);
+  }
+  scheduledReadyBy = 0;
+  return report;
+}
+
+// ========== ХРОНОЛОГИЯ ЗАГРУЗКИ ==========
+// Дешевые этапы проверяются на каждом проходе цикла: ARP читается из таблицы
+// lwIP, ICMP идет фоновой сессией esp_ping, которая засекает первый ответ.
+// SSH и сервис проверяются каждый тик мониторинга, когда ARP уже виден.
+struct ArpLookup {
+  struct tcpip_api_call_data call;
+  ip4_addr_t ip;
+  bool flush;
+  bool found;
+};
+
+// Выполняется в потоке lwIP: ищем хост и повторяем запрос, если его нет
+err_t arpLookupTcpip(struct tcpip_api_call_data* call) {
+  ArpLookup* lookup = (ArpLookup*)call;
+  if (!netif_default) return ERR_OK;
+  if (lookup->flush) etharp_cleanup_netif(netif_default);
+  
+  struct eth_addr* mac;
+  const ip4_addr_t* ip;
+  lookup->found = etharp_find_addr(netif_default, &lookup->ip, &mac, &ip) >= 0;
+  if (!lookup->found) etharp_request(netif_default, &lookup->ip);
+  return ERR_OK;
+}
+
+bool arpLookup(IPAddress ip, bool flush) {
+  ArpLookup lookup = {};
+  IP4_ADDR(&lookup.ip, ip[0], ip[1], ip[2], ip[3]);
+  lookup.flush = flush;
+  tcpip_api_call(arpLookupTcpip, &lookup.call);
+  return lookup.found;
+}
+
+void onBootPingReply(esp_ping_handle_t session, void* args) {
+  if (!icmpReplyAt) icmpReplyAt = millis();
+}
+
+void bootPingStop() {
+  if (!bootPing) return;
+  esp_ping_stop(bootPing);
+  esp_ping_delete_session(bootPing);
+  bootPing = NULL;
+}
+
+void bootTimelineStart() {
+  for (int i = 0; i < STAGE_COUNT; i++) bootStageAt[i] = 0;
+  icmpReplyAt = 0;
+  bootProbeAt = 0;
   
-  if (portOpen) {
-    Serial.println("✅ Порт 22 (SSH) открыт - сервер жив");
-    return true;
+  // Старая ARP запись до выключения подделала бы первый этап
+  arpLookup(serverIP, true);
+  
+  bootPingStop();
+  esp_ping_config_t config = ESP_PING_DEFAULT_CONFIG();
+  IP_ADDR4(&config.target_addr, serverIP[0], serverIP[1], serverIP[2], serverIP[3]);
+  config.count = ESP_PING_COUNT_INFINITE;
+  config.interval_ms = 1000;
+  config.timeout_ms = 1000;
+  esp_ping_callbacks_t callbacks = {};
+  callbacks.on_ping_success = onBootPingReply;
+  if (esp_ping_new_session(&config, &callbacks, &bootPing) == ESP_OK) {
+    esp_ping_start(bootPing);
+  } else {
+    bootPing = NULL;
+  }
+}
+
+bool healthCheck() {
+  if (HEALTH_HTTP_PATH[0]) {
+    HTTPClient http;
+    http.begin("http://" + serverIP.toString() + ":" + String(HEALTH_PORT) + HEALTH_HTTP_PATH);
+    http.setTimeout(2000);
+    int httpCode = http.GET();
+    http.end();
+    return HEALTH_HTTP_STATUS ? httpCode == HEALTH_HTTP_STATUS : httpCode > 0;
   }
   
-  // Проверяем порт 80 напрямую через TCP
-  bool port80Open = client.connect(serverIP, 80, 1000);
+  WiFiClient client;
+  if (!client.connect(serverIP, HEALTH_PORT, WATCH_PROBE_TIMEOUT)) return false;
+  client.setTimeout(1000);
+  String banner = client.readStringUntil('\n');
   client.stop();
+  return banner.startsWith(HEALTH_BANNER);
+}
+
+void markStage(int stage, unsigned long at) {
+  if (bootStageAt[stage]) return;
+  bootStageAt[stage] = at;
+  LOG_INFO("🔎 Этап %s через %lu мс", bootStageNames[stage], at - wolSentTime);
+}
+
+void checkEarlyStages() {
+  if (!bootStageAt[STAGE_ARP] && arpLookup(serverIP, false)) markStage(STAGE_ARP, millis());
+  if (icmpReplyAt) {
+    markStage(STAGE_ICMP, icmpReplyAt);
+    bootPingStop();
+  }
+}
+
+// Возвращает true, когда достигнут этап сервиса
+bool checkBootStages() {
+  TRACE_SPAN("boot.stages");
+  if (!bootStageAt[STAGE_ARP]) return false;
+  
+  // SSH берется из общей проверки доступности, которая начинает с
+  // BOOT_SSH_PORT. Результат приходит в одном из следующих проходов,
+  // checkServerMonitoring() вызывает нас до тех пор.
+  if (!bootProbeAt) bootProbeAt = millis();
+  const LivenessEntry* result = livenessSince(serverIP, bootProbeAt);
+  if (!result) {
+    livenessRequest(serverIP, BOOT_SSH_PORT);
+    return false;
+  }
+  bootProbeAt = 0;
+  if (!result->online) return false;
+  if (result->port == BOOT_SSH_PORT) markStage(STAGE_SSH, result->checkedAt);
   
-  if (port80Open) {
-    Serial.println("✅ Порт 80 (HTTP) открыт - сервер жив");
-    return true;
+  // Этапу сервиса нужно само приложение, а не просто открытый порт
+  if (healthCheck()) {
+    markStage(STAGE_SERVICE, millis());
+    livenessRecord(serverIP, true, HEALTH_PORT);
+  }
+  return bootStageAt[STAGE_SERVICE] != 0;
+}
+
+void loadBootHistory() {
+  bootHistoryCount = prefs.getBytes("boots", bootHistory, sizeof(bootHistory)) / sizeof(BootRecord);
+}
+
+// Сохраняет завершенную хронологию, новые первыми
+void recordBootTimeline() {
+  bootPingStop();
+  for (int i = BOOT_HISTORY - 1; i > 0; i--) bootHistory[i] = bootHistory[i - 1];
+  bootHistory[0].wolAt = clockSynced() ? time(NULL) - (millis() - wolSentTime) / 1000 : 0;
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    bootHistory[0].stageMs[i] = bootStageAt[i] ? bootStageAt[i] - wolSentTime : 0;
+  }
+  if (bootHistoryCount < BOOT_HISTORY) bootHistoryCount++;
+  prefs.putBytes("boots", bootHistory, bootHistoryCount * sizeof(BootRecord));
+}
+
+String bootSeconds(uint32_t ms) {
+  return String(ms / 1000.0, 1);
+}
+
+// Фаза этапа: от предыдущего появившегося этапа (или WoL) до этого
+uint32_t bootPhaseMs(const BootRecord& record, int stage) {
+  uint32_t previous = 0;
+  for (int i = 0; i < stage; i++) {
+    if (record.stageMs[i]) previous = record.stageMs[i];
   }
+  return record.stageMs[stage] ? record.stageMs[stage] - previous : 0;
+}
+
+// Разбивка по фазам последней хронологии против среднего по прошлым
+String bootTimelineReport() {
+  const BootRecord& latest = bootHistory[0];
+  String report = "🧭 Фазы загрузки:\n";
+  const char* const phaseNames[STAGE_COUNT] = {"WoL→ARP (POST, сетевая)", "ARP→ICMP (ядро)", "ICMP→SSH (службы)", "SSH→Сервис (приложение)"};
   
-  Serial.println("❌ Сервер не отвечает ни на один порт");
-  return false;
+  for (int stage = 0; stage < STAGE_COUNT; stage++) {
+    report += "• " + String(phaseNames[stage]) + ": ";
+    if (!latest.stageMs[stage]) {
+      report += "не было\n";
+      continue;
+    }
+    report += bootSeconds(bootPhaseMs(latest, stage)) + " с";
+    
+    uint32_t sum = 0;
+    int count = 0;
+    for (int i = 1; i < bootHistoryCount; i++) {
+      if (!bootHistory[i].stageMs[stage]) continue;
+      sum += bootPhaseMs(bootHistory[i], stage);
+      count++;
+    }
+    if (count > 0) report += " (в среднем " + bootSeconds(sum / count) + ")";
+    report += "\n";
+  }
+  return report;
 }
 
 // ========== МОНИТОРИНГ ЗАГРУЗКИ ==========
@@ -150,27 +1347,22 @@ void checkServerMonitoring() {
     
     // Прогресс-бар (ИСПРАВЛЕНА СТРОКА С min)
     int progressPercent = std::min(100, static_cast<int>((elapsedSeconds * 100) / MAX_WAIT_TIME));
-    progressMsg += "[";
-    for (int i = 0; i < 10; i++) {
-      progressMsg += (i < progressPercent / 10) ? "█" : "░";
-    }
-    progressMsg += "] " + String(progressPercent) + "%";
+    char bar[48];
+    renderProgress(progressPercent, bar, sizeof(bar));
+    progressMsg += bar;
     
-    sendTelegram(monitoringChatID, progressMsg);
-    Serial.print("📊 Прогресс: ");
-    Serial.print(elapsedSeconds);
-    Serial.print(" сек (");
-    Serial.print(progressPercent);
-    Serial.println("%)");
+    sendMonitoring(progressMsg);
+    LOG_INFO("📊 Прогресс: %lu сек (%d%%)", elapsedSeconds, progressPercent);
   }
   
-  // Проверяем сервер каждые CHECK_INTERVAL секунд
-  if (elapsedSeconds % CHECK_INTERVAL == 0) {
-    Serial.print("🔍 Проверка сервера... ");
-    Serial.print(elapsedSeconds);
-    Serial.println(" сек");
+  // ARP и ICMP ничего не стоят, пропущенный тик размыл бы хронологию
+  checkEarlyStages();
+  
+  // Проверяем сервер каждые CHECK_INTERVAL секунд и в каждом проходе, пока идет его проверка
+  if (elapsedSeconds % CHECK_INTERVAL == 0 || bootProbeAt) {
+    if (!bootProbeAt) LOG_DEBUG("🔍 Проверка сервера... %lu сек", elapsedSeconds);
     
-    if (isServerOnline()) {
+    if (checkBootStages()) {
       // Сервер загрузился!
       unsigned long totalBootTime = (currentTime - wakeCommandTime) / 1000;
       unsigned long wolToBootTime = (currentTime - wolSentTime) / 1000;
@@ -180,7 +1372,7 @@ void checkServerMonitoring() {
       successMsg += "• Общее время: " + String(totalBootTime) + " сек\n";
       successMsg += "• WoL→Загрузка: " + String(wolToBootTime) + " сек\n";
       successMsg += "• IP: " + serverIP.toString() + "\n";
-      successMsg += "• MAC: " + serverMAC + "\n\n";
+      successMsg += "• MAC: " + String(serverMAC) + "\n\n";
       
       if (wolToBootTime < 30) {
         successMsg += "⚡ Быстрая загрузка!";
@@ -190,12 +1382,15 @@ void checkServerMonitoring() {
         successMsg += "⚠️ Долгая загрузка, проверьте сервер";
       }
       
-      sendTelegram(monitoringChatID, successMsg);
+      recordBootTimeline();
+      successMsg += "\n\n" + bootTimelineReport();
+      successMsg += scheduleTargetReport(true);
+      sendMonitoring(successMsg);
       isMonitoring = false;
+      watchMarkUp(serverIP);
+      recordBootTime(currentTime - wolSentTime);
       
-      Serial.print("✅ Сервер загрузился за ");
-      Serial.print(totalBootTime);
-      Serial.println(" секунд");
+      LOG_INFO("✅ Сервер загрузился за %lu секунд", totalBootTime);
     }
     else if (elapsedSeconds >= MAX_WAIT_TIME) {
       // Таймаут
@@ -209,96 +1404,415 @@ void checkServerMonitoring() {
       timeoutMsg += "4. Долгая POST-проверка\n\n";
       timeoutMsg += "Попробуйте команду /wake ещё раз";
       
-      sendTelegram(monitoringChatID, timeoutMsg);
+      recordBootTimeline();
+      timeoutMsg += "\n\n" + bootTimelineReport();
+      timeoutMsg += scheduleTargetReport(false);
+      sendMonitoring(timeoutMsg);
       isMonitoring = false;
       
-      Serial.println("❌ Мониторинг: таймаут");
+      LOG_WARN("❌ Мониторинг: таймаут");
+    }
+  }
+}
+
+// ========== SLEEP PROXY ==========
+// Каждый кадр от Wi-Fi драйвера проходит через sleepProxyInput() до lwIP.
+// Это задача драйвера, поэтому она никогда не ждет: мьютекс прокси берется без
+// блокировки, ARP ответы ставятся в очередь для потока lwIP, а пробуждения и
+// передача адреса только отмечаются для loop.
+const int PROXY_PORT_COUNT = sizeof(proxyPorts) / sizeof(proxyPorts[0]);
+struct netif* proxyNetif = NULL;           // Задан после установки прокси
+netif_input_fn proxyStackInput = NULL;     // Собственный вход lwIP для кадров, которые прокси не берет
+SemaphoreHandle_t proxyLock = NULL;
+const size_t PROXY_INSPECT_SIZE = 128;     // Байты кадра, которые читает прокси: Ethernet, IPv4 с опциями, порты и флаги TCP
+QueueHandle_t proxyTxQueue = NULL;         // ARP кадры прокси, отправляет proxyFlush()
+TaskHandle_t loopTask = NULL;
+volatile bool proxyWakePending = false;
+volatile bool proxyHandoverPending = false;
+unsigned long proxyWakeMicros = 0;         // micros() SYN, запросившего пробуждение
+uint32_t proxyWakeClient = 0;
+uint16_t proxyWakePort = 0;
+SleepProxy::Event proxyEvent;              // Последняя завершенная сессия прокси
+unsigned long proxySynToWol = 0;           // мкс, последнее пробуждение через прокси
+int proxyConfirmLeft = 0;                  // Сколько ARP запросов осталось до start(), 0 = не проверяем
+unsigned long proxyConfirmAt = 0;          // millis() последнего из них
+
+struct ProxyFrame {
+  uint8_t data[PROXY_ARP_FRAME_SIZE];
+};
+
+// Выполняется в потоке lwIP
+void proxyFlush(void* ctx) {
+  ProxyFrame frame;
+  while (xQueueReceive(proxyTxQueue, &frame, 0) == pdTRUE) {
+    struct pbuf* p = pbuf_alloc(PBUF_RAW, sizeof(frame.data), PBUF_RAM);
+    if (!p) continue;
+    pbuf_take(p, frame.data, sizeof(frame.data));
+    proxyNetif->linkoutput(proxyNetif, p);
+    pbuf_free(p);
+  }
+}
+
+// Прокси отправляет только ARP кадры. При полной очереди кадр теряется,
+// клиент спросит снова.
+void proxyTransmit(const uint8_t* frame, size_t len, void* ctx) {
+  ProxyFrame queued;
+  if (len != sizeof(queued.data)) return;
+  memcpy(queued.data, frame, len);
+  if (xQueueSend(proxyTxQueue, &queued, 0) == pdTRUE) tcpip_try_callback(proxyFlush, NULL);
+}
+
+void proxyWake(uint8_t host, uint32_t client, uint16_t port, void* ctx) {
+  proxyWakeMicros = micros();
+  proxyWakeClient = client;
+  proxyWakePort = port;
+  proxyWakePending = true;
+  xTaskNotifyGive(loopTask);
+}
+
+void proxyHandover(uint8_t host, const SleepProxy::Event& event, void* ctx) {
+  proxyEvent = event;
+  proxyHandoverPending = true;
+}
+
+const SleepProxy::Hooks proxyHooks = {proxyTransmit, proxyWake, proxyHandover, NULL};
+
+// Создается при первом обращении, когда Wi-Fi интерфейс уже есть
+SleepProxy& sleepProxy() {
+  static SleepProxy proxy(proxyNetif->hwaddr, proxyHooks, PROXY_WAKE_RETRY * 1000UL);
+  return proxy;
+}
+
+// Кадр, пришедший пока loop держит прокси, уходит в lwIP без проверки:
+// ARP запросы повторяются, SYN передается заново, следующий будет пойман
+err_t sleepProxyInput(struct pbuf* p, struct netif* inp) {
+  if (xSemaphoreTake(proxyLock, 0) != pdTRUE) return proxyStackInput(p, inp);
+  uint8_t frame[PROXY_INSPECT_SIZE];
+  size_t len = pbuf_copy_partial(p, frame, sizeof(frame), 0);
+  bool taken = sleepProxy().input(frame, len, millis());
+  xSemaphoreGive(proxyLock);
+  if (!taken) return proxyStackInput(p, inp);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+// Выполняется в потоке lwIP: ставит прокси перед входом интерфейса
+err_t sleepProxyInstall(struct tcpip_api_call_data* call) {
+  if (!netif_default) return ERR_IF;
+  proxyNetif = netif_default;
+  uint8_t mac[WOL_MAC_SIZE];
+  parseMac(serverMAC, mac);
+  sleepProxy().addHost(relayIp(serverIP), mac, proxyPorts, PROXY_PORT_COUNT);
+  proxyStackInput = proxyNetif->input;
+  proxyNetif->input = sleepProxyInput;
+  return ERR_OK;
+}
+
+void setupSleepProxy() {
+  static struct tcpip_api_call_data call;
+  proxyLock = xSemaphoreCreateMutex();
+  proxyTxQueue = xQueueCreate(4, sizeof(ProxyFrame));
+  loopTask = xTaskGetCurrentTaskHandle();
+  if (tcpip_api_call(sleepProxyInstall, &call) != ERR_OK) {
+    Serial.println("❌ Sleep proxy: нет сетевого интерфейса");
+    return;
+  }
+  Serial.print("💤 Sleep proxy: ");
+  Serial.print(PROXY_PORT_COUNT);
+  Serial.println(" порт(ов), включается после подтвержденного падения сервера");
+}
+
+// Закрытый TCP порт не значит, что сервер отдал свой адрес, а ответы на ARP
+// за живой хост украли бы его трафик. Включение только сбрасывает запись ARP
+// и спрашивает заново; serviceSleepProxy() запускает прокси, когда
+// PROXY_ARP_CONFIRM запросов остались без ответа.
+void sleepProxySet(bool active) {
+  if (!proxyNetif) return;
+  xSemaphoreTake(proxyLock, portMAX_DELAY);
+  ProxyState state = sleepProxy().state(0);
+  if (!active) sleepProxy().release(0, millis());
+  xSemaphoreGive(proxyLock);
+  
+  if (!active) {
+    proxyConfirmLeft = 0;
+  } else if (state == PROXY_OFF && proxyConfirmLeft == 0) {
+    arpLookup(serverIP, true);
+    proxyConfirmLeft = PROXY_ARP_CONFIRM;
+    proxyConfirmAt = millis();
+  }
+}
+
+// Одна проверка ARP за вызов, не раньше чем через секунду после прошлого запроса
+void sleepProxyConfirm() {
+  if (proxyConfirmLeft == 0 || millis() - proxyConfirmAt < 1000) return;
+  proxyConfirmAt = millis();
+  
+  if (arpLookup(serverIP, false)) {
+    proxyConfirmLeft = 0;
+    LOG_WARN("💤 Sleep proxy: %u.%u.%u.%u еще отвечает на ARP, не запускаю", serverIP[0], serverIP[1], serverIP[2], serverIP[3]);
+    return;
+  }
+  if (--proxyConfirmLeft > 0) return;
+  
+  xSemaphoreTake(proxyLock, portMAX_DELAY);
+  sleepProxy().start(0, millis());
+  xSemaphoreGive(proxyLock);
+  LOG_INFO("💤 Sleep proxy: отвечаю за %u.%u.%u.%u", serverIP[0], serverIP[1], serverIP[2], serverIP[3]);
+}
+
+// Будит сервер по пойманному прокси SYN и сообщает о каждой передаче адреса
+void serviceSleepProxy() {
+  if (!proxyNetif) return;
+  sleepProxyConfirm();
+  
+  if (proxyWakePending) {
+    xSemaphoreTake(proxyLock, portMAX_DELAY);
+    proxyWakePending = false;
+    unsigned long synMicros = proxyWakeMicros;
+    IPAddress client = relayIp(proxyWakeClient);
+    uint16_t port = proxyWakePort;
+    xSemaphoreGive(proxyLock);
+    
+    // Уже идущее пробуждение свой WoL отправило
+    if (!isMonitoring) {
+      wakeCommandTime = millis();
+      lastProgressUpdate = 0;
+      commandMicros = synMicros;
+      if (sendWOL()) {
+        proxySynToWol = wolBurst.commandToWolMicros;
+        isMonitoring = true;
+        monitoringChatID = "";
+        bootTimelineStart();
+        
+        String msg = "💤 Sleep proxy: подключение с " + client.toString() + " на порт " + String(port) + "\n";
+        msg += "⚡ WoL отправлен через " + String(proxySynToWol / 1000.0, 2) + " мс после SYN, слежу за загрузкой";
+        notifyAll(msg);
+      }
+    }
+  }
+  
+  if (proxyHandoverPending) {
+    xSemaphoreTake(proxyLock, portMAX_DELAY);
+    proxyHandoverPending = false;
+    SleepProxy::Event event = proxyEvent;
+    xSemaphoreGive(proxyLock);
+    
+    LOG_INFO("🔁 Sleep proxy: адрес передан через %lu мс (%u пробуждений)", (unsigned long)(event.handoverMs - event.startMs), event.wakes);
+    if (event.wakes) {
+      String msg = "🔁 Sleep proxy вернул серверу его адрес\n\n";
+      msg += "• SYN→WoL: " + String(proxySynToWol / 1000.0, 2) + " мс\n";
+      msg += "• SYN→передача: " + String((event.handoverMs - event.synMs) / 1000.0, 1) + " сек";
+      msg += event.released ? " (по пробе)\n" : " (ARP сервера)\n";
+      msg += "• Под прокси: " + String((event.handoverMs - event.startMs) / 60000) + " мин";
+      notifyAll(msg);
     }
   }
 }
 
 // ========== TELEGRAM ФУНКЦИИ ==========
-String getTelegramUpdate() {
+// Забирает до `limit` апдейтов в updateBatch и подтверждает их все следующим
+// offset; возвращает, сколько пришло
+int getTelegramUpdates(int limit = TELEGRAM_BATCH) {
+  TRACE_SPAN("telegram.poll");
   HTTPClient http;
   
-  String url = "https://api.telegram.org/bot" + botToken + "/getUpdates?timeout=1&limit=1";
+  // offset подтверждает все до последнего апдейта, без отдельного запроса на удаление
+  String url = "https://api.telegram.org/bot" + botToken + "/getUpdates?timeout=1&limit=" + String(limit) + "&offset=" + String(lastUpdateId + 1);
   
   http.begin(url);
   http.setTimeout(3000);
   
+  if (http.GET() != 200) {
+    http.end();
+    return 0;
+  }
+  
+  String response = http.getString();
+  updateReceivedMicros = micros();
+  http.end();
+  
+  int count;
+  {
+    TRACE_SPAN("telegram.parse");
+    count = parseTelegramUpdates(response.c_str(), response.length(), updateBatch, limit);
+  }
+  if (count == 0) return 0;
+  
+  // Слишком большой для разбора пакет забирается заново по одному апдейту;
+  // одиночный апдейт, который все равно не влезает, пропускается, а не повторяется вечно
+  if (!updateBatch[0].complete && count > 1) return getTelegramUpdates(1);
+  lastUpdateId = updateBatch[count - 1].updateId;
+  if (!updateBatch[0].complete) LOG_WARN("📨 Апдейт %d слишком большой, пропущен", updateBatch[0].updateId);
+  
+  for (int i = 0; i < count; i++) {
+    if (updateBatch[i].hasMessage) LOG_INFO("📨 Команда: %s", logCopy(updateBatch[i].text));
+  }
+  return count;
+}
+
+// Пропускает все, что уже ждет; следующий опрос подтвердит и последний апдейт
+void clearUpdateHistory() {
+  HTTPClient http;
+  http.begin("https://api.telegram.org/bot" + botToken + "/getUpdates?offset=-1");
   if (http.GET() == 200) {
     String response = http.getString();
-    
-    DynamicJsonDocument doc(2048);
-    DeserializationError error = deserializeJson(doc, response);
-    
-    if (!error) {
-      if (doc.containsKey("result") && doc["result"].size() > 0) {
-        JsonObject result = doc["result"][0];
-        int update_id = result["update_id"].as<int>();
-        
-        lastUpdateId = update_id;
-        
-        if (result.containsKey("message")) {
-          String chatID = result["message"]["chat"]["id"].as<String>();
-          String text = result["message"]["text"].as<String>();
-          
-          Serial.print("📨 Команда: ");
-          Serial.println(text);
-          
-          // Удаляем сообщение из истории
-          String deleteUrl = "https://api.telegram.org/bot" + botToken + 
-                           "/getUpdates?offset=" + String(update_id + 1);
-          HTTPClient http2;
-          http2.begin(deleteUrl);
-          http2.GET();
-          http2.end();
-          
-          http.end();
-          return chatID + "|" + text;
-        }
-      }
+    TelegramUpdate update;
+    if (parseTelegramUpdate(response.c_str(), response.length(), update)) {
+      lastUpdateId = update.updateId;
     }
   }
-  
   http.end();
-  return "";
 }
 
 void sendTelegram(String chatID, String message) {
   if (WiFi.status() != WL_CONNECTED) return;
+  TRACE_SPAN("telegram.send");
   
-  message.replace(" ", "%20");
-  message.replace("\n", "%0A");
+  size_t len = buildSendMessageUrl(botToken.c_str(), chatID.c_str(), message.c_str(), NULL, 0);
+  char* url = (char*)malloc(len + 1);
+  if (!url) return;
+  buildSendMessageUrl(botToken.c_str(), chatID.c_str(), message.c_str(), url, len + 1);
   
   HTTPClient http;
-  String url = "https://api.telegram.org/bot" + botToken + 
-               "/sendMessage?chat_id=" + chatID + "&text=" + message;
-  
   http.begin(url);
+  free(url);
   http.setTimeout(5000);
   http.GET();
   http.end();
 }
 
+struct DocumentStream {
+  WiFiClientSecure* client;   // NULL = только подсчет
+  size_t length;
+  size_t buffered;
+  char buffer[512];           // Мелкие записи уходят одной TLS записью
+};
+
+void documentFlush(DocumentStream& stream) {
+  if (stream.client && stream.buffered) stream.client->write((const uint8_t*)stream.buffer, stream.buffered);
+  stream.buffered = 0;
+}
+
+void documentWrite(const char* text, size_t len, void* ctx) {
+  DocumentStream& stream = *(DocumentStream*)ctx;
+  stream.length += len;
+  if (!stream.client) return;
+  while (len > 0) {
+    size_t chunk = std::min(len, sizeof(stream.buffer) - stream.buffered);
+    memcpy(stream.buffer + stream.buffered, text, chunk);
+    stream.buffered += chunk;
+    text += chunk;
+    len -= chunk;
+    if (stream.buffered == sizeof(stream.buffer)) documentFlush(stream);
+  }
+}
+
+// Отправляет текстовый файл (multipart/form-data sendDocument), который пишет
+// `content`. Он вызывается дважды: первый раз для Content-Length, второй прямо
+// в сокет, поэтому файл не хранится в RAM и оба раза должен выйти одинаковым.
+bool sendTelegramDocument(String chatID, const char* filename,
+                          size_t (*content)(void (*write)(const char* text, size_t len, void* ctx), void* ctx)) {
+  if (WiFi.status() != WL_CONNECTED) return false;
+  TRACE_SPAN("telegram.document");
+  
+  String boundary = "wolbot" + String(micros());
+  String head = "--" + boundary + "\r\nContent-Disposition: form-data; name=\"chat_id\"\r\n\r\n" + chatID + "\r\n";
+  head += "--" + boundary + "\r\nContent-Disposition: form-data; name=\"document\"; filename=\"" + filename + "\"\r\n";
+  head += "Content-Type: application/json\r\n\r\n";
+  String tail = "\r\n--" + boundary + "--\r\n";
+  
+  DocumentStream stream = {};
+  content(documentWrite, &stream);
+  size_t length = head.length() + stream.length + tail.length();
+  
+  WiFiClientSecure client;
+  client.setInsecure();
+  if (!client.connect("api.telegram.org", 443)) return false;
+  client.print("POST /bot" + botToken + "/sendDocument HTTP/1.1\r\nHost: api.telegram.org\r\n");
+  client.print("Content-Type: multipart/form-data; boundary=" + boundary + "\r\n");
+  client.print("Content-Length: " + String(length) + "\r\nConnection: close\r\n\r\n");
+  client.print(head);
+  
+  stream = DocumentStream();
+  stream.client = &client;
+  content(documentWrite, &stream);
+  documentFlush(stream);
+  client.print(tail);
+  
+  // Строка статуса, например "HTTP/1.1 200 OK"
+  unsigned long start = millis();
+  while (client.connected() && !client.available() && millis() - start < 10000) delay(10);
+  String status = client.readStringUntil('\n');
+  client.stop();
+  return status.startsWith("HTTP/1.1 200");
+}
+
+// ========== ТРАССИРОВКА ==========
+void traceToSerial(const char* text, size_t len, void* ctx) {
+  Serial.write((const uint8_t*)text, len);
+}
+
+// По имени спана: количество, общее и наибольшее время
+String traceSummary() {
+  const int MAX_NAMES = 16;
+  const char* names[MAX_NAMES];
+  uint32_t counts[MAX_NAMES] = {};
+  uint64_t totals[MAX_NAMES] = {};
+  uint32_t longest[MAX_NAMES] = {};
+  int nameCount = 0;
+  
+  for (size_t i = 0; i < traceCount(); i++) {
+    const TraceEvent& event = traceEvent(i);
+    if (event.duration == TRACE_INSTANT) continue;
+    int n = 0;
+    while (n < nameCount && names[n] != event.name) n++;
+    if (n == nameCount) {
+      if (nameCount == MAX_NAMES) continue;
+      names[nameCount++] = event.name;
+    }
+    counts[n]++;
+    totals[n] += event.duration;
+    if (event.duration > longest[n]) longest[n] = event.duration;
+  }
+  
+  String summary = "🧵 Трассировка: " + String(traceCount()) + " записей";
+  if (traceOverwritten()) summary += " (" + String(traceOverwritten()) + " перезаписано" + ")";
+  summary += traceOn ? ", запись идет\n\n" : ", на паузе\n\n";
+  for (int n = 0; n < nameCount; n++) {
+    summary += "• " + String(names[n]) + ": " + String(counts[n]) + "x, всего " + String((uint32_t)(totals[n] / 1000));
+    summary += " мс, макс " + String(longest[n] / 1000) + " мс\n";
+  }
+  return summary;
+}
+
 // ========== ОБРАБОТКА КОМАНД ==========
+// WoL команды пакета идут первыми: любая другая команда ждет свой HTTPS ответ
+bool isWolCommand(const char* text) {
+  return !strcmp(text, "/wake") || !strcmp(text, "/wakeonly");
+}
+
 void processCommand(String chatID, String text) {
+  TRACE_SPAN("command");
   // Проверка вайтлиста
-  bool allowed = false;
-  for (int i = 0; i < sizeof(allowedUsers)/sizeof(allowedUsers[0]); i++) {
-    if (allowedUsers[i] == chatID) {
-      allowed = true;
-      break;
+  bool allowed = isAllowedChat(chatID.c_str(), allowedUsers, sizeof(allowedUsers)/sizeof(allowedUsers[0]));
+  
+  // Отказы не тратят сетевой I/O, кроме одного необязательного ответа за окно
+  if (!allowed) {
+    rejectedUnauthorized++;
+    if (ANSWER_UNAUTHORIZED && chatLimiter.noticeUnauthorized(millis())) {
+      sendTelegram(chatID, "⛔ Доступ запрещен");
     }
+    return;
   }
   
-  if (!allowed) {
-    sendTelegram(chatID, "⛔ Доступ запрещен");
+  if (!chatLimiter.take(chatID.c_str(), millis())) {
+    if (chatLimiter.notice(chatID.c_str(), millis())) {
+      sendTelegram(chatID, "🐌 Слишком много команд, остальные пока отбрасываются");
+    }
     return;
   }
   
-  Serial.print("Обработка: ");
-  Serial.println(text);
+  LOG_DEBUG("Обработка: %s", logCopy(text.c_str()));
   
   if (text == "/start" || text == "/help") {
     String msg = "🤖 WoL Bot с детальным мониторингом\n\n";
@@ -307,7 +1821,15 @@ void processCommand(String chatID, String text) {
     msg += "/wakeonly - только WoL\n";
     msg += "/status - статус системы\n";
     msg += "/check - проверить сервер сейчас\n";
+    msg += "/check force - проверить без кэша\n";
+    msg += "/watch - наблюдение за аптаймом и его стоимость\n";
+    msg += "/schedule - пробуждение по расписанию (время готовности)\n";
+    msg += "/sequence - пробуждение по зависимостям\n";
+    msg += "/wakeall - разбудить все цели ретрансляторов\n";
+    msg += "/checkall - проверить все цели ретрансляторов\n";
     msg += "/timing - статистика времени\n";
+    msg += "/boots - история фаз загрузки\n";
+    msg += "/trace - трассировка спанов (Chrome JSON), on/off/clear/dump\n";
     msg += "/ping - проверка связи\n";
     msg += "/clear - очистить историю\n\n";
     msg += "⚙️ Настройки мониторинга:\n";
@@ -317,17 +1839,18 @@ void processCommand(String chatID, String text) {
     sendTelegram(chatID, msg);
   }
   else if (text == "/wake") {
+    // WoL уходит раньше любого обмена с Telegram, подтверждение после
     wakeCommandTime = millis(); // Засекаем время команды
     lastProgressUpdate = 0;
-    
-    sendTelegram(chatID, "🔌 Команда получена, отправляю WoL...");
+    commandMicros = updateReceivedMicros;
     
     if (sendWOL()) {
       // Запускаем мониторинг
       isMonitoring = true;
+      bootTimelineStart();
       monitoringChatID = chatID;
       
-      String msg = "✅ WoL отправлен!\n\n";
+      String msg = "✅ WoL отправлен через " + String(wolBurst.commandToWolMicros / 1000.0, 2) + " мс после получения команды!\n\n";
       msg += "📊 Начинаю мониторинг загрузки:\n";
       msg += "• Ожидаемое время: 20-50 секунд\n";
       msg += "• Максимум: " + String(MAX_WAIT_TIME) + " секунд\n";
@@ -336,16 +1859,16 @@ void processCommand(String chatID, String text) {
       msg += "Я сообщу когда сервер загрузится со статистикой времени!";
       sendTelegram(chatID, msg);
       
-      Serial.println("🔍 Мониторинг запущен");
+      LOG_INFO("🔍 Мониторинг запущен");
     } else {
       sendTelegram(chatID, "❌ Ошибка отправки WoL");
     }
   }
   else if (text == "/wakeonly") {
-    sendTelegram(chatID, "🔌 Отправляю WoL без мониторинга...");
+    commandMicros = updateReceivedMicros;
     
     if (sendWOL()) {
-      sendTelegram(chatID, "✅ WoL отправлен на " + serverIP.toString());
+      sendTelegram(chatID, "✅ WoL отправлен на " + serverIP.toString() + " (без мониторинга), " + String(wolBurst.commandToWolMicros / 1000.0, 2) + " мс после команды");
     } else {
       sendTelegram(chatID, "❌ Ошибка WoL");
     }
@@ -356,6 +1879,14 @@ void processCommand(String chatID, String text) {
     status += "IP ESP: " + WiFi.localIP().toString() + "\n";
     status += "Сервер: " + serverIP.toString() + "\n";
     
+    const LivenessEntry* last = livenessFresh(serverIP, (unsigned long)-1);
+    if (last) {
+      status += last->online ? "Состояние сервера: онлайн (порт " + String(last->port) + ", " : "Состояние сервера: оффлайн (";
+      status += String((millis() - last->checkedAt) / 1000) + " сек назад)\n";
+    } else {
+      status += "Состояние сервера: неизвестно\n";
+    }
+    
     if (isMonitoring) {
       unsigned long elapsed = (millis() - wakeCommandTime) / 1000;
       status += "Мониторинг: АКТИВЕН " + String(elapsed) + " сек\n";
@@ -363,17 +1894,188 @@ void processCommand(String chatID, String text) {
       status += "Мониторинг: выключен\n";
     }
     
+    if (WATCH_ENABLED) {
+      status += "Наблюдение: " + String(WATCH_HOST_COUNT) + " хост(ов) каждые " + String(WATCH_INTERVAL) + " сек\n";
+    }
+    
+    if (sequenceRunning >= 0) {
+      status += "🧩 Выполняется последовательность: " + String(sequencePlans[sequenceRunning].name) + "\n";
+    }
+    
+    if (nextScheduleIndex >= 0) {
+      status += "Следующий WoL по расписанию: " + formatTime(nextScheduleFire) + "\n";
+    } else if (scheduleCount > 0 && !clockSynced()) {
+      status += "Расписания: ожидание времени SNTP\n";
+    }
+    
+    if (RELAY_ROLE == RELAY_FRONTEND) {
+      status += "Ретрансляторы: " + String(sizeof(relaySegments) / sizeof(relaySegments[0])) + " сегмент(ов)\n";
+    }
+    
+    const ChatRateLimiter::Stats& limits = chatLimiter.stats();
+    status += "Отклонено: " + String(rejectedUnauthorized) + " чужих, ";
+    status += String(limits.limited) + " по лимиту (" + String(limits.notices) + " с ответом)\n";
+    if (proxyNetif) {
+      const char* const proxyStates[] = {"выкл", "активен", "будит"};
+      xSemaphoreTake(proxyLock, portMAX_DELAY);
+      ProxyState state = sleepProxy().state(0);
+      SleepProxy::Stats stats = sleepProxy().stats(0);
+      xSemaphoreGive(proxyLock);
+      status += "Sleep proxy: " + String(proxyConfirmLeft ? "проверка" : proxyStates[state]) + ", " + String(stats.arpAnswered) + " ARP, ";
+      status += String(stats.wakes) + " пробуждений, " + String(stats.handovers) + " передач\n";
+    }
+    status += "Лог: " + String(logWritten()) + " записей, " + String(logDropped()) + " потеряно\n";
     status += "lastUpdateId: " + String(lastUpdateId);
     sendTelegram(chatID, status);
   }
-  else if (text == "/check") {
-    sendTelegram(chatID, "🔍 Проверяю сервер...");
+  else if (text == "/check" || text == "/check force") {
+    // Свежие данные - ответ сразу, иначе ждем общую проверку
+    const LivenessEntry* cached = livenessFresh(serverIP, LIVENESS_FRESH_TIME * 1000UL);
+    if (cached && text == "/check") {
+      String msg = livenessText(*cached) + "\n";
+      msg += "ℹ️ Возраст данных: " + String((millis() - cached->checkedAt) / 1000) + " сек";
+      sendTelegram(chatID, msg);
+    } else if (livenessWait(serverIP, chatID)) {
+      sendTelegram(chatID, "🔍 Проверяю сервер...");
+    } else {
+      sendTelegram(chatID, "⏳ Проверка уже идет, попробуйте через несколько секунд");
+    }
+  }
+  else if (text.startsWith("/sequence")) {
+    String name = text.substring(9);
+    name.trim();
     
-    if (isServerOnline()) {
-      sendTelegram(chatID, "✅ Сервер онлайн! " + serverIP.toString());
+    int plan = -1;
+    for (int i = 0; i < SEQUENCE_PLAN_COUNT; i++) {
+      if (name == sequencePlans[i].name) plan = i;
+    }
+    
+    if (name == "") {
+      String msg = "🧩 Последовательности пробуждения:\n\n";
+      for (int i = 0; i < SEQUENCE_PLAN_COUNT; i++) {
+        msg += "• " + String(sequencePlans[i].name) + ": " + sequencePlans[i].hosts;
+        if (i == sequenceRunning) msg += " ▶️ выполняется";
+        msg += "\n";
+      }
+      msg += "\nВключений: не больше " + String(SEQUENCE_MAX_POWERING) + " одновременно, ";
+      msg += "не чаще раза в " + String(SEQUENCE_STAGGER) + " сек\n";
+      msg += "Запуск: /sequence <имя>";
+      sendTelegram(chatID, msg);
+    } else if (sequenceRunning >= 0) {
+      sendTelegram(chatID, "⏳ Уже выполняется " + String(sequencePlans[sequenceRunning].name) + "");
+    } else if (plan < 0) {
+      sendTelegram(chatID, "❌ Нет последовательности " + name);
     } else {
-      sendTelegram(chatID, "❌ Сервер оффлайн " + serverIP.toString());
+      String error = startSequence(plan);
+      if (error != "") {
+        sendTelegram(chatID, "❌ Последовательность " + name + ": " + error);
+      } else {
+        sequenceChatID = chatID;
+        String msg = "🧩 Запускаю последовательность " + name + ": ";
+        for (int i = 0; i < sequencer.hostCount(); i++) {
+          msg += String(i ? ", " : "") + sequenceHosts[sequenceHostOf[i]].name;
+        }
+        sendTelegram(chatID, msg);
+        serviceSequence();
+      }
+    }
+  }
+  else if (text.startsWith("/schedule")) {
+    String args = text.substring(9);
+    args.trim();
+    
+    if (args.startsWith("add ")) {
+      String cron = args.substring(4);
+      cron.trim();
+      CronSpec spec;
+      if (scheduleCount >= MAX_SCHEDULES) {
+        sendTelegram(chatID, "❌ Список расписаний заполнен (" + String(MAX_SCHEDULES) + ")");
+      } else if (cron.length() >= sizeof(schedules[0].cron) || !parseCron(cron.c_str(), spec)) {
+        sendTelegram(chatID, "❌ Неверное cron выражение: " + cron);
+      } else {
+        WakeSchedule& schedule = schedules[scheduleCount];
+        snprintf(schedule.cron, sizeof(schedule.cron), "%s", cron.c_str());
+        snprintf(schedule.chatId, sizeof(schedule.chatId), "%s", chatID.c_str());
+        scheduleSpecs[scheduleCount++] = spec;
+        saveSchedules();
+        planSchedules();
+        
+        String msg = "✅ Расписание #" + String(scheduleCount) + " добавлено: готовность по " + cron;
+        if (clockSynced()) {
+          time_t readyBy = cronNextAfter(spec, time(NULL) + scheduleLeadSeconds());
+          msg += "\n• Ближайшая готовность: " + (readyBy ? formatTime(readyBy) : String("никогда"));
+        }
+        sendTelegram(chatID, msg);
+      }
+    }
+    else if (args.startsWith("del ")) {
+      int n = args.substring(4).toInt();
+      if (n < 1 || n > scheduleCount) {
+        sendTelegram(chatID, "❌ Нет расписания #" + args.substring(4));
+      } else {
+        for (int i = n - 1; i < scheduleCount - 1; i++) {
+          schedules[i] = schedules[i + 1];
+          scheduleSpecs[i] = scheduleSpecs[i + 1];
+        }
+        scheduleCount--;
+        saveSchedules();
+        sendTelegram(chatID, "🗑️ Расписание #" + String(n) + " удалено");
+      }
+    }
+    else {
+      String msg = "📅 Пробуждение по расписанию (время готовности):\n\n";
+      if (schedulePlanDirty) planSchedules();
+      for (int i = 0; i < scheduleCount; i++) {
+        msg += String(i + 1) + ". " + schedules[i].cron;
+        if (i == nextScheduleIndex) msg += " ⏭️ ближайшее";
+        msg += "\n";
+      }
+      if (scheduleCount == 0) msg += "Нет расписаний\n";
+      
+      msg += "\n";
+      if (nextScheduleIndex >= 0) {
+        msg += "• Следующий WoL: " + formatTime(nextScheduleFire) + ", готовность к " + formatTime(nextScheduleReady) + "\n";
+      } else if (!clockSynced()) {
+        msg += "• Часы еще не синхронизированы (SNTP)\n";
+      }
+      msg += "• Оценка загрузки: " + String(bootEstimateMs / 1000) + " сек + запас " + String(SCHEDULE_MARGIN) + " сек\n\n";
+      msg += "Добавить: /schedule add 30 8 * * 1-5\n(минута час день месяц день_недели)\nУдалить: /schedule del 1";
+      sendTelegram(chatID, msg);
+    }
+  }
+  else if (text == "/wakeall" || text == "/checkall") {
+    if (RELAY_ROLE != RELAY_FRONTEND) {
+      sendTelegram(chatID, "ℹ️ Кластер ретрансляторов выключен");
+      return;
+    }
+    
+    String report = runFleet(text == "/wakeall");
+    sendTelegram(chatID, report);
+  }
+  else if (text == "/watch") {
+    if (!WATCH_ENABLED) {
+      sendTelegram(chatID, "ℹ️ Наблюдение за аптаймом выключено");
+      return;
+    }
+    
+    const char* stateNames[] = {"❔ неизвестно", "🟢 ДОСТУПЕН", "🟡 подтверждение", "🔴 НЕДОСТУПЕН"};
+    unsigned long now = millis();
+    
+    String msg = "👁️ Наблюдение за аптаймом:\n\n";
+    for (int h = 0; h < WATCH_HOST_COUNT; h++) {
+      const WatchStatus& st = watchStatus[h];
+      msg += String(watchHosts[h].name) + " (" + watchHosts[h].ip.toString() + "): ";
+      msg += String(stateNames[st.state]);
+      if (st.state != WATCH_UNKNOWN) {
+        msg += " уже " + String((now - st.since) / 1000) + " сек";
+      }
+      msg += "\n";
     }
+    
+    msg += "\n📊 Стоимость:\n" + watchCostReport();
+    msg += "• Проверка каждые " + String(WATCH_INTERVAL) + " сек, подтверждение ";
+    msg += String(WATCH_CONFIRM_PROBES) + "x каждые " + String(WATCH_CONFIRM_INTERVAL) + " сек";
+    sendTelegram(chatID, msg);
   }
   else if (text == "/timing") {
     if (wolSentTime > 0) {
@@ -382,10 +2084,24 @@ void processCommand(String chatID, String text) {
       unsigned long wolToNow = (now - wolSentTime);
       
       String timing = "⏱️ Статистика времени:\n\n";
-      timing += "• Команда→WoL: " + String(commandToWol) + " мс\n";
+      if (wolBurst.commandToWolMicros) {
+        timing += "• Команда→WoL: " + String(wolBurst.commandToWolMicros) + " мкс (получение апдейта → первый пакет)\n";
+      } else {
+        timing += "• Команда→WoL: " + String(commandToWol) + " мс\n";
+      }
       timing += "• WoL→Сейчас: " + String(wolToNow / 1000) + " сек\n";
       timing += "• Общее: " + String((now - wakeCommandTime) / 1000) + " сек\n\n";
       
+      timing += "⚡ Последняя серия WoL:\n";
+      timing += "• Пакетов: " + String(wolBurst.datagrams - wolBurst.failed) + "/" + String(wolBurst.datagrams);
+      timing += " (" + String(WOL_REPEATS) + "x" + String(WOL_BROADCAST_COUNT) + "x" + String(WOL_PORT_COUNT) + ")\n";
+      timing += "• Первый пакет: " + String(wolBurst.firstMicros) + " мкс\n";
+      if (wolBurst.datagrams > 0) {
+        timing += "• На пакет: в среднем " + String(wolBurst.totalSendMicros / wolBurst.datagrams);
+        timing += " мкс, макс " + String(wolBurst.maxSendMicros) + " мкс\n";
+      }
+      timing += "• Серия: " + String(wolBurst.burstMicros / 1000) + " мс\n\n";
+      
       if (isMonitoring) {
         timing += "📡 Мониторинг активен";
       } else if (wolSentTime > 0) {
@@ -397,17 +2113,57 @@ void processCommand(String chatID, String text) {
       sendTelegram(chatID, "ℹ️ WoL ещё не отправлялся");
     }
   }
+  else if (text == "/trace on" || text == "/trace off") {
+    traceOn = (text == "/trace on");
+    sendTelegram(chatID, traceOn ? "🧵 Запись трассировки включена" : "🧵 Запись трассировки на паузе");
+  }
+  else if (text == "/trace clear") {
+    traceClear();
+    sendTelegram(chatID, "🗑️ Трассировка очищена");
+  }
+  else if (text == "/trace dump") {
+    // Строки лога иначе попадут в середину JSON
+    logPauseDrain(true);
+    traceExport(traceToSerial, NULL);
+    logPauseDrain(false);
+    sendTelegram(chatID, "🧵 JSON трассировки выведен в Serial");
+  }
+  else if (text == "/trace") {
+    // Пауза, чтобы отправка не попала в выгружаемый буфер: оба прохода
+    // выгрузки в sendTelegramDocument() должны видеть одни и те же записи
+    bool wasOn = traceOn;
+    traceOn = false;
+    
+    String summary = traceSummary();
+    if (!sendTelegramDocument(chatID, "wolbot-trace.json", traceExport)) {
+      summary += "\n⚠️ Не удалось отправить файл, используйте /trace dump";
+    }
+    sendTelegram(chatID, summary + "\nОткройте файл в ui.perfetto.dev или chrome://tracing");
+    traceOn = wasOn;
+  }
+  else if (text == "/boots") {
+    if (bootHistoryCount == 0) {
+      sendTelegram(chatID, "ℹ️ Загрузок еще не было");
+    } else {
+      String msg = "🧭 История загрузок (фазы в сек: ARP / ICMP / SSH / Сервис):\n\n";
+      for (int i = 0; i < bootHistoryCount; i++) {
+        msg += bootHistory[i].wolAt ? formatTime(bootHistory[i].wolAt) : String("?");
+        msg += ": ";
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+          if (stage > 0) msg += " / ";
+          msg += bootHistory[i].stageMs[stage] ? bootSeconds(bootPhaseMs(bootHistory[i], stage)) : String("—");
+        }
+        msg += "\n";
+      }
+      msg += "\n" + bootTimelineReport();
+      sendTelegram(chatID, msg);
+    }
+  }
   else if (text == "/ping") {
     sendTelegram(chatID, "🏓 Pong! " + String(millis()) + " мс");
   }
   else if (text == "/clear") {
-    HTTPClient http;
-    String url = "https://api.telegram.org/bot" + botToken + "/getUpdates?offset=-1";
-    http.begin(url);
-    http.GET();
-    http.end();
-    
-    lastUpdateId = 0;
+    clearUpdateHistory();
     sendTelegram(chatID, "🗑️ История очищена");
   }
   else {
@@ -418,6 +2174,8 @@ void processCommand(String chatID, String text) {
 // ========== SETUP ==========
 void setup() {
   Serial.begin(115200);
+  traceOn = TRACE_AT_BOOT;
+  logStartTask();
   delay(1000);
   
   Serial.println("\n=== WoL Bot с таймингом загрузки ===");
@@ -447,14 +2205,45 @@ void setup() {
   
   setupWOL();
   
+  if (RELAY_ROLE != RELAY_OFF) {
+    relayUdp.begin(RELAY_PORT);
+    Serial.print("📡 Ретранслятор ");
+    Serial.print(RELAY_ROLE == RELAY_NODE ? "узел" : "фронтенд");
+    Serial.print(" #");
+    Serial.print(RELAY_NODE_ID);
+    Serial.print(", порт ");
+    Serial.println(RELAY_PORT);
+  }
+  if (RELAY_ROLE == RELAY_NODE) return;
+  
+  // Time for scheduled wakes
+  prefs.begin("wolbot", false);
+  loadSchedules();
+  loadBootHistory();
+  sntp_set_time_sync_notification_cb(onTimeSync);
+  configTzTime(TIMEZONE, NTP_SERVER);
+  Serial.print("📅 Расписания: ");
+  Serial.println(scheduleCount);
+  
+  if (SLEEP_PROXY_ENABLED) setupSleepProxy();
+  
   // Очистка истории Telegram
   Serial.println("🧹 Очищаю историю...");
-  HTTPClient http;
-  String url = "https://api.telegram.org/bot" + botToken + "/getUpdates?offset=-1";
-  http.begin(url);
-  http.GET();
-  http.end();
-  delay(1000);
+  clearUpdateHistory();
+  
+  // Первые проверки наблюдения сразу, с разносом по интервалу
+  watchStartTime = millis();
+  for (int h = 0; h < WATCH_HOST_COUNT; h++) {
+    watchStatus[h] = WatchStatus();
+    watchStatus[h].nextProbe = watchStartTime + (WATCH_INTERVAL * 1000UL * h) / WATCH_HOST_COUNT;
+  }
+  if (WATCH_ENABLED) {
+    Serial.print("👁️ Наблюдение за аптаймом: ");
+    Serial.print(WATCH_HOST_COUNT);
+    Serial.print(" хост(ов), ~");
+    Serial.print(3600 / WATCH_INTERVAL * WATCH_HOST_COUNT);
+    Serial.println(" проверок/ч");
+  }
   
   Serial.println("✅ Бот запущен");
   Serial.println("Ожидаемое время загрузки сервера: 20-50 секунд");
@@ -462,21 +2251,38 @@ void setup() {
 
 // ========== LOOP ==========
 void loop() {
-  // Проверка Telegram
-  String update = getTelegramUpdate();
-  
-  if (update != "") {
-    int separator = update.indexOf("|");
-    if (separator > 0) {
-      String chatID = update.substring(0, separator);
-      String text = update.substring(separator + 1);
-      
-      processCommand(chatID, text);
+  // Узлы-ретрансляторы только обслуживают фронтенд
+  if (RELAY_ROLE == RELAY_NODE) {
+    serviceRelayNode();
+    delay(1);
+    return;
+  }
+  
+  // Пробуждение от sleep proxy уходит раньше всего остального
+  serviceSleepProxy();
+  
+  // Проверка Telegram: флуд разбирается по TELEGRAM_BATCH команд за опрос
+  int updates = getTelegramUpdates();
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < updates; i++) {
+      const TelegramUpdate& update = updateBatch[i];
+      if (!update.complete || !update.hasMessage || isWolCommand(update.text) != (pass == 0)) continue;
+      processCommand(update.chatId, update.text);
     }
   }
   
   // Проверка мониторинга
   checkServerMonitoring();
+  serviceLiveness();
+  checkWatch();
+  checkSchedules();
+  serviceSequence();
   
-  delay(2000);
+  // За опросом, который принес апдейты, в очереди могут ждать еще
+  if (updates == 0) {
+    TRACE_SPAN("idle");
+    // SYN, пойманный sleep proxy, прерывает паузу; идущая последовательность
+    // проверяет один хост за проход, поэтому пауза короткая
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sequenceRunning >= 0 ? 100 : 2000));
+  }
 }
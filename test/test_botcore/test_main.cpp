@@ -0,0 +1,151 @@
+#include <BotCore.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+static char response[8192];
+
+// getUpdates response with `count` text messages from chat 1000 + i,
+// update ids from 500; message `longIndex` gets a text of `longLen` bytes
+static size_t buildResponse(int count, int longIndex = -1, size_t longLen = 0) {
+  size_t len = snprintf(response, sizeof(response), "{\"ok\":true,\"result\":[");
+  for (int i = 0; i < count; i++) {
+    len += snprintf(response + len, sizeof(response) - len,
+                    "%s{\"update_id\":%d,\"message\":{\"message_id\":%d,\"from\":{\"id\":%d,\"is_bot\":false},"
+                    "\"chat\":{\"id\":%d,\"type\":\"private\"},\"date\":1760000000,\"text\":\"",
+                    i ? "," : "", 500 + i, 10 + i, 1000 + i, 1000 + i);
+    if (i == longIndex) {
+      memset(response + len, 'x', longLen);
+      len += longLen;
+    } else {
+      len += snprintf(response + len, sizeof(response) - len, "/status");
+    }
+    len += snprintf(response + len, sizeof(response) - len, "\"}}");
+  }
+  len += snprintf(response + len, sizeof(response) - len, "]}");
+  return len;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_single_update(void) {
+  TelegramUpdate update;
+  size_t len = buildResponse(1);
+  TEST_ASSERT_TRUE(parseTelegramUpdate(response, len, update));
+  TEST_ASSERT_EQUAL(500, update.updateId);
+  TEST_ASSERT_TRUE(update.complete);
+  TEST_ASSERT_TRUE(update.hasMessage);
+  TEST_ASSERT_EQUAL_STRING("1000", update.chatId);
+  TEST_ASSERT_EQUAL_STRING("/status", update.text);
+}
+
+void test_no_update(void) {
+  TelegramUpdate update;
+  const char* empty = "{\"ok\":true,\"result\":[]}";
+  TEST_ASSERT_FALSE(parseTelegramUpdate(empty, strlen(empty), update));
+  const char* broken = "{\"ok\":true,\"result\":[{\"update_id\":5";
+  TEST_ASSERT_FALSE(parseTelegramUpdate(broken, strlen(broken), update));
+}
+
+void test_update_without_message(void) {
+  TelegramUpdate update;
+  const char* edited = "{\"ok\":true,\"result\":[{\"update_id\":77,\"edited_message\":{\"text\":\"/wake\"}}]}";
+  TEST_ASSERT_TRUE(parseTelegramUpdate(edited, strlen(edited), update));
+  TEST_ASSERT_EQUAL(77, update.updateId);
+  TEST_ASSERT_TRUE(update.complete);
+  TEST_ASSERT_FALSE(update.hasMessage);
+}
+
+void test_batch(void) {
+  TelegramUpdate updates[8];
+  size_t len = buildResponse(8);
+  TEST_ASSERT_EQUAL(8, parseTelegramUpdates(response, len, updates, 8));
+  for (int i = 0; i < 8; i++) {
+    char chatId[8];
+    snprintf(chatId, sizeof(chatId), "%d", 1000 + i);
+    TEST_ASSERT_EQUAL(500 + i, updates[i].updateId);
+    TEST_ASSERT_TRUE(updates[i].complete);
+    TEST_ASSERT_EQUAL_STRING(chatId, updates[i].chatId);
+    TEST_ASSERT_EQUAL_STRING("/status", updates[i].text);
+  }
+}
+
+// The id still comes back, so the caller's offset can move past the update
+void test_oversized_update_keeps_id(void) {
+  TelegramUpdate update;
+  size_t len = buildResponse(1, 0, 4000);
+  TEST_ASSERT_TRUE(parseTelegramUpdate(response, len, update));
+  TEST_ASSERT_EQUAL(500, update.updateId);
+  TEST_ASSERT_FALSE(update.complete);
+  TEST_ASSERT_FALSE(update.hasMessage);
+}
+
+void test_long_text_truncated(void) {
+  TelegramUpdate update;
+  size_t len = buildResponse(1, 0, 700);
+  TEST_ASSERT_TRUE(parseTelegramUpdate(response, len, update));
+  TEST_ASSERT_TRUE(update.complete);
+  TEST_ASSERT_EQUAL(TELEGRAM_TEXT_MAX - 1, strlen(update.text));
+}
+
+void test_rate_limit_burst_and_refill(void) {
+  ChatRateLimiter limiter(3, 1000, 60000);
+  for (int i = 0; i < 3; i++) TEST_ASSERT_TRUE(limiter.take("1000", 0));
+  TEST_ASSERT_FALSE(limiter.take("1000", 500));
+  TEST_ASSERT_TRUE(limiter.take("1000", 1500));
+  TEST_ASSERT_FALSE(limiter.take("1000", 1600));
+
+  // Another chat has a bucket of its own
+  TEST_ASSERT_TRUE(limiter.take("2000", 1600));
+  TEST_ASSERT_EQUAL(5, limiter.stats().passed);
+  TEST_ASSERT_EQUAL(2, limiter.stats().limited);
+}
+
+void test_notice_once_per_window(void) {
+  ChatRateLimiter limiter(1, 1000, 60000);
+  TEST_ASSERT_TRUE(limiter.notice("1000", 0));
+  TEST_ASSERT_FALSE(limiter.notice("1000", 59999));
+  TEST_ASSERT_TRUE(limiter.notice("1000", 60000));
+  TEST_ASSERT_TRUE(limiter.notice("2000", 60000));
+}
+
+// Chat ids whose FNV-1a hashes collide must still get separate buckets
+void test_hash_collision_keeps_chats_apart(void) {
+  ChatRateLimiter limiter(1, 60000, 60000);
+  TEST_ASSERT_TRUE(limiter.take("costarring", 0));
+  TEST_ASSERT_TRUE(limiter.take("liquid", 0));
+  TEST_ASSERT_FALSE(limiter.take("costarring", 0));
+  TEST_ASSERT_FALSE(limiter.take("liquid", 0));
+}
+
+// Unknown chats share one budget and never touch the per-chat table
+void test_unauthorized_notices_share_a_budget(void) {
+  ChatRateLimiter limiter(2, 60000, 60000);
+  TEST_ASSERT_TRUE(limiter.take("1000", 0));
+
+  TEST_ASSERT_TRUE(limiter.noticeUnauthorized(0));
+  TEST_ASSERT_FALSE(limiter.noticeUnauthorized(30000));
+  TEST_ASSERT_TRUE(limiter.noticeUnauthorized(60000));
+  TEST_ASSERT_EQUAL(0, limiter.stats().evictions);
+
+  // The whitelisted chat kept its bucket: one token left, not a fresh two
+  TEST_ASSERT_TRUE(limiter.take("1000", 0));
+  TEST_ASSERT_FALSE(limiter.take("1000", 0));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_single_update);
+  RUN_TEST(test_no_update);
+  RUN_TEST(test_update_without_message);
+  RUN_TEST(test_batch);
+  RUN_TEST(test_oversized_update_keeps_id);
+  RUN_TEST(test_long_text_truncated);
+  RUN_TEST(test_rate_limit_burst_and_refill);
+  RUN_TEST(test_notice_once_per_window);
+  RUN_TEST(test_hash_collision_keeps_chats_apart);
+  RUN_TEST(test_unauthorized_notices_share_a_budget);
+  return UNITY_END();
+}
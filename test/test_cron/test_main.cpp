@@ -0,0 +1,122 @@
+#include <CronSchedule.h>
+#include <stdlib.h>
+#include <unity.h>
+
+static const char* UTC = "UTC0";
+static const char* BERLIN = "CET-1CEST,M3.5.0,M10.5.0/3";
+
+static void useZone(const char* tz) {
+  setenv("TZ", tz, 1);
+  tzset();
+}
+
+static time_t local(int year, int month, int day, int hour, int minute) {
+  struct tm tm = {};
+  tm.tm_year = year - 1900;
+  tm.tm_mon = month - 1;
+  tm.tm_mday = day;
+  tm.tm_hour = hour;
+  tm.tm_min = minute;
+  tm.tm_isdst = -1;
+  return mktime(&tm);
+}
+
+// -1 when the expression doesn't parse
+static time_t next(const char* expr, time_t after) {
+  CronSpec spec;
+  if (!parseCron(expr, spec)) return -1;
+  return cronNextAfter(spec, after);
+}
+
+void setUp(void) {
+  useZone(UTC);
+}
+
+void tearDown(void) {}
+
+void test_steps_and_ranges(void) {
+  CronSpec spec;
+  TEST_ASSERT_TRUE(parseCron("*/15 0-6/2 1-31/10 * *", spec));
+  TEST_ASSERT_EQUAL_HEX64(1ULL << 0 | 1ULL << 15 | 1ULL << 30 | 1ULL << 45, spec.minutes);
+  TEST_ASSERT_EQUAL_HEX32(1 << 0 | 1 << 2 | 1 << 4 | 1 << 6, spec.hours);
+  TEST_ASSERT_EQUAL_HEX32(1u << 1 | 1u << 11 | 1u << 21 | 1u << 31, spec.days);
+
+  // "5/20" runs from 5 to the end of the field
+  TEST_ASSERT_TRUE(parseCron("5/20 8 * 1,6-7 1-5", spec));
+  TEST_ASSERT_EQUAL_HEX64(1ULL << 5 | 1ULL << 25 | 1ULL << 45, spec.minutes);
+  TEST_ASSERT_EQUAL_HEX32(1 << 1 | 1 << 6 | 1 << 7, spec.months);
+  TEST_ASSERT_EQUAL_HEX8(0x3E, spec.weekdays);
+  TEST_ASSERT_TRUE(spec.anyDay);
+  TEST_ASSERT_FALSE(spec.anyWeekday);
+
+  TEST_ASSERT_TRUE(parseCron("0 0 * * 7", spec));
+  TEST_ASSERT_EQUAL_HEX8(0x01, spec.weekdays);
+}
+
+void test_rejects_malformed(void) {
+  const char* bad[] = {
+      "*/5x * * * *", "*/ * * * *", "*/0 * * * *", "*/-5 * * * *", "*/61 * * * *",
+      "1-5/2x * * * *", "60 * * * *", "0 24 * * *", "0 0 0 * *", "0 0 * 13 *",
+      "0 0 * * 8", "5-1 * * * *", "1- * * * *", "a * * * *",
+      "* * * *", "* * * * * *", "",
+  };
+  CronSpec spec;
+  for (const char* expr : bad) TEST_ASSERT_FALSE_MESSAGE(parseCron(expr, spec), expr);
+}
+
+// Both day fields restricted: either one matching fires (cron's OR rule)
+void test_day_fields_or(void) {
+  // 2026-03-01 is a Sunday, the 1st or any Wednesday
+  time_t t = next("0 8 1 * 3", local(2026, 3, 1, 8, 0));
+  TEST_ASSERT_EQUAL(local(2026, 3, 4, 8, 0), t);
+  t = next("0 8 1 * 3", local(2026, 3, 25, 8, 0));
+  TEST_ASSERT_EQUAL(local(2026, 4, 1, 8, 0), t);
+
+  // Only one field restricted: that field alone decides
+  TEST_ASSERT_EQUAL(local(2026, 4, 1, 8, 0), next("0 8 1 * *", local(2026, 3, 1, 8, 0)));
+  TEST_ASSERT_EQUAL(local(2026, 3, 4, 8, 0), next("0 8 * * 3", local(2026, 3, 1, 8, 0)));
+}
+
+void test_next_is_strictly_after(void) {
+  time_t at = local(2026, 6, 10, 12, 30);
+  TEST_ASSERT_EQUAL(local(2026, 6, 11, 12, 30), next("30 12 * * *", at));
+  TEST_ASSERT_EQUAL(local(2026, 6, 10, 12, 31), next("* * * * *", at + 59));
+  TEST_ASSERT_EQUAL(0, next("0 0 31 2 *", at));
+}
+
+// Spring forward (02:00 -> 03:00 on 2026-03-29): the day is 23 hours long
+void test_dst_spring_forward(void) {
+  useZone(BERLIN);
+  time_t before = next("0 4 * * *", local(2026, 3, 28, 0, 0));
+  time_t after = next("0 4 * * *", before);
+  TEST_ASSERT_EQUAL(local(2026, 3, 28, 4, 0), before);
+  TEST_ASSERT_EQUAL(23 * 3600, after - before);
+
+  // A time in the skipped hour still fires once that day and moves on
+  time_t skipped = next("30 2 * * *", local(2026, 3, 29, 0, 0));
+  TEST_ASSERT_GREATER_THAN(local(2026, 3, 29, 0, 0), skipped);
+  TEST_ASSERT_LESS_THAN(local(2026, 3, 30, 0, 0), skipped);
+  TEST_ASSERT_EQUAL(local(2026, 3, 30, 2, 30), next("30 2 * * *", skipped));
+}
+
+// Fall back (03:00 -> 02:00 on 2026-10-25): 25 hours, the repeated hour fires once
+void test_dst_fall_back(void) {
+  useZone(BERLIN);
+  time_t before = next("0 12 * * *", local(2026, 10, 24, 0, 0));
+  TEST_ASSERT_EQUAL(25 * 3600, next("0 12 * * *", before) - before);
+
+  time_t repeated = next("30 2 * * *", local(2026, 10, 25, 0, 0));
+  TEST_ASSERT_LESS_THAN(local(2026, 10, 26, 0, 0), repeated);
+  TEST_ASSERT_EQUAL(local(2026, 10, 26, 2, 30), next("30 2 * * *", repeated));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_steps_and_ranges);
+  RUN_TEST(test_rejects_malformed);
+  RUN_TEST(test_day_fields_or);
+  RUN_TEST(test_next_is_strictly_after);
+  RUN_TEST(test_dst_spring_forward);
+  RUN_TEST(test_dst_fall_back);
+  return UNITY_END();
+}
@@ -0,0 +1,222 @@
+#include <WolRelay.h>
+#include <string.h>
+#include <unity.h>
+
+static const uint8_t key[RELAY_KEY_SIZE] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+
+// Last datagram the node under test replied with
+static uint8_t reply[RELAY_MAX_DATAGRAM];
+static size_t replyLen;
+
+static bool nodeWake(const RelayJob& job, void* ctx) {
+  return true;
+}
+
+static bool nodeProbe(const RelayJob& job, void* ctx) {
+  return job.port == 22;
+}
+
+static void nodeReply(const uint8_t* data, size_t len, void* ctx) {
+  memcpy(reply, data, len);
+  replyLen = len;
+}
+
+static uint32_t nodeMicros(void* ctx) {
+  return 0;
+}
+
+static const RelayNode::Hooks hooks = {nodeWake, nodeProbe, nodeReply, nodeMicros, NULL};
+
+static RelayJob wakeJob(uint8_t id) {
+  RelayJob job = {RELAY_JOB_WAKE, id, 9, 0xC0A814FF, {0xAA, 0xBB, 0xCC, 0xDD, 0xEE, id}, 1};
+  return job;
+}
+
+// One wake job from `node`, returns the datagram length
+static size_t batch(uint8_t* out, uint16_t node, uint32_t session, uint32_t seq) {
+  RelayWriter writer(out, RELAY_MAX_DATAGRAM);
+  RelayHeader header = {RELAY_MSG_BATCH, node, 0, session, seq};
+  writer.begin(header);
+  writer.add(wakeJob(0));
+  return writer.finish(key);
+}
+
+void setUp(void) {
+  replyLen = 0;
+}
+
+void tearDown(void) {}
+
+// Reference vectors from the SipHash paper: key 00..0f, messages 00..len-1
+void test_siphash_vectors(void) {
+  uint8_t message[15];
+  for (int i = 0; i < 15; i++) message[i] = i;
+  TEST_ASSERT_EQUAL_HEX64(0x726fdb47dd0e0e31ULL, relaySipHash(key, message, 0));
+  TEST_ASSERT_EQUAL_HEX64(0xa129ca6149be45e5ULL, relaySipHash(key, message, 15));
+}
+
+void test_batch_round_trip(void) {
+  uint8_t data[RELAY_MAX_DATAGRAM];
+  RelayWriter writer(data, sizeof(data));
+  RelayHeader header = {RELAY_MSG_BATCH, 7, 0, 42, 3};
+  writer.begin(header);
+  TEST_ASSERT_TRUE(writer.add(wakeJob(0)));
+  RelayJob probe = {RELAY_JOB_PROBE, 1, 22, 0xC0A8140A, {0}, 800};
+  TEST_ASSERT_TRUE(writer.add(probe));
+  RelayResult wrongType = {RELAY_JOB_WAKE, 0, RELAY_OK, 0};
+  TEST_ASSERT_FALSE(writer.add(wrongType));
+  size_t len = writer.finish(key);
+  TEST_ASSERT_EQUAL(RELAY_HEADER_SIZE + 2 * RELAY_JOB_SIZE + RELAY_TAG_SIZE, len);
+
+  RelayReader reader;
+  TEST_ASSERT_TRUE(reader.open(data, len, key));
+  TEST_ASSERT_EQUAL(7, reader.header().node);
+  TEST_ASSERT_EQUAL(2, reader.header().count);
+  TEST_ASSERT_EQUAL(42, reader.header().session);
+  TEST_ASSERT_EQUAL(3, reader.header().seq);
+
+  RelayJob job;
+  TEST_ASSERT_TRUE(reader.job(1, job));
+  TEST_ASSERT_EQUAL(RELAY_JOB_PROBE, job.type);
+  TEST_ASSERT_EQUAL(22, job.port);
+  TEST_ASSERT_EQUAL_HEX32(0xC0A8140A, job.ip);
+  TEST_ASSERT_EQUAL(800, job.param);
+  TEST_ASSERT_TRUE(reader.job(0, job));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(wakeJob(0).mac, job.mac, 6);
+  TEST_ASSERT_FALSE(reader.job(2, job));
+}
+
+void test_tag_mismatch(void) {
+  uint8_t data[RELAY_MAX_DATAGRAM];
+  size_t len = batch(data, 7, 1, 1);
+  RelayReader reader;
+  TEST_ASSERT_TRUE(reader.open(data, len, key));
+
+  // Any flipped bit, in the body or the tag, fails the check
+  const size_t flips[] = {9, RELAY_HEADER_SIZE + 4, len - 1};
+  for (size_t i : flips) {
+    data[i] ^= 0x01;
+    TEST_ASSERT_FALSE(reader.open(data, len, key));
+    data[i] ^= 0x01;
+  }
+
+  uint8_t otherKey[RELAY_KEY_SIZE];
+  memcpy(otherKey, key, sizeof(otherKey));
+  otherKey[15] ^= 0x80;
+  TEST_ASSERT_FALSE(reader.open(data, len, otherKey));
+  TEST_ASSERT_FALSE(reader.open(data, len - 1, key));
+
+  RelayNode node(key, 2, hooks);
+  data[len - 1] ^= 0x01;
+  TEST_ASSERT_EQUAL(-1, node.handle(data, len));
+  TEST_ASSERT_EQUAL(1, node.stats().rejectedAuth);
+  TEST_ASSERT_EQUAL(0, replyLen);
+}
+
+void test_replayed_seq(void) {
+  RelayNode node(key, 2, hooks);
+  uint8_t first[RELAY_MAX_DATAGRAM], second[RELAY_MAX_DATAGRAM];
+  size_t firstLen = batch(first, 7, 1, 1);
+  size_t secondLen = batch(second, 7, 1, 2);
+
+  TEST_ASSERT_EQUAL(1, node.handle(first, firstLen));
+  TEST_ASSERT_EQUAL(-1, node.handle(first, firstLen));
+  TEST_ASSERT_EQUAL(1, node.handle(second, secondLen));
+  TEST_ASSERT_EQUAL(-1, node.handle(first, firstLen));
+  TEST_ASSERT_EQUAL(2, node.stats().rejectedReplay);
+  TEST_ASSERT_EQUAL(2, node.stats().batches);
+}
+
+// A front-end reboot starts a new session at seq 1; the old one stays closed
+void test_new_session_resets_window(void) {
+  RelayNode node(key, 2, hooks);
+  uint8_t old[RELAY_MAX_DATAGRAM], fresh[RELAY_MAX_DATAGRAM];
+  size_t oldLen = batch(old, 7, 5, 10);
+  size_t freshLen = batch(fresh, 7, 6, 1);
+
+  TEST_ASSERT_EQUAL(1, node.handle(old, oldLen));
+  TEST_ASSERT_EQUAL(1, node.handle(fresh, freshLen));
+  TEST_ASSERT_EQUAL(-1, node.handle(old, oldLen));
+
+  size_t laterLen = batch(old, 7, 5, 11);
+  TEST_ASSERT_EQUAL(-1, node.handle(old, laterLen));
+  TEST_ASSERT_EQUAL(2, node.stats().rejectedReplay);
+}
+
+// Senders are tracked per node id; another sender's window is its own
+void test_sender_table_fallback(void) {
+  RelayNode node(key, 2, hooks);
+  uint8_t data[RELAY_MAX_DATAGRAM];
+  size_t len;
+
+  // Nodes 10..17 fill the table in order
+  for (uint16_t sender = 10; sender < 18; sender++) {
+    len = batch(data, sender, 1, 5);
+    TEST_ASSERT_EQUAL(1, node.handle(data, len));
+  }
+
+  // A ninth sender takes slot 18 % 8, which node 12 held
+  len = batch(data, 18, 1, 5);
+  TEST_ASSERT_EQUAL(1, node.handle(data, len));
+  TEST_ASSERT_EQUAL(-1, node.handle(data, len));
+
+  // Node 12 lost its window, node 10 kept its own
+  len = batch(data, 12, 1, 5);
+  TEST_ASSERT_EQUAL(1, node.handle(data, len));
+  len = batch(data, 10, 1, 5);
+  TEST_ASSERT_EQUAL(-1, node.handle(data, len));
+}
+
+void test_results_only_from_the_jobs_relay(void) {
+  RelayDispatcher dispatcher(key, 1, 9);
+  dispatcher.setRelayNode(0, 2);
+  dispatcher.setRelayNode(1, 3);
+  TEST_ASSERT_EQUAL(0, dispatcher.add(0, wakeJob(0)));
+  TEST_ASSERT_EQUAL(1, dispatcher.add(1, wakeJob(0)));
+
+  uint8_t sent[RelayDispatcher::MAX_RELAYS][RELAY_MAX_DATAGRAM];
+  size_t sentLen[RelayDispatcher::MAX_RELAYS] = {};
+  struct Capture {
+    uint8_t (*sent)[RELAY_MAX_DATAGRAM];
+    size_t* sentLen;
+  } capture = {sent, sentLen};
+  auto send = [](uint8_t relay, const uint8_t* data, size_t len, void* ctx) {
+    Capture* c = (Capture*)ctx;
+    memcpy(c->sent[relay], data, len);
+    c->sentLen[relay] = len;
+  };
+  TEST_ASSERT_EQUAL(2, dispatcher.transmit(send, &capture, 0));
+
+  // Node 3 runs relay 0's batch: its answer must not complete job 0
+  RelayNode intruder(key, 3, hooks);
+  TEST_ASSERT_EQUAL(1, intruder.handle(sent[0], sentLen[0]));
+  TEST_ASSERT_TRUE(dispatcher.receive(reply, replyLen, 5));
+  TEST_ASSERT_EQUAL(RELAY_PENDING, dispatcher.result(0).status);
+  TEST_ASSERT_EQUAL(RELAY_PENDING, dispatcher.result(1).status);
+
+  RelayNode relay0(key, 2, hooks);
+  TEST_ASSERT_EQUAL(1, relay0.handle(sent[0], sentLen[0]));
+  TEST_ASSERT_TRUE(dispatcher.receive(reply, replyLen, 6));
+  TEST_ASSERT_EQUAL(RELAY_OK, dispatcher.result(0).status);
+  TEST_ASSERT_FALSE(dispatcher.done());
+
+  RelayNode relay1(key, 3, hooks);
+  TEST_ASSERT_EQUAL(1, relay1.handle(sent[1], sentLen[1]));
+  TEST_ASSERT_TRUE(dispatcher.receive(reply, replyLen, 7));
+  TEST_ASSERT_TRUE(dispatcher.done());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_siphash_vectors);
+  RUN_TEST(test_batch_round_trip);
+  RUN_TEST(test_tag_mismatch);
+  RUN_TEST(test_replayed_seq);
+  RUN_TEST(test_new_session_resets_window);
+  RUN_TEST(test_sender_table_fallback);
+  RUN_TEST(test_results_only_from_the_jobs_relay);
+  return UNITY_END();
+}
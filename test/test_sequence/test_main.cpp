@@ -0,0 +1,174 @@
+#include <WakeSequence.h>
+#include <unity.h>
+
+// Simulated hosts: up from the start, or up bootMs after their WoL
+struct Lab {
+  bool up[SEQ_MAX_HOSTS];
+  bool woke[SEQ_MAX_HOSTS];
+  uint32_t wokeMs[SEQ_MAX_HOSTS];
+  uint32_t bootMs[SEQ_MAX_HOSTS];
+  uint32_t nowMs;
+  int probes;
+  int pending;             // Probes left that answer SEQ_PROBE_PENDING
+  int wakes;
+};
+
+static Lab lab;
+
+static bool labWake(uint8_t host, void* ctx) {
+  lab.woke[host] = true;
+  lab.wokeMs[host] = lab.nowMs;
+  lab.wakes++;
+  return true;
+}
+
+static SeqProbe labProbe(uint8_t host, void* ctx) {
+  lab.probes++;
+  if (lab.pending > 0) {
+    lab.pending--;
+    return SEQ_PROBE_PENDING;
+  }
+  bool up = lab.up[host] || (lab.woke[host] && lab.nowMs - lab.wokeMs[host] >= lab.bootMs[host]);
+  return up ? SEQ_PROBE_UP : SEQ_PROBE_DOWN;
+}
+
+static const WakeSequencer::Hooks hooks = {labWake, labProbe, NULL};
+static const WakeSequencer::Config config = {2, 1000, 500, 30000};
+
+// Steps every 100 ms until the plan is done, returns the steps taken
+static int run(WakeSequencer& seq, uint32_t limitMs) {
+  int steps = 0;
+  while (seq.step(lab.nowMs) && lab.nowMs < limitMs) {
+    lab.nowMs += 100;
+    steps++;
+  }
+  return steps;
+}
+
+void setUp(void) {
+  lab = Lab();
+}
+
+void tearDown(void) {}
+
+void test_rejects_cycle_and_unknown_dependency(void) {
+  WakeSequencer seq(hooks, config);
+  seq.addHost(1u << 1);
+  seq.addHost(1u << 0);
+  TEST_ASSERT_FALSE(seq.start(0));
+
+  seq.reset();
+  seq.addHost(1u << 5);
+  TEST_ASSERT_FALSE(seq.start(0));
+}
+
+void test_one_probe_per_step(void) {
+  WakeSequencer seq(hooks, config);
+  for (int i = 0; i < 4; i++) seq.addHost(0);
+  TEST_ASSERT_TRUE(seq.start(0));
+
+  for (int step = 1; step <= 4; step++) {
+    seq.step(lab.nowMs);
+    TEST_ASSERT_EQUAL(step, lab.probes);
+  }
+  for (int i = 0; i < 4; i++) TEST_ASSERT_TRUE(seq.host(i).checked);
+}
+
+// The pre-wake probe finds the dependency up: its dependent is released at once
+void test_online_host_releases_dependents_same_step(void) {
+  lab.up[0] = true;
+  WakeSequencer seq(hooks, config);
+  seq.addHost(0);
+  seq.addHost(1u << 0);
+  TEST_ASSERT_TRUE(seq.start(0));
+
+  seq.step(0);
+  TEST_ASSERT_EQUAL(SEQ_ONLINE, seq.host(0).state);
+  TEST_ASSERT_TRUE(seq.host(0).wasOnline);
+  TEST_ASSERT_EQUAL(SEQ_READY, seq.host(1).state);
+  TEST_ASSERT_EQUAL(0, lab.wakes);
+}
+
+// A host is not woken while its pre-wake probe has no answer yet
+void test_pending_probe_holds_the_wake(void) {
+  lab.up[0] = true;
+  lab.pending = 3;
+  WakeSequencer seq(hooks, config);
+  seq.addHost(0);
+  TEST_ASSERT_TRUE(seq.start(0));
+
+  for (int step = 0; step < 3; step++) {
+    TEST_ASSERT_TRUE(seq.step(lab.nowMs));
+    TEST_ASSERT_FALSE(seq.host(0).checked);
+    lab.nowMs += 100;
+  }
+  TEST_ASSERT_FALSE(seq.step(lab.nowMs));
+  TEST_ASSERT_TRUE(seq.host(0).wasOnline);
+  TEST_ASSERT_EQUAL(0, lab.wakes);
+}
+
+void test_chain_waits_for_dependencies(void) {
+  // 0 <- 1 <- 2, and 3 independent
+  for (int i = 0; i < 4; i++) lab.bootMs[i] = 5000;
+  WakeSequencer seq(hooks, config);
+  seq.addHost(0);
+  seq.addHost(1u << 0);
+  seq.addHost(1u << 1);
+  seq.addHost(0);
+  TEST_ASSERT_TRUE(seq.start(0));
+  run(seq, 120000);
+
+  for (int i = 0; i < 4; i++) TEST_ASSERT_EQUAL(SEQ_ONLINE, seq.host(i).state);
+  TEST_ASSERT_EQUAL(4, lab.wakes);
+  TEST_ASSERT_GREATER_OR_EQUAL(seq.host(0).doneMs, seq.host(1).wokeMs);
+  TEST_ASSERT_GREATER_OR_EQUAL(seq.host(1).doneMs, seq.host(2).wokeMs);
+  TEST_ASSERT_GREATER_OR_EQUAL(config.staggerMs, seq.host(3).wokeMs - seq.host(0).wokeMs);
+
+  uint8_t path[SEQ_MAX_HOSTS];
+  TEST_ASSERT_EQUAL(3, seq.criticalPath(path, SEQ_MAX_HOSTS));
+  TEST_ASSERT_EQUAL(0, path[0]);
+  TEST_ASSERT_EQUAL(2, path[2]);
+}
+
+void test_concurrency_cap(void) {
+  for (int i = 0; i < 5; i++) lab.bootMs[i] = 10000;
+  WakeSequencer seq(hooks, config);
+  for (int i = 0; i < 5; i++) seq.addHost(0);
+  TEST_ASSERT_TRUE(seq.start(0));
+
+  int most = 0;
+  while (seq.step(lab.nowMs) && lab.nowMs < 120000) {
+    int powering = 0;
+    for (int i = 0; i < 5; i++) powering += seq.host(i).state == SEQ_POWERING;
+    if (powering > most) most = powering;
+    lab.nowMs += 100;
+  }
+  TEST_ASSERT_EQUAL(config.maxPowering, most);
+  for (int i = 0; i < 5; i++) TEST_ASSERT_EQUAL(SEQ_ONLINE, seq.host(i).state);
+}
+
+void test_timeout_skips_dependents(void) {
+  lab.bootMs[0] = 60000;   // Longer than the boot timeout
+  WakeSequencer seq(hooks, config);
+  seq.addHost(0);
+  seq.addHost(1u << 0);
+  TEST_ASSERT_TRUE(seq.start(0));
+  run(seq, 120000);
+
+  TEST_ASSERT_EQUAL(SEQ_FAILED, seq.host(0).state);
+  TEST_ASSERT_EQUAL(SEQ_SKIPPED, seq.host(1).state);
+  TEST_ASSERT_EQUAL(1, lab.wakes);
+  TEST_ASSERT_GREATER_OR_EQUAL(config.bootTimeoutMs, seq.host(0).doneMs - seq.host(0).wokeMs);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_rejects_cycle_and_unknown_dependency);
+  RUN_TEST(test_one_probe_per_step);
+  RUN_TEST(test_online_host_releases_dependents_same_step);
+  RUN_TEST(test_pending_probe_holds_the_wake);
+  RUN_TEST(test_chain_waits_for_dependencies);
+  RUN_TEST(test_concurrency_cap);
+  RUN_TEST(test_timeout_skips_dependents);
+  return UNITY_END();
+}
@@ -0,0 +1,355 @@
+#include <SleepProxy.h>
+#include <string.h>
+#include <unity.h>
+
+// A switch in front of three stations: frames reach the station they are
+// addressed to, broadcasts reach everyone but the sender. Transmissions are
+// queued and delivered in order, so a reply sent from inside input() never
+// re-enters it.
+enum Station { PROXY_STATION, CLIENT_STATION, HOST_STATION, STATION_COUNT };
+
+static const uint8_t stationMac[STATION_COUNT][6] = {
+    {0x02, 0xE5, 0x32, 0x00, 0x00, 0x01},
+    {0x02, 0xC1, 0x1E, 0x00, 0x00, 0x02},
+    {0xA1, 0xAA, 0x1A, 0x1A, 0x11, 0xA1},
+};
+static const uint32_t stationIp[STATION_COUNT] = {0xC0A80164, 0xC0A8010A, 0xC0A801E4};
+static const uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const uint8_t zeroMac[6] = {0, 0, 0, 0, 0, 0};
+static const uint16_t simPorts[] = {22, 443};
+static const uint32_t BOOT_MS = 25000;
+static const uint32_t RETRY_MS = 90000;
+
+struct SimFrame {
+  int from;
+  size_t len;
+  uint8_t data[64];
+};
+
+struct Sim {
+  uint32_t now;
+  bool hostAnnounces;
+  SleepProxy* proxy;
+
+  SimFrame queue[32];
+  int queued;
+  int lost;
+
+  // Client: connects to the host's port 22 at 1 s, Linux-like SYN backoff
+  bool clientKnowsHost;
+  uint8_t clientHostMac[6];
+  uint32_t nextArpMs;
+  uint32_t nextSynMs;
+  uint32_t synBackoffMs;
+  int synsSent;
+  uint32_t firstSynMs;
+  uint32_t connectedMs;
+  bool proxyMacLearned;
+
+  // Host: powered down until a wake plus BOOT_MS
+  uint32_t wakeMs;
+  uint32_t hostUpMs;
+  bool hostUp;
+  int wakes;
+  uint32_t lastWakeMs;
+  uint32_t minWakeGapMs;
+
+  // Proxy station: boot monitoring ARPs the host while it wakes
+  uint32_t nextMonitorMs;
+  int handovers;
+  uint32_t arpAnsweredAtHandover;
+};
+
+static Sim sim;
+
+static uint16_t get16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put16(uint8_t* p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v & 0xFF;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  put16(p, v >> 16);
+  put16(p + 2, v & 0xFFFF);
+}
+
+// Ethernet + IPv4 + TCP SYN without options, 54 bytes
+static size_t buildSynFrame(uint8_t* out, const uint8_t ethSrc[6], const uint8_t ethDst[6], uint32_t src,
+                            uint32_t dst, uint16_t dport) {
+  memset(out, 0, 54);
+  memcpy(out, ethDst, 6);
+  memcpy(out + 6, ethSrc, 6);
+  put16(out + 12, PROXY_ETHERTYPE_IPV4);
+
+  uint8_t* ip = out + PROXY_ETH_HEADER_SIZE;
+  ip[0] = 0x45;
+  put16(ip + 2, 40);
+  put16(ip + 6, 0x4000);   // Don't fragment
+  ip[8] = 64;
+  ip[9] = 6;
+  put32(ip + 12, src);
+  put32(ip + 16, dst);
+
+  uint8_t* tcp = ip + 20;
+  put16(tcp, 50000);
+  put16(tcp + 2, dport);
+  tcp[12] = 5 << 4;
+  tcp[13] = 0x02;          // SYN
+  return 54;
+}
+
+static void simSend(int from, const uint8_t* frame, size_t len) {
+  if (sim.queued >= (int)(sizeof(sim.queue) / sizeof(sim.queue[0])) || len > sizeof(sim.queue[0].data)) {
+    sim.lost++;
+    return;
+  }
+  SimFrame& f = sim.queue[sim.queued++];
+  f.from = from;
+  f.len = len;
+  memcpy(f.data, frame, len);
+}
+
+static void simTransmit(const uint8_t* frame, size_t len, void* ctx) {
+  simSend(PROXY_STATION, frame, len);
+}
+
+static void simWake(uint8_t host, uint32_t client, uint16_t port, void* ctx) {
+  if (sim.wakes++ && sim.now - sim.lastWakeMs < sim.minWakeGapMs) sim.minWakeGapMs = sim.now - sim.lastWakeMs;
+  sim.lastWakeMs = sim.now;
+  if (!sim.wakeMs) {
+    sim.wakeMs = sim.now;
+    sim.hostUpMs = sim.now + BOOT_MS;
+    sim.nextMonitorMs = sim.now;
+  }
+}
+
+static void simHandover(uint8_t host, const SleepProxy::Event& event, void* ctx) {
+  sim.handovers++;
+  sim.arpAnsweredAtHandover = sim.proxy->stats(host).arpAnswered;
+}
+
+static const SleepProxy::Hooks hooks = {simTransmit, simWake, simHandover, NULL};
+
+static void clientReceive(const uint8_t* frame, size_t len) {
+  if (len < PROXY_ARP_FRAME_SIZE || get16(frame + 12) != PROXY_ETHERTYPE_ARP) return;
+  const uint8_t* arp = frame + PROXY_ETH_HEADER_SIZE;
+  uint16_t op = get16(arp + 6);
+  uint32_t spa = get32(arp + 14), tpa = get32(arp + 24);
+  if (spa != stationIp[HOST_STATION]) return;
+
+  // Replies to our request create the entry, announcements only update it
+  bool reply = op == PROXY_ARP_REPLY && tpa == stationIp[CLIENT_STATION];
+  if (!reply && !(spa == tpa && sim.clientKnowsHost)) return;
+  memcpy(sim.clientHostMac, arp + 8, 6);
+  if (!sim.clientKnowsHost && memcmp(arp + 8, stationMac[PROXY_STATION], 6) == 0) sim.proxyMacLearned = true;
+  sim.clientKnowsHost = true;
+}
+
+static void hostReceive(const uint8_t* frame, size_t len) {
+  if (!sim.hostUp) return;
+  uint16_t type = get16(frame + 12);
+  if (type == PROXY_ETHERTYPE_ARP && len >= PROXY_ARP_FRAME_SIZE) {
+    const uint8_t* arp = frame + PROXY_ETH_HEADER_SIZE;
+    uint32_t spa = get32(arp + 14);
+    if (get16(arp + 6) != PROXY_ARP_REQUEST || get32(arp + 24) != stationIp[HOST_STATION] || spa == 0) return;
+    uint8_t reply[PROXY_ARP_FRAME_SIZE];
+    buildArpFrame(reply, stationMac[HOST_STATION], arp + 8, PROXY_ARP_REPLY, stationMac[HOST_STATION],
+                  stationIp[HOST_STATION], arp + 8, spa);
+    simSend(HOST_STATION, reply, sizeof(reply));
+  } else if (type == PROXY_ETHERTYPE_IPV4 && len >= 54 && frame[PROXY_ETH_HEADER_SIZE + 9] == 6) {
+    if (!sim.connectedMs) sim.connectedMs = sim.now;
+  }
+}
+
+static void simDeliver() {
+  for (int i = 0; i < sim.queued; i++) {
+    // Copy out: stations may queue more frames while we walk the queue
+    SimFrame f = sim.queue[i];
+    bool broadcast = memcmp(f.data, broadcastMac, 6) == 0;
+    for (int s = 0; s < STATION_COUNT; s++) {
+      if (s == f.from || (!broadcast && memcmp(f.data, stationMac[s], 6) != 0)) continue;
+      if (s == PROXY_STATION) sim.proxy->input(f.data, f.len, sim.now);
+      if (s == CLIENT_STATION) clientReceive(f.data, f.len);
+      if (s == HOST_STATION) hostReceive(f.data, f.len);
+    }
+  }
+  sim.queued = 0;
+}
+
+static void clientArpRequest() {
+  uint8_t frame[PROXY_ARP_FRAME_SIZE];
+  buildArpFrame(frame, stationMac[CLIENT_STATION], broadcastMac, PROXY_ARP_REQUEST, stationMac[CLIENT_STATION],
+                stationIp[CLIENT_STATION], zeroMac, stationIp[HOST_STATION]);
+  simSend(CLIENT_STATION, frame, sizeof(frame));
+}
+
+static void simTick() {
+  uint8_t frame[64];
+
+  // Client: resolve the host, then SYN with exponential backoff
+  if (!sim.connectedMs && sim.now >= 1000) {
+    if (!sim.clientKnowsHost && sim.now >= sim.nextArpMs) {
+      clientArpRequest();
+      sim.nextArpMs = sim.now + 1000;
+    } else if (sim.clientKnowsHost && sim.now >= sim.nextSynMs) {
+      size_t len = buildSynFrame(frame, stationMac[CLIENT_STATION], sim.clientHostMac, stationIp[CLIENT_STATION],
+                                 stationIp[HOST_STATION], 22);
+      simSend(CLIENT_STATION, frame, len);
+      if (!sim.synsSent++) sim.firstSynMs = sim.now;
+      sim.nextSynMs = sim.now + sim.synBackoffMs;
+      sim.synBackoffMs *= 2;
+    }
+  }
+
+  // Host: boots, then probes and announces its address unless it is quiet
+  if (sim.wakeMs && !sim.hostUp && sim.now >= sim.hostUpMs) {
+    sim.hostUp = true;
+    if (sim.hostAnnounces) {
+      buildArpFrame(frame, stationMac[HOST_STATION], broadcastMac, PROXY_ARP_REQUEST, stationMac[HOST_STATION], 0,
+                    zeroMac, stationIp[HOST_STATION]);
+      simSend(HOST_STATION, frame, PROXY_ARP_FRAME_SIZE);
+    }
+  }
+  if (sim.hostUp && sim.hostAnnounces && sim.now == sim.hostUpMs + 200) {
+    buildArpFrame(frame, stationMac[HOST_STATION], broadcastMac, PROXY_ARP_REQUEST, stationMac[HOST_STATION],
+                  stationIp[HOST_STATION], zeroMac, stationIp[HOST_STATION]);
+    simSend(HOST_STATION, frame, PROXY_ARP_FRAME_SIZE);
+  }
+
+  // Proxy station: the stack's own ARP for the host, like checkBootStages()
+  if (sim.proxy->state(0) == PROXY_WAKING && sim.now >= sim.nextMonitorMs) {
+    buildArpFrame(frame, stationMac[PROXY_STATION], broadcastMac, PROXY_ARP_REQUEST, stationMac[PROXY_STATION],
+                  stationIp[PROXY_STATION], zeroMac, stationIp[HOST_STATION]);
+    simSend(PROXY_STATION, frame, PROXY_ARP_FRAME_SIZE);
+    sim.nextMonitorMs = sim.now + 3000;
+  }
+
+  simDeliver();
+}
+
+// Client connects to the sleeping host until it gets through, then asks for
+// the host once more
+static void runScenario(bool hostAnnounces) {
+  sim.hostAnnounces = hostAnnounces;
+  SleepProxy proxy(stationMac[PROXY_STATION], hooks, RETRY_MS);
+  sim.proxy = &proxy;
+  proxy.addHost(stationIp[HOST_STATION], stationMac[HOST_STATION], simPorts, 2);
+  proxy.start(0, 0);
+  simDeliver();
+
+  for (sim.now = 0; sim.now < 300000 && !(sim.connectedMs && sim.now > sim.connectedMs + 5000); sim.now++) {
+    simTick();
+  }
+  clientArpRequest();
+  simDeliver();
+
+  const SleepProxy::Event& event = proxy.event(0);
+  TEST_ASSERT_EQUAL(0, sim.lost);
+  TEST_ASSERT_TRUE_MESSAGE(sim.proxyMacLearned, "client resolved the host to the proxy");
+  TEST_ASSERT_EQUAL_MESSAGE(sim.firstSynMs, sim.wakeMs, "first SYN woke the host");
+  TEST_ASSERT_GREATER_OR_EQUAL(RETRY_MS, sim.minWakeGapMs);
+  TEST_ASSERT_EQUAL(1, sim.handovers);
+  TEST_ASSERT_FALSE(event.released);
+  TEST_ASSERT_GREATER_OR_EQUAL(sim.hostUpMs, event.handoverMs);
+  TEST_ASSERT_GREATER_THAN_MESSAGE(event.handoverMs, sim.connectedMs, "retransmitted SYN reached the host");
+  TEST_ASSERT_EQUAL_MESSAGE(sim.arpAnsweredAtHandover, proxy.stats(0).arpAnswered, "no ARP answered after the handover");
+  TEST_ASSERT_EQUAL(PROXY_OFF, proxy.state(0));
+}
+
+void setUp(void) {
+  sim = Sim();
+  sim.synBackoffMs = 1000;
+  sim.minWakeGapMs = UINT32_MAX;
+}
+
+void tearDown(void) {}
+
+void test_answers_arp_only_while_active(void) {
+  SleepProxy proxy(stationMac[PROXY_STATION], hooks, RETRY_MS);
+  sim.proxy = &proxy;
+  proxy.addHost(stationIp[HOST_STATION], stationMac[HOST_STATION], simPorts, 2);
+
+  clientArpRequest();
+  simDeliver();
+  TEST_ASSERT_FALSE(sim.clientKnowsHost);
+
+  proxy.start(0, 0);
+  clientArpRequest();
+  simDeliver();
+  TEST_ASSERT_TRUE(sim.proxyMacLearned);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(stationMac[PROXY_STATION], sim.clientHostMac, 6);
+  TEST_ASSERT_EQUAL(1, proxy.stats(0).arpAnswered);
+}
+
+void test_syn_to_service_port_wakes(void) {
+  SleepProxy proxy(stationMac[PROXY_STATION], hooks, RETRY_MS);
+  sim.proxy = &proxy;
+  proxy.addHost(stationIp[HOST_STATION], stationMac[HOST_STATION], simPorts, 2);
+  proxy.start(0, 0);
+
+  // Another port is swallowed without a wake
+  uint8_t frame[64];
+  buildSynFrame(frame, stationMac[CLIENT_STATION], stationMac[PROXY_STATION], stationIp[CLIENT_STATION],
+                stationIp[HOST_STATION], 8080);
+  TEST_ASSERT_TRUE(proxy.input(frame, 54, 1000));
+  TEST_ASSERT_EQUAL(0, sim.wakes);
+  TEST_ASSERT_EQUAL(1, proxy.stats(0).dropped);
+
+  buildSynFrame(frame, stationMac[CLIENT_STATION], stationMac[PROXY_STATION], stationIp[CLIENT_STATION],
+                stationIp[HOST_STATION], 443);
+  sim.now = 2000;
+  TEST_ASSERT_TRUE(proxy.input(frame, 54, sim.now));
+  TEST_ASSERT_EQUAL(1, sim.wakes);
+  TEST_ASSERT_EQUAL(PROXY_WAKING, proxy.state(0));
+  TEST_ASSERT_EQUAL(443, proxy.event(0).port);
+  TEST_ASSERT_EQUAL_HEX32(stationIp[CLIENT_STATION], proxy.event(0).client);
+
+  // Retransmissions wake again only after the retry interval
+  TEST_ASSERT_TRUE(proxy.input(frame, 54, sim.now + RETRY_MS - 1));
+  TEST_ASSERT_EQUAL(1, sim.wakes);
+  sim.now += RETRY_MS;
+  TEST_ASSERT_TRUE(proxy.input(frame, 54, sim.now));
+  TEST_ASSERT_EQUAL(2, sim.wakes);
+  TEST_ASSERT_EQUAL(3, proxy.stats(0).syns);
+}
+
+void test_release_announces_the_host(void) {
+  SleepProxy proxy(stationMac[PROXY_STATION], hooks, RETRY_MS);
+  sim.proxy = &proxy;
+  proxy.addHost(stationIp[HOST_STATION], stationMac[HOST_STATION], simPorts, 2);
+  proxy.start(0, 0);
+  clientArpRequest();
+  simDeliver();
+
+  proxy.release(0, 5000);
+  simDeliver();
+  TEST_ASSERT_EQUAL(1, sim.handovers);
+  TEST_ASSERT_TRUE(proxy.event(0).released);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(stationMac[HOST_STATION], sim.clientHostMac, 6);
+}
+
+void test_announcing_host(void) {
+  runScenario(true);
+}
+
+// Never announces itself: only its reply to the boot monitoring's ARP ends the proxying
+void test_quiet_host(void) {
+  runScenario(false);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_answers_arp_only_while_active);
+  RUN_TEST(test_syn_to_service_port_wakes);
+  RUN_TEST(test_release_announces_the_host);
+  RUN_TEST(test_announcing_host);
+  RUN_TEST(test_quiet_host);
+  return UNITY_END();
+}
@@ -0,0 +1,99 @@
+#include <SpanTrace.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+
+static void collect(const char* text, size_t len, void* ctx) {
+  ((std::string*)ctx)->append(text, len);
+}
+
+static const TraceEvent* find(const char* name) {
+  for (size_t i = 0; i < traceCount(); i++) {
+    if (strcmp(traceEvent(i).name, name) == 0) return &traceEvent(i);
+  }
+  return NULL;
+}
+
+void setUp(void) {
+  traceClear();
+  traceOn = true;
+}
+
+void tearDown(void) {
+  traceOn = false;
+}
+
+void test_ring_wraparound(void) {
+  for (int i = 0; i < TRACE_CAPACITY + 10; i++) traceInstant("tick", i);
+
+  TEST_ASSERT_EQUAL(TRACE_CAPACITY, traceCount());
+  TEST_ASSERT_EQUAL(10, traceOverwritten());
+  // Oldest first: the 10 earliest records are gone
+  TEST_ASSERT_EQUAL(10, traceEvent(0).arg);
+  TEST_ASSERT_EQUAL(TRACE_CAPACITY + 9, traceEvent(TRACE_CAPACITY - 1).arg);
+  for (size_t i = 1; i < traceCount(); i++) {
+    TEST_ASSERT_EQUAL(traceEvent(i - 1).arg + 1, traceEvent(i).arg);
+  }
+
+  traceClear();
+  TEST_ASSERT_EQUAL(0, traceCount());
+  TEST_ASSERT_EQUAL(0, traceOverwritten());
+}
+
+// The inner span closes first and lies within the outer one
+void test_nested_spans(void) {
+  {
+    TRACE_SPAN("outer");
+    {
+      TraceSpan inner("inner");
+      inner.arg(7);
+      for (volatile int i = 0; i < 100000; i++) {}
+    }
+    TRACE_MARK("after", 3);
+  }
+
+  TEST_ASSERT_EQUAL(3, traceCount());
+  TEST_ASSERT_EQUAL_STRING("inner", traceEvent(0).name);
+  TEST_ASSERT_EQUAL_STRING("after", traceEvent(1).name);
+  TEST_ASSERT_EQUAL_STRING("outer", traceEvent(2).name);
+
+  const TraceEvent* outer = find("outer");
+  const TraceEvent* inner = find("inner");
+  TEST_ASSERT_EQUAL(7, inner->arg);
+  TEST_ASSERT_EQUAL(0, outer->arg);
+  TEST_ASSERT_TRUE((int32_t)(inner->start - outer->start) >= 0);
+  TEST_ASSERT_TRUE(inner->start + inner->duration <= outer->start + outer->duration);
+  TEST_ASSERT_EQUAL_HEX32(TRACE_INSTANT, find("after")->duration);
+}
+
+// A span opened while tracing is off stays silent, even if tracing starts before it ends
+void test_off_records_nothing(void) {
+  traceOn = false;
+  {
+    TRACE_SPAN("quiet");
+    traceOn = true;
+  }
+  TEST_ASSERT_EQUAL(0, traceCount());
+}
+
+void test_export_json(void) {
+  for (int i = 0; i < TRACE_CAPACITY + 2; i++) traceInstant("tick", i);
+  traceComplete("span", traceMicros(), -1);
+
+  std::string json;
+  size_t written = traceExport(collect, &json);
+  TEST_ASSERT_EQUAL(json.size(), written);
+  TEST_ASSERT_TRUE(json.find("\"overwritten\":3") != std::string::npos);
+  TEST_ASSERT_TRUE(json.find("\"name\":\"span\",\"ph\":\"X\"") != std::string::npos);
+  TEST_ASSERT_TRUE(json.find("\"args\":{\"v\":-1}") != std::string::npos);
+  TEST_ASSERT_EQUAL_STRING("\n]}\n", json.c_str() + json.size() - 4);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_ring_wraparound);
+  RUN_TEST(test_nested_spans);
+  RUN_TEST(test_off_records_nothing);
+  RUN_TEST(test_export_json);
+  return UNITY_END();
+}
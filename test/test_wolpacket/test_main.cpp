@@ -0,0 +1,63 @@
+#include <WolPacket.h>
+#include <string.h>
+#include <unity.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_parse_mac(void) {
+  const uint8_t expected[WOL_MAC_SIZE] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xAB};
+  uint8_t mac[WOL_MAC_SIZE] = {};
+  TEST_ASSERT_TRUE(parseMac("01:23:45:67:89:AB", mac));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, mac, WOL_MAC_SIZE);
+
+  memset(mac, 0, sizeof(mac));
+  TEST_ASSERT_TRUE(parseMac("01-23-45-67-89-ab", mac));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, mac, WOL_MAC_SIZE);
+}
+
+// Malformed input fails and leaves mac as it was
+void test_parse_mac_rejects_malformed(void) {
+  const char* const malformed[] = {
+      "",
+      "01:23:45:67:89",           // Too short
+      "01:23:45:67:89:AB:CD",     // Too long
+      "01:23:45:67:89:AB:",       // Trailing separator
+      "01:23:45:67:89:A",         // Half a byte
+      "01:23:45:67:89:AG",        // Not hex
+      "0123:45:67:89:AB",         // Missing separator
+      "01.23.45.67.89.AB",        // Wrong separator
+      " 01:23:45:67:89:AB",       // Leading space
+  };
+  uint8_t untouched[WOL_MAC_SIZE];
+  memset(untouched, 0x5A, sizeof(untouched));
+  for (const char* text : malformed) {
+    uint8_t mac[WOL_MAC_SIZE];
+    memcpy(mac, untouched, sizeof(mac));
+    TEST_ASSERT_FALSE_MESSAGE(parseMac(text, mac), text);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(untouched, mac, WOL_MAC_SIZE);
+  }
+
+  uint8_t mac[WOL_MAC_SIZE];
+  TEST_ASSERT_FALSE(parseMac(NULL, mac));
+}
+
+// The runtime builder and the compile-time one produce the same packet
+void test_runtime_packet_matches_constexpr(void) {
+  constexpr WolMagicPacket expected = makeMagicPacket("01:23:45:67:89:AB");
+  uint8_t mac[WOL_MAC_SIZE];
+  TEST_ASSERT_TRUE(parseMac("01:23:45:67:89:AB", mac));
+  uint8_t packet[WOL_PACKET_SIZE];
+  buildMagicPacket(mac, packet);
+  TEST_ASSERT_EQUAL(WOL_PACKET_SIZE, expected.size);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected.bytes, packet, WOL_PACKET_SIZE);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_mac);
+  RUN_TEST(test_parse_mac_rejects_malformed);
+  RUN_TEST(test_runtime_packet_matches_constexpr);
+  return UNITY_END();
+}
@@ -0,0 +1,373 @@
+// Native relay node and dispatcher for the WoL relay protocol (lib/WolRelay).
+//
+// Runs a relay on a Linux box of a LAN segment, or simulates a whole cluster
+// as several processes on localhost:
+//
+//   wol_relay node --port 40010 --id 2
+//   wol_relay node --port 40011 --id 3
+//   wol_relay dispatch --relay 127.0.0.1:40010,2 --relay 127.0.0.1:40011,3
+//       --wake 0,AA:BB:CC:DD:EE:FF,127.0.0.1 --probe 1,127.0.0.1,22
+//
+// All processes need the same --key (32 hex digits) as RELAY_KEY in the sketch.
+// Each dispatch takes the next session from a counter file (--session-file,
+// default ~/.wol_relay_session), like the sketch's boot counter in NVS. The
+// --id must differ from RELAY_NODE_ID of a front-end using the same relays.
+
+#include <WolPacket.h>
+#include <WolRelay.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint8_t relayKey[RELAY_KEY_SIZE] = {
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+  0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+
+static uint32_t nowMicros() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+static uint32_t nowMillis() {
+  return nowMicros() / 1000;
+}
+
+static sockaddr_in makeAddr(uint32_t ip, uint16_t port) {
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(ip);
+  addr.sin_port = htons(port);
+  return addr;
+}
+
+static bool parseIp(const char* text, uint32_t& ip) {
+  in_addr addr;
+  if (inet_pton(AF_INET, text, &addr) != 1) return false;
+  ip = ntohl(addr.s_addr);
+  return true;
+}
+
+static bool parseKey(const char* hex) {
+  if (strlen(hex) != RELAY_KEY_SIZE * 2) return false;
+  for (size_t i = 0; i < RELAY_KEY_SIZE; i++) {
+    unsigned v;
+    if (sscanf(hex + i * 2, "%2x", &v) != 1) return false;
+    relayKey[i] = (uint8_t)v;
+  }
+  return true;
+}
+
+static int openUdp(uint32_t bindIp, uint16_t port) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) return -1;
+
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &yes, sizeof(yes));
+  sockaddr_in addr = makeAddr(bindIp, port);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// ========== NODE ==========
+struct NodeContext {
+  int fd;
+  sockaddr_in peer;
+  bool dryRun;
+};
+
+static bool nodeWake(const RelayJob& job, void* ctx) {
+  NodeContext* node = (NodeContext*)ctx;
+  uint8_t packet[WOL_PACKET_SIZE];
+  buildMagicPacket(job.mac, packet);
+
+  uint32_t target = job.ip ? job.ip : INADDR_BROADCAST;
+  printf("⚡ wake %02X:%02X:%02X:%02X:%02X:%02X -> %s:%u x%u\n",
+         job.mac[0], job.mac[1], job.mac[2], job.mac[3], job.mac[4], job.mac[5],
+         inet_ntoa(makeAddr(target, 0).sin_addr), job.port, job.param ? job.param : 1);
+  if (node->dryRun) return true;
+
+  sockaddr_in addr = makeAddr(target, job.port);
+  bool ok = true;
+  for (int i = 0; i < (job.param ? job.param : 1); i++) {
+    ok &= sendto(node->fd, packet, sizeof(packet), 0, (sockaddr*)&addr, sizeof(addr)) == (ssize_t)sizeof(packet);
+  }
+  return ok;
+}
+
+static bool nodeProbe(const RelayJob& job, void* ctx) {
+  (void)ctx;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  sockaddr_in addr = makeAddr(job.ip, job.port);
+  bool open = connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+  if (!open && errno == EINPROGRESS) {
+    pollfd pfd = {fd, POLLOUT, 0};
+    if (poll(&pfd, 1, job.param ? job.param : RELAY_DEFAULT_PROBE_TIMEOUT) == 1) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      open = err == 0;
+    }
+  }
+  close(fd);
+
+  printf("🔍 probe %s:%u -> %s\n", inet_ntoa(addr.sin_addr), job.port, open ? "open" : "closed");
+  return open;
+}
+
+static void nodeReply(const uint8_t* data, size_t len, void* ctx) {
+  NodeContext* node = (NodeContext*)ctx;
+  sendto(node->fd, data, len, 0, (sockaddr*)&node->peer, sizeof(node->peer));
+}
+
+static uint32_t nodeMicros(void* ctx) {
+  (void)ctx;
+  return nowMicros();
+}
+
+static int runNode(uint32_t bindIp, uint16_t port, uint16_t id, bool dryRun) {
+  NodeContext node;
+  node.fd = openUdp(bindIp, port);
+  node.dryRun = dryRun;
+  if (node.fd < 0) {
+    perror("bind");
+    return 1;
+  }
+
+  RelayNode::Hooks hooks = {nodeWake, nodeProbe, nodeReply, nodeMicros, &node};
+  RelayNode relay(relayKey, id, hooks);
+  printf("📡 relay node %u listening on port %u\n", id, port);
+  fflush(stdout);
+
+  uint8_t buffer[RELAY_MAX_DATAGRAM];
+  for (;;) {
+    socklen_t peerLen = sizeof(node.peer);
+    ssize_t len = recvfrom(node.fd, buffer, sizeof(buffer), 0, (sockaddr*)&node.peer, &peerLen);
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      perror("recvfrom");
+      return 1;
+    }
+
+    int ran = relay.handle(buffer, (size_t)len);
+    if (ran < 0) {
+      printf("⛔ rejected datagram from %s (auth %u, replay %u)\n", inet_ntoa(node.peer.sin_addr),
+             relay.stats().rejectedAuth, relay.stats().rejectedReplay);
+    }
+    fflush(stdout);
+  }
+}
+
+// ========== DISPATCH ==========
+struct DispatchContext {
+  int fd;
+  sockaddr_in relays[RelayDispatcher::MAX_RELAYS];
+  int relayCount;
+};
+
+static void dispatchSend(uint8_t relay, const uint8_t* data, size_t len, void* ctx) {
+  DispatchContext* d = (DispatchContext*)ctx;
+  sendto(d->fd, data, len, 0, (sockaddr*)&d->relays[relay], sizeof(d->relays[relay]));
+}
+
+// "host:port,node", node being the relay's --id
+static bool parseRelay(const char* text, sockaddr_in& addr, uint16_t& node) {
+  char host[64];
+  unsigned port, id;
+  if (sscanf(text, "%63[^:]:%u,%u", host, &port, &id) != 3 || port > 65535 || id > 65535) return false;
+  uint32_t ip;
+  if (!parseIp(host, ip)) return false;
+  addr = makeAddr(ip, (uint16_t)port);
+  node = (uint16_t)id;
+  return true;
+}
+
+// "relay,MAC[,broadcast[,port[,repeats]]]"
+static bool parseWake(const char* text, uint8_t& relay, RelayJob& job) {
+  char mac[18] = "", bcast[16] = "";
+  unsigned r, port = 9, repeats = 1;
+  int n = sscanf(text, "%u,%17[^,],%15[^,],%u,%u", &r, mac, bcast, &port, &repeats);
+  if (n < 2 || !parseMac(mac, job.mac)) return false;
+
+  job.type = RELAY_JOB_WAKE;
+  job.ip = 0;
+  if (n >= 3 && !parseIp(bcast, job.ip)) return false;
+  job.port = (uint16_t)port;
+  job.param = (uint16_t)repeats;
+  relay = (uint8_t)r;
+  return true;
+}
+
+// "relay,ip,port[,timeoutMs]"
+static bool parseProbe(const char* text, uint8_t& relay, RelayJob& job) {
+  char ip[16];
+  unsigned r, port, timeout = RELAY_DEFAULT_PROBE_TIMEOUT;
+  if (sscanf(text, "%u,%15[^,],%u,%u", &r, ip, &port, &timeout) < 3) return false;
+  if (!parseIp(ip, job.ip)) return false;
+
+  memset(job.mac, 0, sizeof(job.mac));
+  job.type = RELAY_JOB_PROBE;
+  job.port = (uint16_t)port;
+  job.param = (uint16_t)timeout;
+  relay = (uint8_t)r;
+  return true;
+}
+
+// Relays refuse sessions older than the last one they saw from this id, so
+// every dispatch takes the next one. Starting from the clock keeps it growing
+// when the file is lost; the lock keeps concurrent dispatches apart.
+static bool nextSession(const char* path, uint32_t& session) {
+  int fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) return false;
+  flock(fd, LOCK_EX);
+  char text[16] = "";
+  ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+  uint32_t last = n > 0 ? (uint32_t)strtoul(text, NULL, 10) : 0;
+  uint32_t now = (uint32_t)time(NULL);
+  session = last >= now ? last + 1 : now;
+  int len = snprintf(text, sizeof(text), "%u\n", session);
+  bool ok = ftruncate(fd, 0) == 0 && pwrite(fd, text, len, 0) == len;
+  close(fd);
+  return ok;
+}
+
+static int runDispatch(int argc, char** argv, int first, uint16_t id, const char* sessionFile, uint32_t timeoutMs,
+                       uint32_t retryMs) {
+  DispatchContext d;
+  d.relayCount = 0;
+  d.fd = openUdp(INADDR_ANY, 0);
+  if (d.fd < 0) {
+    perror("socket");
+    return 1;
+  }
+
+  uint32_t session;
+  if (!nextSession(sessionFile, session)) {
+    perror(sessionFile);
+    return 1;
+  }
+  RelayDispatcher dispatcher(relayKey, id, session);
+
+  for (int i = first; i + 1 < argc; i++) {
+    RelayJob job;
+    uint8_t relay;
+    if (!strcmp(argv[i], "--relay")) {
+      uint16_t node;
+      if (d.relayCount >= RelayDispatcher::MAX_RELAYS || !parseRelay(argv[i + 1], d.relays[d.relayCount], node)) {
+        fprintf(stderr, "bad relay: %s\n", argv[i + 1]);
+        return 2;
+      }
+      dispatcher.setRelayNode((uint8_t)d.relayCount++, node);
+      i++;
+    } else if (!strcmp(argv[i], "--wake") || !strcmp(argv[i], "--probe")) {
+      bool ok = argv[i][2] == 'w' ? parseWake(argv[i + 1], relay, job) : parseProbe(argv[i + 1], relay, job);
+      if (!ok || relay >= d.relayCount || dispatcher.add(relay, job) < 0) {
+        fprintf(stderr, "bad job (relays must come first): %s\n", argv[i + 1]);
+        return 2;
+      }
+      i++;
+    } else if (!strcmp(argv[i], "--timeout") || !strcmp(argv[i], "--retry") || !strcmp(argv[i], "--key") ||
+               !strcmp(argv[i], "--id") || !strcmp(argv[i], "--session-file")) {
+      i++;
+    }
+  }
+  if (dispatcher.jobCount() == 0) {
+    fprintf(stderr, "nothing to dispatch\n");
+    return 2;
+  }
+
+  uint32_t start = nowMillis();
+  uint32_t lastSend = start;
+  int datagrams = dispatcher.transmit(dispatchSend, &d, start);
+
+  uint8_t buffer[RELAY_MAX_DATAGRAM];
+  while (!dispatcher.done() && nowMillis() - start < timeoutMs) {
+    pollfd pfd = {d.fd, POLLIN, 0};
+    if (poll(&pfd, 1, 20) == 1) {
+      ssize_t len = recv(d.fd, buffer, sizeof(buffer), 0);
+      if (len > 0) dispatcher.receive(buffer, (size_t)len, nowMillis());
+    }
+    if (nowMillis() - lastSend >= retryMs) {
+      lastSend = nowMillis();
+      datagrams += dispatcher.transmit(dispatchSend, &d, lastSend);
+    }
+  }
+
+  int failed = 0;
+  for (int i = 0; i < dispatcher.jobCount(); i++) {
+    const RelayJob& job = dispatcher.job(i);
+    const RelayResult& r = dispatcher.result(i);
+    const char* status = r.status == RELAY_OK ? "ok" : (r.status == RELAY_PENDING ? "no answer" : "failed");
+    if (r.status != RELAY_OK) failed++;
+
+    printf("relay %u  %-5s  %-9s", dispatcher.relayOf(i), job.type == RELAY_JOB_WAKE ? "wake" : "probe", status);
+    if (r.status != RELAY_PENDING) {
+      printf("  %4u ms  (relay %u us, %u tries)", dispatcher.latencyMs(i), r.micros, dispatcher.attempts(i));
+    }
+    printf("\n");
+  }
+  printf("⏱️ %d jobs, %d relays, %d datagrams, %u ms\n", dispatcher.jobCount(), d.relayCount, datagrams,
+         nowMillis() - start);
+
+  close(d.fd);
+  return failed ? 3 : 0;
+}
+
+// ========== MAIN ==========
+static void usage() {
+  fprintf(stderr,
+          "usage: wol_relay node --port P [--id N] [--bind IP] [--dry-run] [--key HEX]\n"
+          "       wol_relay dispatch --relay HOST:PORT,NODE... [--wake R,MAC[,BCAST[,PORT[,REPEATS]]]]...\n"
+          "                          [--probe R,IP,PORT[,TIMEOUT_MS]]... [--id N] [--timeout MS] [--retry MS] [--key HEX]\n"
+          "                          [--session-file PATH]\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+
+  uint16_t port = RELAY_DEFAULT_PORT, id = 0;
+  uint32_t bindIp = INADDR_ANY, timeoutMs = 5000, retryMs = 300;
+  bool dryRun = false;
+  const char* home = getenv("HOME");
+  char sessionFile[256];
+  snprintf(sessionFile, sizeof(sessionFile), "%s/.wol_relay_session", home ? home : ".");
+  for (int i = 2; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : "";
+    if (!strcmp(arg, "--port")) port = (uint16_t)atoi(value), i++;
+    else if (!strcmp(arg, "--id")) id = (uint16_t)atoi(value), i++;
+    else if (!strcmp(arg, "--timeout")) timeoutMs = (uint32_t)atoi(value), i++;
+    else if (!strcmp(arg, "--retry")) retryMs = (uint32_t)atoi(value), i++;
+    else if (!strcmp(arg, "--session-file")) snprintf(sessionFile, sizeof(sessionFile), "%s", value), i++;
+    else if (!strcmp(arg, "--dry-run")) dryRun = true;
+    else if (!strcmp(arg, "--bind") && !parseIp(value, bindIp)) return usage(), 2;
+    else if (!strcmp(arg, "--key") && !parseKey(value)) return usage(), 2;
+    else if (!strcmp(arg, "--bind") || !strcmp(arg, "--key")) i++;
+  }
+
+  if (!strcmp(argv[1], "node")) return runNode(bindIp, port, id ? id : 2, dryRun);
+  if (!strcmp(argv[1], "dispatch")) return runDispatch(argc, argv, 2, id ? id : 100, sessionFile, timeoutMs, retryMs);
+  usage();
+  return 2;
+}
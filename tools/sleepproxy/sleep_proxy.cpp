@@ -0,0 +1,234 @@
+// Sleep proxy (lib/SleepProxy) on Linux, against a real L2 segment. The
+// simulated segment scenarios live in test/test_sleepproxy.
+//
+//   sleep_proxy live --if IFACE --host IP,MAC,PORT[,PORT...] [--broadcast IP] [--retry MS] [--once]
+//       Proxies for the host on a real interface (e.g. one end of a veth
+//       pair) through an AF_PACKET socket and sends WoL on a SYN. Needs
+//       CAP_NET_RAW, and IP forwarding off so the kernel drops the SYNs.
+
+#include <SleepProxy.h>
+#include <WolPacket.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static const size_t FRAME_MAX = 1518;
+
+static uint32_t nowMillis() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000);
+}
+
+static bool parseIp(const char* text, uint32_t& ip) {
+  in_addr addr;
+  if (inet_pton(AF_INET, text, &addr) != 1) return false;
+  ip = ntohl(addr.s_addr);
+  return true;
+}
+
+static const char* ipText(uint32_t ip) {
+  static char text[4][16];
+  static int next = 0;
+  char* out = text[next++ % 4];
+  snprintf(out, 16, "%u.%u.%u.%u", ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF);
+  return out;
+}
+
+static const uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const uint8_t zeroMac[6] = {0, 0, 0, 0, 0, 0};
+
+// ========== LIVE ==========
+struct LiveContext {
+  int raw;
+  int udp;
+  int ifindex;
+  uint8_t mac[6];
+  uint32_t ip;
+  uint32_t broadcast;
+  uint8_t hostMac[6];
+  uint32_t hostIp;
+  uint32_t wakeMs;
+  bool done;
+};
+
+static void liveTransmit(const uint8_t* frame, size_t len, void* ctx) {
+  LiveContext* live = (LiveContext*)ctx;
+  sockaddr_ll addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sll_family = AF_PACKET;
+  addr.sll_ifindex = live->ifindex;
+  addr.sll_halen = 6;
+  memcpy(addr.sll_addr, frame, 6);
+  if (sendto(live->raw, frame, len, 0, (sockaddr*)&addr, sizeof(addr)) < 0) perror("sendto");
+}
+
+static void liveWake(uint8_t host, uint32_t client, uint16_t port, void* ctx) {
+  LiveContext* live = (LiveContext*)ctx;
+  (void)host;
+  uint8_t packet[WOL_PACKET_SIZE];
+  buildMagicPacket(live->hostMac, packet);
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(live->broadcast);
+  addr.sin_port = htons(9);
+  bool sent = sendto(live->udp, packet, sizeof(packet), 0, (sockaddr*)&addr, sizeof(addr)) == (ssize_t)sizeof(packet);
+
+  live->wakeMs = nowMillis();
+  printf("⚡ SYN from %s to port %u, WoL %s to %s\n", ipText(client), port, sent ? "sent" : "FAILED",
+         ipText(live->broadcast));
+  fflush(stdout);
+}
+
+static void liveHandover(uint8_t host, const SleepProxy::Event& event, void* ctx) {
+  LiveContext* live = (LiveContext*)ctx;
+  (void)host;
+  printf("🔁 %s is back after %u ms of proxying", ipText(live->hostIp), event.handoverMs - event.startMs);
+  if (event.wakes) printf(", SYN→handover %u ms (%u wake(s))", event.handoverMs - event.synMs, event.wakes);
+  printf("\n");
+  fflush(stdout);
+  live->done = true;
+}
+
+// "IP,MAC,PORT[,PORT...]"
+static int parseHost(char* text, LiveContext& live, uint16_t* ports) {
+  char* ip = strtok(text, ",");
+  char* mac = strtok(NULL, ",");
+  if (!ip || !mac || !parseIp(ip, live.hostIp) || !parseMac(mac, live.hostMac)) return -1;
+  int count = 0;
+  for (char* port = strtok(NULL, ","); port && count < SleepProxy::MAX_PORTS; port = strtok(NULL, ",")) {
+    ports[count++] = (uint16_t)atoi(port);
+  }
+  return count;
+}
+
+static bool openInterface(const char* name, LiveContext& live) {
+  live.raw = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (live.raw < 0) return false;
+
+  ifreq req;
+  memset(&req, 0, sizeof(req));
+  strncpy(req.ifr_name, name, IFNAMSIZ - 1);
+  if (ioctl(live.raw, SIOCGIFINDEX, &req) < 0) return false;
+  live.ifindex = req.ifr_ifindex;
+  if (ioctl(live.raw, SIOCGIFHWADDR, &req) < 0) return false;
+  memcpy(live.mac, req.ifr_hwaddr.sa_data, 6);
+  live.ip = 0;
+  if (ioctl(live.raw, SIOCGIFADDR, &req) == 0) live.ip = ntohl(((sockaddr_in*)&req.ifr_addr)->sin_addr.s_addr);
+
+  sockaddr_ll addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = live.ifindex;
+  if (bind(live.raw, (sockaddr*)&addr, sizeof(addr)) < 0) return false;
+
+  live.udp = socket(AF_INET, SOCK_DGRAM, 0);
+  int yes = 1;
+  setsockopt(live.udp, SOL_SOCKET, SO_BROADCAST, &yes, sizeof(yes));
+  setsockopt(live.udp, SOL_SOCKET, SO_BINDTODEVICE, name, strlen(name));
+  return live.udp >= 0;
+}
+
+static int runLive(const char* ifname, char* hostSpec, uint32_t broadcast, uint32_t retryMs, bool once) {
+  LiveContext live;
+  memset(&live, 0, sizeof(live));
+  live.broadcast = broadcast;
+
+  uint16_t ports[SleepProxy::MAX_PORTS];
+  int portCount = hostSpec ? parseHost(hostSpec, live, ports) : -1;
+  if (!ifname || portCount <= 0) {
+    fprintf(stderr, "live needs --if and --host IP,MAC,PORT[,PORT...]\n");
+    return 2;
+  }
+  if (!openInterface(ifname, live)) {
+    perror(ifname);
+    return 1;
+  }
+
+  SleepProxy::Hooks hooks = {liveTransmit, liveWake, liveHandover, &live};
+  SleepProxy proxy(live.mac, hooks, retryMs);
+  proxy.addHost(live.hostIp, live.hostMac, ports, portCount);
+  proxy.start(0, nowMillis());
+  printf("💤 proxying %s on %s, %d port(s)\n", ipText(live.hostIp), ifname, portCount);
+  fflush(stdout);
+
+  uint8_t frame[FRAME_MAX];
+  uint32_t nextMonitor = 0;
+  while (!(once && live.done)) {
+    // The kernel never ARPs a host it has no traffic for, ask like the sketch does
+    if (proxy.state(0) == PROXY_WAKING && (int32_t)(nowMillis() - nextMonitor) >= 0) {
+      uint8_t request[PROXY_ARP_FRAME_SIZE];
+      buildArpFrame(request, live.mac, broadcastMac, PROXY_ARP_REQUEST, live.mac, live.ip, zeroMac, live.hostIp);
+      liveTransmit(request, sizeof(request), &live);
+      nextMonitor = nowMillis() + 1000;
+    }
+
+    pollfd pfd = {live.raw, POLLIN, 0};
+    if (poll(&pfd, 1, 100) != 1) continue;
+    sockaddr_ll from;
+    socklen_t fromLen = sizeof(from);
+    ssize_t len = recvfrom(live.raw, frame, sizeof(frame), 0, (sockaddr*)&from, &fromLen);
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      perror("recvfrom");
+      return 1;
+    }
+    if (from.sll_pkttype == PACKET_OUTGOING) continue;
+    proxy.input(frame, (size_t)len, nowMillis());
+  }
+
+  const SleepProxy::Stats& stats = proxy.stats(0);
+  printf("📊 ARP answered %u, SYNs %u, dropped %u, wakes %u\n", stats.arpAnswered, stats.syns, stats.dropped,
+         stats.wakes);
+  close(live.udp);
+  close(live.raw);
+  return 0;
+}
+
+// ========== MAIN ==========
+static void usage() {
+  fprintf(stderr,
+          "usage: sleep_proxy live --if IFACE --host IP,MAC,PORT[,PORT...] [--broadcast IP] [--retry MS] [--once]\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+
+  uint32_t retryMs = 90000, broadcast = INADDR_BROADCAST;
+  const char* ifname = NULL;
+  char* hostSpec = NULL;
+  bool once = false;
+  for (int i = 2; i < argc; i++) {
+    const char* arg = argv[i];
+    char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!strcmp(arg, "--once")) once = true;
+    else if (!value) return usage(), 2;
+    else if (!strcmp(arg, "--retry")) retryMs = (uint32_t)atoi(value), i++;
+    else if (!strcmp(arg, "--if")) ifname = value, i++;
+    else if (!strcmp(arg, "--host")) hostSpec = value, i++;
+    else if (!strcmp(arg, "--broadcast") && parseIp(value, broadcast)) i++;
+    else return usage(), 2;
+  }
+
+  if (!strcmp(argv[1], "live")) return runLive(ifname, hostSpec, broadcast, retryMs, once);
+  usage();
+  return 2;
+}